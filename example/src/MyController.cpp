@@ -7,6 +7,7 @@ MyController::MyController(MyConfig &config) : MainController(config), myConfig(
 void MyController::init()
 {
     MainController::init();
+    statusTopic = mqttManager.addTopic("abris_velo/{hostname}");
     displayManager.printLine(0, "Init done!");
     Serial.println("Init done!");
 
@@ -29,7 +30,7 @@ void MyController::processEvent(String type, String action, std::vector<String>
     {
         if (action == "Connected")
         {
-            mqttManager.publish("abris_velo/" + String(hostname), "Connected");
+            mqttManager.publish(statusTopic, "Connected");
             mqttManager.subscribe("abris_velo/lampe");
         }
         else if (action == "Message")
@@ -14,6 +14,7 @@ private:
 
     MyConfig* myConfig;
     DHT dht;
+    MQTTTopicHandle statusTopic;
 
 public:
     MyController(MyConfig& config);
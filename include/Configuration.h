@@ -2,25 +2,33 @@
 #define CONFIGURATION_H
 
 #include <Arduino.h>
+#include <ArduinoJson.h>
 #include <EventManager.h>
 
+#include <functional>
+#include <vector>
+
 #ifdef ESP32
 #include <Preferences.h>
 #else
 #include <EEPROM.h>
-#include <ArduinoJson.h>
 #endif
 
+using ConfigCallback = std::function<void(const String& key, const String& value)>;
+
 class Configuration
 {
 public:
     int CONNECTION_TIMEOUT = 10000;
 
+    int CONFIG_VERSION = 1; // stored in snapshots, bump when preference keys change meaning
+
     const char *HOSTNAME = "ESP32";
     const char *OTA_HOST = "home.zore.org";
     const char *OTA_FINGERPRINT = "35 EF E8 CB CC 63 97 13 70 41 85 19 5C B3 CC 81 5A 79 C0 7A C1 1F 98 E6 1D D5 8B 98 23 50 B6 22";
     int OTA_PORT = 443;
     const char *OTA_URL = "esp/default/firmaware.bin"; // should be overriden in MyConfig
+    const char *OTA_PUBLIC_KEY = nullptr; // PEM ECDSA key, ESP32 updates then need a manifest signed by tools/ota_package.py
 
     int LCD_ADDRESS = 0x27;
     int LCD_COLS = 20;
@@ -44,15 +52,48 @@ public:
 
     bool setPreference(const String key, int value);
     bool setPreference(const String key, String value);
+    // Several values at once, nothing is written if one is invalid: a single EEPROM commit on ESP8266,
+    // unchanged values are not written, null removes the key. On ESP32 integers and booleans are stored as int,
+    // other values as strings (JSON text)
+    bool setPreferences(JsonDocument& values);
 
-    String getJsonConfig();
+    String getJsonConfig(const String& prefix = "");
     bool setJsonConfig(const String json);
 
+    // Stream the configuration as a JSON object (only keys starting with prefix)
+    size_t printJsonConfig(Print& out, const String& prefix = "");
+
+    // Binary snapshot: 16 bytes header (magic, format, CONFIG_VERSION, length, CRC32) + MessagePack map
+    size_t writeSnapshot(Print& out);
+    bool restoreSnapshot(const uint8_t* data, size_t length);
+    // Total length announced by the snapshot header at data, 0 while the header is incomplete, -1 if it is not a snapshot
+    int getSnapshotLength(const uint8_t* data, size_t length);
+
     int getPreference(const String key, int defaultValue = 0);
     String getPreference(const String key, const String &defaultValue = "");
 
     String getHostname();
 
+    // Storage instrumentation, to observe the cost of the configuration on the device
+    struct StorageStats {
+        uint32_t reads = 0;
+        uint32_t writes = 0;          // values actually written (or removed)
+        uint32_t skippedWrites = 0;   // unchanged values, not written
+        uint32_t commits = 0;
+        uint32_t payloadBytes = 0;    // key + value bytes of the written values (4 bytes per int), on both platforms
+        uint32_t flashBytes = 0;      // bytes rewritten in flash (NVS entries / EEPROM sector)
+        uint32_t commitTimeTotal = 0; // us
+        uint32_t commitTimeMax = 0;   // us
+    };
+    StorageStats getStorageStats();
+    void resetStorageStats();
+    String getStorageStatsInfos();
+
+    // Register a callback called after a preference value actually changed,
+    // a key ending with '*' matches every key starting with the given prefix
+    uint onChange(const String& key, ConfigCallback callback);
+    void removeOnChange(uint id);
+
 #ifndef ESP32
 #define EEPROM_PREFERENCES_SIZE 4096
     JsonDocument json_preferences;
@@ -63,13 +104,33 @@ public:
 private:
     static EventManager *eventManager; // Pointeur vers EventManager
 
+    struct Observer {
+        uint id;
+        String key;
+        bool prefix;
+        ConfigCallback callback;
+    };
+
+    std::vector<Observer> observers;
+    uint nextObserverId = 1;
+    String hostname;  // cached, kept up to date by notifyChange
+
+    void notifyChange(const String& key, const String& value);
+
+    StorageStats storageStats;
+    void recordCommit(size_t values, size_t payloadBytes, size_t flashBytes, unsigned long startMicros);
+
 #ifdef ESP32
     Preferences prefs;
+
+    bool setJsonPreference(const String key, JsonVariantConst value);
 #else
     EEPROMClass eeprom;
+    size_t storedLength = 0;  // length of the JSON currently stored in the EEPROM
 
     bool readJsonPreferences();
-    bool writeJsonPreferences();
+    bool writeJsonPreferences(size_t values, size_t payloadBytes);
+    bool mergeJsonPreferences(JsonDocument& doc, bool replace);
 
     bool writeVariable(const String key, int value);
     bool writeVariable(const String key, String value);
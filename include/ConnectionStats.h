@@ -0,0 +1,64 @@
+#ifndef CONNECTIONSTATS_H
+#define CONNECTIONSTATS_H
+
+#include <Arduino.h>
+
+/*
+Rolling statistics of a link (WiFi, MQTT): connect time histogram, uptime ratio, drops by reason,
+outage durations, reconnects and RSSI min / avg / max. Counted since boot or the last reset().
+A roam (deliberate move to another AP) is counted apart: not a drop, an outage or a reconnect, only its
+time down lowers the uptime ratio.
+*/
+class ConnectionStats
+{
+  public:
+    static const uint HISTOGRAM_BUCKETS = 6;  // connect time < 0.5 s, 1 s, 2 s, 5 s, 10 s, more
+    static const uint MAX_REASONS = 8;
+
+    void connected(unsigned long connectTime);
+    void disconnected(int reason);
+    void roamed();
+    void attemptFailed();
+    void sampleRssi(int rssi);
+    void reset();
+
+    bool isUp() { return up; }
+    float getUptimeRatio();  // 0..1
+    uint32_t getDrops() { return drops; }
+    uint32_t getReconnects() { return connects > roams + 1 ? connects - 1 - roams : 0; }
+    uint32_t getRoams() { return roams; }
+
+    String getInfos();
+    // {"up":<%>,"drops":n,"reconnects":n,"ct":<last connect time ms>[,"roams":n][,"rssi":[min,avg,max]]}
+    size_t printJson(Print& out);
+
+  private:
+    bool up = false;
+    unsigned long startedAt = 0;  // stats period start
+    unsigned long changedAt = 0;  // last up / down transition
+    unsigned long upTime = 0;     // ms, closed up periods
+    unsigned long longestOutage = 0;
+    unsigned long totalOutage = 0;
+    uint32_t outages = 0;
+
+    uint32_t connects = 0;
+    uint32_t failures = 0;
+    uint32_t drops = 0;
+    uint32_t roams = 0;
+    bool roaming = false;  // down since roamed()
+    unsigned long lastConnectTime = 0;
+    uint32_t histogram[HISTOGRAM_BUCKETS] = {0};
+    struct ReasonCount {
+        int reason;
+        uint32_t count;
+    };
+    ReasonCount reasons[MAX_REASONS];
+    uint reasonCount = 0;
+
+    int rssiMin = 0;
+    int rssiMax = 0;
+    int64_t rssiSum = 0;
+    uint32_t rssiSamples = 0;
+};
+
+#endif
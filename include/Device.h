@@ -4,6 +4,7 @@
 #include <Arduino.h>
 #include <Configuration.h>
 #include <EventManager.h>
+#include <MQTTManager.h>
 #include <TimeManager.h>
 #include <ESPUI.h>
 #include <functional>
@@ -27,6 +28,7 @@ class Device
             eventManager = &eventMgr;
         }
     };
+    virtual ~Device();
 
     // Méthode pour ajouter une commande et son action associée
     void addCommand(const std::string& command, std::function<void()> action);
@@ -38,6 +40,9 @@ class Device
     virtual void init();
     virtual void loop();
 
+    // Set by MainController::addDevice, MQTT messages are then routed only to matching devices
+    void setMQTTManager(MQTTManager* mqttManager);
+
     virtual bool subscribeMQTT(String topic);
     virtual bool unsubscribeMQTT(String topic);
 
@@ -58,6 +63,9 @@ class Device
    protected:
     Configuration& config;
     TimeManager& timeManager;
+    MQTTManager* mqttManager = nullptr;
+    std::map<String, uint> mqttHandlers;  // topic filter => MQTTManager handler id
+    uint configObserver = 0;              // Configuration::onChange id, 0 if none
 
     // Carte des commandes et de leurs actions associées
     std::map<std::string, std::function<void()>> commands;
@@ -21,6 +21,10 @@ public:
     // Déclenche un événement pour un type donné avec des paramètres
     void triggerEvent(const String& eventType, const String& event, const std::vector<String>& params);
 
+    // Déclenche la commande "<type>:<commande> [paramètres]" (événement <type> "@<commande>"),
+    // entrée série, telnet ou topic MQTT <hostname>/cmd. Faux si le format est incorrect
+    bool triggerCommand(const String& input);
+
     void registerDebugCallback(DebugCallBack callback);
     void debug(String message, int level = 0, bool displayTime = true);
 
@@ -0,0 +1,66 @@
+#ifndef MQTTBATCHPUBLISHER_H
+#define MQTTBATCHPUBLISHER_H
+
+#include <Arduino.h>
+#include <EventManager.h>
+#include <MQTTManager.h>
+#include <vector>
+
+typedef enum {
+    MQTT_BATCH_FLUSH_COUNT = 0,
+    MQTT_BATCH_FLUSH_SIZE = 1,
+    MQTT_BATCH_FLUSH_AGE = 2,
+    MQTT_BATCH_FLUSH_MANUAL = 3
+} mqtt_batch_flush_reason;
+
+/*
+Accumulates readings published under a topic prefix and publishes them as one message on
+<prefix>/batch when the count, size or age threshold of the stream is reached:
+{"t":<millis of the first reading>,"r":[["<subtopic>",<ms since first reading>,<value>],...]}
+maxAge is the latency bound of the stream. Streams may be nested ("sensors" and "sensors/room"),
+a reading goes to the stream with the longest matching prefix.
+*/
+class MQTTBatchPublisher
+{
+  public:
+    MQTTBatchPublisher(MQTTManager& mqttManager, EventManager& eventMgr) : mqttManager(mqttManager), eventManager(&eventMgr) {}
+
+    bool addStream(const String& topicPrefix, uint maxCount = 20, uint maxBytes = 512, uint maxAge = 10000);
+    bool removeStream(const String& topicPrefix);
+
+    // Readings outside any stream are published immediately
+    void add(const String& topic, int value);
+    void add(const String& topic, float value, int decimals = 2);
+    void add(const String& topic, const String& value);  // sent as a number if it is one, else as a string
+
+    void loop();
+    void flush();
+
+    String getInfos();
+
+  private:
+    struct BatchStream {
+        String prefix;
+        uint maxCount;
+        uint maxBytes;
+        uint maxAge;
+        String buffer;
+        uint count;
+        unsigned long firstAt;
+        // stats
+        uint32_t readings;
+        uint32_t batches;
+        uint32_t maxBatch;
+        uint32_t flushes[4];  // by mqtt_batch_flush_reason
+    };
+
+    MQTTManager& mqttManager;
+    EventManager* eventManager;
+    std::vector<BatchStream> streams;
+
+    BatchStream* findStream(const String& topic);
+    void addJson(const String& topic, const String& jsonValue);
+    void flushStream(BatchStream& stream, mqtt_batch_flush_reason reason);
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef MQTTBENCHMARK_H
+#define MQTTBENCHMARK_H
+
+#include <Arduino.h>
+#include <EventManager.h>
+#include <MQTTManager.h>
+#include <vector>
+
+// Bounds of start(), the latencies (4 bytes per message) and the padding are allocated up front
+#ifndef MQTT_BENCH_MAX_COUNT
+#define MQTT_BENCH_MAX_COUNT 2000
+#endif
+#ifndef MQTT_BENCH_MAX_SIZE
+#define MQTT_BENCH_MAX_SIZE 4096
+#endif
+#ifndef MQTT_BENCH_MAX_HANDLERS
+#define MQTT_BENCH_MAX_HANDLERS 32
+#endif
+
+/*
+Loopback benchmark through the broker: publishes count messages of size bytes on <hostname>/bench,
+subscribed with `handlers` handlers (exact and wildcard filters, like devices), and measures the
+publish rate, the receive rate and the round trip latency (p50 / p99 / max).
+At most `window` messages are in flight, messages not received 5 s after the last one are lost.
+start() refuses a count, size or handlers above the MQTT_BENCH_MAX_* bounds.
+*/
+class MQTTBenchmark
+{
+  public:
+    MQTTBenchmark(MQTTManager& mqttManager, EventManager& eventMgr) : mqttManager(mqttManager), eventManager(&eventMgr) {}
+
+    bool start(uint count, uint size, uint handlers = 1, uint window = 8);
+    void stop();
+    void loop();
+    bool isRunning() { return running; }
+
+    String getInfos();  // results of the last run
+
+  private:
+    MQTTManager& mqttManager;
+    EventManager* eventManager;
+    MQTTTopicHandle topic;
+    std::vector<uint> handlerIds;
+
+    bool running = false;
+    uint count = 0;
+    uint size = 0;
+    uint window = 8;
+    String padding;
+
+    uint sent = 0;
+    uint received = 0;
+    uint32_t deliveries = 0;  // handler calls
+    unsigned long startedAt = 0;     // us
+    unsigned long sentAt = 0;        // us, last publication
+    unsigned long lastReceived = 0;  // us
+    std::vector<uint32_t> latencies;  // us
+    String result;
+
+    void onMessage(const MQTTMessage& message);
+    void finish();
+};
+
+#endif
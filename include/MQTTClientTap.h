@@ -0,0 +1,56 @@
+#ifndef MQTTCLIENTTAP_H
+#define MQTTCLIENTTAP_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <functional>
+
+/*
+Client wrapper given to PubSubClient: forwards everything to the real client and follows the
+inbound MQTT packets to report the PUBACKs, which PubSubClient reads and discards, and the flags
+of the last PUBLISH (PubSubClient calls back before reading the next packet).
+*/
+class MQTTClientTap : public Client
+{
+  public:
+    MQTTClientTap(Client& client) : client(client) {}
+
+    void onPuback(std::function<void(uint16_t packetId)> callback);
+    bool isLastPublishRetained() { return (publishFlags & 0x01) != 0; }
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+#ifdef ESP32
+    int connect(IPAddress ip, uint16_t port, int32_t timeout);
+    int connect(const char* host, uint16_t port, int32_t timeout);
+#endif
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override;
+
+  private:
+    enum { TAP_HEADER, TAP_LENGTH, TAP_BODY } state = TAP_HEADER;
+
+    Client& client;
+    std::function<void(uint16_t)> pubackCallback;
+
+    uint8_t packetType = 0;
+    uint8_t publishFlags = 0;
+    uint32_t remaining = 0;
+    uint32_t multiplier = 1;
+    uint32_t bodyIndex = 0;
+    uint8_t body[2];
+
+    void feed(uint8_t c);
+    void packetDone();
+    void reset();
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef MQTTLOGSHIPPER_H
+#define MQTTLOGSHIPPER_H
+
+#include <Arduino.h>
+#include <EventManager.h>
+#include <MQTTManager.h>
+#include <deque>
+
+/*
+Buffers debug lines and publishes them in batches on the log topic, as a JSON array:
+[{"time":"12:00:00","level":1,"message":"..."},...]
+Batches are sent every `interval` ms (sooner when a batch is full) and limited by a token bucket
+of `burst` batches refilled at `rate` batches per minute. When the buffer is full the oldest lines
+are dropped, and the next batch starts with a "N log messages dropped" line.
+*/
+class MQTTLogShipper
+{
+  public:
+    MQTTLogShipper(MQTTManager& mqttManager, EventManager& eventMgr) : mqttManager(mqttManager), eventManager(&eventMgr) {}
+
+    void setTopic(MQTTTopicHandle topic) { this->topic = topic; }
+    void configure(uint interval, uint rate, uint burst = 3);
+
+    void add(int level, const String& time, const String& message);
+    void loop();
+
+    String getInfos();
+
+  private:
+    struct LogEntry {
+        String time;
+        int level;
+        String message;
+    };
+
+    static const uint MAX_LINES = 64;
+    static const uint MAX_BYTES = 4096;  // buffered message text
+    static const uint MAX_PAYLOAD = 1024;
+
+    MQTTManager& mqttManager;
+    EventManager* eventManager;
+    MQTTTopicHandle topic;
+    std::deque<LogEntry> lines;
+    size_t bufferedBytes = 0;
+    bool shipping = false;  // lines produced while publishing are not shipped (no feedback loop)
+
+    uint interval = 2000;
+    uint rate = 30;  // batches per minute
+    uint burst = 3;
+    float tokens = 3;
+    unsigned long lastRefill = 0;
+    unsigned long lastFlush = 0;
+
+    // stats
+    uint32_t pendingDropped = 0;
+    uint32_t shipped = 0;
+    uint32_t dropped = 0;
+    uint32_t batches = 0;
+    uint32_t throttled = 0;
+
+    void refill();
+    size_t entrySize(const LogEntry& entry) const;
+    void publishBatch();
+};
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <Arduino.h>
 #include <PubSubClient.h>
+#include <map>
 #include <vector>
 // #include <WiFiManager.h>
 #include <Configuration.h>
@@ -10,19 +11,47 @@
 #include <ESPUI.h>
 #endif
 #include <EventManager.h>
+#include <ConnectionStats.h>
+#include <MQTTClientTap.h>
+#include <MQTTPublishQueue.h>
+#include <MQTTTopicTrie.h>
 #ifdef ESP32
 #include <WiFi.h>
 #else
 #include <ESP8266WiFi.h>
 #endif
+#include <lwip/ip_addr.h>
+
+typedef enum {
+    MQTT_STATE_IDLE = 0,         // waiting for status 2 (WiFi connected)
+    MQTT_STATE_BACKOFF = 1,      // waiting before the next attempt
+    MQTT_STATE_RESOLVING = 2,    // asynchronous DNS resolution of the server
+    MQTT_STATE_CONNECTING = 3,   // TCP + MQTT CONNECT, blocks up to connectTimeout
+    MQTT_STATE_SUBSCRIBING = 4,  // replaying subscriptions, one per loop
+    MQTT_STATE_CONNECTED = 5
+} mqtt_connect_state;
+
+// Topic registered once with MQTTManager::addTopic, see publish(MQTTTopicHandle, ...)
+struct MQTTTopicHandle {
+    int index = -1;
+    bool isValid() const { return index >= 0; }
+};
+
+// Writes a payload to out, must write the same bytes each time it is called
+using MQTTPayloadWriter = std::function<void(Print& out)>;
 
 class MQTTManager
 {
 
   public:
-    MQTTManager(Configuration& config, EventManager& eventMgr) : config(config), mqttClient(wifiClient) { 
+    MQTTManager(Configuration& config, EventManager& eventMgr) : config(config), clientTap(wifiClient), mqttClient(clientTap) { 
         this->eventManager = &eventMgr;
     }
+    ~MQTTManager()
+    {
+        config.removeOnChange(serverObserver);
+        config.removeOnChange(hostnameObserver);
+    }
 
     // 0 = disabled, 1 = waiting wifi to connect, 2 = keep connected
     uint status = 0;
@@ -40,13 +69,48 @@ class MQTTManager
 
     void setStatus(uint status);
 
+    // Also trigger the mqtt/message event (copies topic and payload) for every message
+    void setMessageEvents(bool enabled, bool save = true);
+
+    // Request a connection attempt on the next loop, skipping the backoff delay
     bool reconnect();
     bool isConnected();
+    String getConnectInfos();
+    ConnectionStats& getStats();
+    // Time spent routing inbound messages (handlers and mqtt/message event)
+    String getDispatchInfos();
+    void resetDispatchStats();
 
     // void onMessage(char* topic, byte* payload, unsigned int length);
 
     // void registerCallback(MQTTCallback callback);
-    void publish(String topic, String payload, bool enableDebug = true);
+    // Messages published while disconnected are queued and replayed on reconnection
+    void publish(const String& topic, const String& payload, bool enableDebug = true, bool retained = false);
+    void publish(MQTTTopicHandle handle, const String& payload, bool enableDebug = true, bool retained = false);
+    // At-least-once delivery: queued, sent within the in-flight window and retransmitted until acknowledged
+    bool publishQos1(String topic, String payload, bool retained = false);
+    // Stream a payload of any size in bounded memory: writer is called twice, to measure then to send.
+    // Not queued, returns false while disconnected or while queued messages are replayed (see canPublishStream)
+    bool publishStream(String topic, MQTTPayloadWriter writer, bool retained = false);
+    // Send length bytes read from source (e.g. a LittleFS file)
+    bool publishStream(String topic, Stream& source, size_t length, bool retained = false);
+    bool publishStream(MQTTTopicHandle handle, MQTTPayloadWriter writer, bool retained = false);
+    // publishStream would send now: connected, no queued message to replay first
+    bool canPublishStream();
+
+    // Build a topic once, "{hostname}" is replaced and kept up to date when the hostname changes.
+    // With subscribe, the topic is also added to the subscriptions (and moved when it changes)
+    MQTTTopicHandle addTopic(const String& pattern, bool subscribe = false);
+    void setTopic(MQTTTopicHandle handle, const String& pattern);
+    const String& getTopic(MQTTTopicHandle handle) const;
+    // Subscribe to the command topic (e.g. "{hostname}/cmd"): each message is a command line run with
+    // EventManager::triggerCommand ("<device id>:<command> [params]"), retained messages are ignored
+    void setCommandTopic(const String& pattern);
+    // Retransmit timer, to call periodically (see MainController::init)
+    void checkInflight();
+    void setInflightWindow(uint window, uint ackTimeout = 5000, uint maxRetries = 5);
+    String getQos1Infos();
+
     void subscribe(String topic);
     void unsubscribe(String topic);
 
@@ -62,6 +126,18 @@ class MQTTManager
 
     String getDebugInfos();
 
+    // Route messages matching filter (wildcards allowed) directly to handler
+    uint addHandler(String filter, MQTTHandler handler);
+    // Same without copy: the message points to the receive buffer, only valid during the call
+    uint addMessageHandler(String filter, MQTTMessageHandler handler);
+    bool removeHandler(uint id);
+
+    // Shared subscription: the broker subscription is reference counted across handlers, and the
+    // last value received on matching topics is cached and delivered at once to new handlers
+    uint subscribeHandler(String filter, MQTTHandler handler);
+    bool unsubscribeHandler(uint id);
+    String getCacheInfos();
+
     bool addSubscription(String topic);
     bool removeSubscription(String topic);
     std::vector<String> getSubscriptions();
@@ -69,6 +145,10 @@ class MQTTManager
     bool storePublication(String topic, String payload);
     bool removePublication(String topic);
 
+    void setQueuePolicy(String topicPrefix, mqtt_queue_policy policy);
+    bool setQueueSpill(bool enabled, bool save = true);
+    String getQueueInfos();
+
 #ifndef DISABLE_ESPUI
     void initEspUI();
     void EspUiCallback(Control* sender, int type);
@@ -76,16 +156,123 @@ class MQTTManager
 
   private:
     Configuration& config;
+    uint serverObserver = 0;  // Configuration::onChange ids
+    uint hostnameObserver = 0;
 
     WiFiClient wifiClient;
+    MQTTClientTap clientTap;
     PubSubClient mqttClient;
     static EventManager* eventManager;  // Pointeur vers EventManager
 
     bool connected = false;
 
+    // Connection state machine, one step per loop
+    mqtt_connect_state connectState = MQTT_STATE_IDLE;
+    IPAddress serverIP;
+    bool serverResolved = false;
+    bool dnsPending = false;               // asynchronous lookup started, see dnsFound
+    String dnsName;                        // its host name, only accessed with the TCP/IP core locked
+    volatile bool dnsDone = false;         // set by the lwIP callback (TCP/IP task on ESP32)
+    volatile uint32_t dnsAddress = 0;      // 0 if the lookup failed
+    uint connectTimeout = 2000;    // ms, TCP connect and CONNACK
+    uint backoffMin = 1000;        // ms
+    uint backoffMax = 60000;       // ms
+    uint backoff = 0;              // current backoff, doubled on each failure
+    unsigned long retryDelay = 0;  // backoff with jitter
+    unsigned long lastAttempt = 0;
+    unsigned long attemptStart = 0;
+    uint consecutiveFailures = 0;
+    size_t subscriptionIndex = 0;
+
+    // Connection metrics
+    uint connectAttempts = 0;
+    uint connectFailures = 0;
+    unsigned long lastConnectLatency = 0;
+    unsigned long maxConnectLatency = 0;
+    unsigned long totalConnectLatency = 0;
+    uint connectCount = 0;
+    ConnectionStats stats;
+
+    int resolveServer();  // 1 resolved, 0 in progress, -1 failed
+    static void dnsFound(const char* name, const ip_addr_t* address, void* arg);
+    bool connectBroker();
+    void scheduleRetry();
+    void replaySubscription();
+
     std::vector<String> subscriptions;
 
-    std::map<String, String> publications;
+    struct TopicEntry {
+        String pattern;
+        String topic;
+        bool subscribe;
+    };
+    std::vector<TopicEntry> topics;
+
+    void buildTopic(TopicEntry& entry);
+
+    // Shared subscriptions and last-value cache
+    static const uint CACHE_MAX_ENTRIES = 32;
+    static const uint CACHE_MAX_PAYLOAD = 256;
+    std::map<String, uint> subscriptionRefs;  // filter => handlers
+    std::map<uint, String> sharedHandlers;    // handler id => filter
+    struct CachedValue {
+        String payload;
+        uint32_t used;  // cacheClock when last updated or delivered, the least recently used is evicted
+    };
+    std::map<String, CachedValue> lastValues;  // topic => value
+    uint32_t cacheHits = 0;
+    uint32_t cacheEvictions = 0;
+    uint32_t cacheClock = 0;
+
+    void cacheValue(const MQTTMessage& message);
+
+    MQTTTopicTrie handlers;
+    bool messageEvents = true;
+    MQTTTopicHandle commandTopic;
+
+    // Dispatch metrics
+    uint32_t dispatchCount = 0;
+    uint64_t dispatchTime = 0;  // us
+    uint32_t dispatchMax = 0;   // us
+
+    void onMessage(char* topic, byte* payload, unsigned int length);
+
+    MQTTPublishQueue publishQueue;
+    uint replayBurst = 5;       // queued messages sent per loop iteration
+    uint replayInterval = 50;   // ms between two bursts
+    unsigned long lastReplay = 0;
+
+    void replayQueue();
+    // Publish from RAM, streamed when the payload does not fit in the client buffer
+    bool sendMessage(const String& topic, const String& payload, bool retained);
+    bool sendStream(const String& topic, size_t length, bool retained, const MQTTPayloadWriter& writer);
+
+    // QoS 1 publications
+    struct InflightMessage {
+        uint16_t packetId;
+        MQTTQueuedMessage message;
+        unsigned long sentAt;  // 0 = to be (re)sent
+        uint8_t retries;
+        bool transmitted;  // written at least once, later copies have the DUP flag
+    };
+    struct Qos1Stats {
+        uint32_t sent = 0;
+        uint32_t acked = 0;
+        uint32_t retries = 0;
+        uint32_t failed = 0;
+    };
+    MQTTPublishQueue qos1Queue;
+    std::vector<InflightMessage> inflight;
+    uint inflightWindow = 4;
+    uint ackTimeout = 5000;  // ms
+    uint maxRetries = 5;
+    uint16_t nextPacketId = 0x8000;  // PubSubClient numbers its SUBSCRIBE packets from 1
+    Qos1Stats qos1Stats;
+
+    void onPuback(uint16_t packetId);
+    void fillInflight();
+    bool sendQos1(InflightMessage& inflightMessage);
+    uint16_t allocatePacketId();
 
 #ifndef DISABLE_ESPUI
     // ESPUI:
@@ -0,0 +1,91 @@
+#ifndef MQTTPUBLISHQUEUE_H
+#define MQTTPUBLISHQUEUE_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <deque>
+#include <vector>
+
+typedef enum {
+    MQTT_QUEUE_KEEP_ALL = 0,    // every message is kept and replayed in order
+    MQTT_QUEUE_LATEST_ONLY = 1  // a new message replaces the queued one for the same topic
+} mqtt_queue_policy;
+
+struct MQTTQueuedMessage {
+    String topic;
+    String payload;
+    bool retained;
+};
+
+/*
+Bounded outbound queue used while the broker is not reachable.
+The RAM tier holds up to maxMessages / maxBytes, keep-all messages overflow to an optional
+LittleFS spill file (replayed after the RAM tier, and after a reboot), otherwise the oldest
+message is dropped. Latest-only messages always stay in RAM.
+The replay position in the spill file is saved (<path>.pos) each time a batch read back from it
+has been sent, so at most one batch is sent again after a reboot.
+*/
+class MQTTPublishQueue
+{
+  public:
+    struct Stats {
+        uint32_t queued = 0;
+        uint32_t replayed = 0;
+        uint32_t replaced = 0;  // latest-only messages overwritten
+        uint32_t dropped = 0;   // lost because the queue was full
+        uint32_t spilled = 0;   // written to the spill file
+    };
+
+    MQTTPublishQueue(size_t maxMessages = 32, size_t maxBytes = 4096) : maxMessages(maxMessages), maxBytes(maxBytes) {}
+
+    void setPolicy(const String& topicPrefix, mqtt_queue_policy policy);
+    mqtt_queue_policy getPolicy(const String& topic);
+
+    bool enableSpill(const char* path = "/mqtt_queue.bin", size_t maxFileSize = 32768);
+    void disableSpill();
+    bool isSpillEnabled();
+
+    // Returns false if a message had to be dropped
+    bool push(const String& topic, const String& payload, bool retained = false);
+    bool push(const String& topic, const String& payload, bool retained, mqtt_queue_policy policy);
+    bool remove(const String& topic);
+    void clear();
+
+    bool isEmpty();
+    size_t size();
+    MQTTQueuedMessage* front();  // nullptr if empty or the spill file could not be read
+    void pop();
+
+    Stats getStats();
+    String getInfos();
+
+  private:
+    size_t maxMessages;
+    size_t maxBytes;
+    size_t bytes = 0;
+    std::deque<MQTTQueuedMessage> messages;
+    std::vector<std::pair<String, mqtt_queue_policy>> policies;
+
+    bool spillEnabled = false;
+    String spillPath;
+    size_t spillMaxSize = 0;
+    size_t spillReadOffset = 0;
+    size_t spillSize = 0;
+    size_t spillCount = 0;
+    size_t spillPending = 0;  // messages at the front of the RAM tier read back from the file, not sent yet
+
+    Stats stats;
+
+    bool isFull(size_t extraBytes);
+    void pushRam(const String& topic, const String& payload, bool retained);
+    void dropOldest();
+    std::deque<MQTTQueuedMessage>::iterator eraseMessage(std::deque<MQTTQueuedMessage>::iterator it);
+    bool spill(const String& topic, const String& payload, bool retained);
+    void refill();
+    void clearSpill();
+    void spillSent();
+    void saveSpillOffset();
+    String getOffsetPath() { return spillPath + ".pos"; }
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef MQTTTOPICTRIE_H
+#define MQTTTOPICTRIE_H
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+/*
+Inbound message as views over the PubSubClient receive buffer, only valid during the callback.
+topicString() / payloadString() make a copy, done once and shared by all the handlers.
+*/
+struct MQTTMessage {
+    const char* topic;
+    const uint8_t* payload;
+    unsigned int length;
+
+    MQTTMessage(const char* topic, const uint8_t* payload, unsigned int length) : topic(topic), payload(payload), length(length) {}
+
+    const String& topicString() const;
+    const String& payloadString() const;
+    bool payloadEquals(const char* str) const;
+
+  private:
+    mutable String topicCopy;
+    mutable String payloadCopy;
+    mutable bool topicCopied = false;
+    mutable bool payloadCopied = false;
+};
+
+using MQTTMessageHandler = std::function<void(const MQTTMessage& message)>;
+using MQTTHandler = std::function<void(const String& topic, const String& payload)>;
+
+/*
+Subscription trie: maps MQTT topic filters (with '+' and '#' wildcards) to handlers,
+a topic is routed with one walk over its levels instead of comparing every filter.
+*/
+class MQTTTopicTrie
+{
+  public:
+    uint add(const String& filter, MQTTMessageHandler handler);
+    bool remove(uint id);
+    size_t size();
+
+    // Call visitor for every handler whose filter matches topic, returns the number of matches.
+    // The ids are collected first: a visitor may add or remove handlers, a handler removed during
+    // the dispatch is not called anymore, one added is called from the next message
+    size_t match(const String& topic, std::function<void(const MQTTMessageHandler&)> visitor);
+
+    static bool matches(const String& filter, const String& topic);
+
+  private:
+    struct Entry {
+        String filter;
+        // shared: a handler removing itself stays alive until it returns
+        std::shared_ptr<MQTTMessageHandler> handler;
+    };
+
+    struct Node {
+        std::map<String, std::unique_ptr<Node>> children;
+        std::unique_ptr<Node> plus;  // '+' level
+        std::vector<uint> handlers;  // ids of the filters ending at this level
+        std::vector<uint> multi;     // ids of the filters ending with '#' after this level
+
+        bool isEmpty() { return children.empty() && !plus && handlers.empty() && multi.empty(); }
+    };
+
+    Node root;
+    std::map<uint, Entry> entries;
+    uint nextId = 1;
+    std::vector<uint> matched;  // kept between messages, no allocation once large enough
+
+    void matchNode(Node* node, const std::vector<String>& levels, size_t index, std::vector<uint>& ids);
+    bool removeNode(Node* node, const std::vector<String>& levels, size_t index, uint id);
+    static bool removeId(std::vector<uint>& ids, uint id);
+};
+
+#endif
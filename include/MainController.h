@@ -7,6 +7,9 @@
 #include <DisplayManager.h>
 #include <WiFiManager.h>
 #include <MQTTManager.h>
+#include <MQTTBatchPublisher.h>
+#include <MQTTLogShipper.h>
+#include <MQTTBenchmark.h>
 #ifndef DISABLE_ESPUI
 #include <ESPUIManager.h>
 #endif
@@ -34,17 +37,32 @@ protected:
     WiFiManager wiFiManager;
     MQTTManager mqttManager;
     TimeManager timeManager;
+    MQTTBatchPublisher telemetry;
+    MQTTLogShipper logShipper;
+    MQTTBenchmark benchmark;
 
     #ifndef DISABLE_ESPUI
     ESPUIManager espUIManager;
     #endif
 
+    int debugLevel = 0;  // cached "debug_level" preference, read for every debug message
     int powerSaving = 0; // 0 = disabled, else = idle time in ms while power saving (100 is a good value)
     bool timeSet = false;
 
     std::vector<Device*> devices;
 
     uint powerSavingRemumeTimer = 0;
+
+    // Snapshot received by sys:restore, one console line at a time
+    std::vector<uint8_t> restoreBuffer;
+    void restoreChunk(const String& hex);
+
+    // Compact link statistics published on <hostname>/status
+    MQTTTopicHandle statusTopic;
+    uint statusTimer = 0;
+    void setStatusInterval(int seconds, bool save = true);
+    void publishStatus();
+
     void setPowerSaving(int value, bool save = true);
 
 public:
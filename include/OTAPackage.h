@@ -0,0 +1,132 @@
+#ifndef OTAPACKAGE_H
+#define OTAPACKAGE_H
+
+#ifdef ESP32
+#include <Arduino.h>
+#include <functional>
+#include <rom/miniz.h>
+
+/*
+OTA package (built by tools/ota_package.py): a 28 bytes header followed by the payload,
+a zlib stream and/or a delta against the running firmware (COPY / INSERT operations).
+*/
+#define OTA_PACKAGE_MAGIC "EMOT"
+#define OTA_PACKAGE_FORMAT 1
+#define OTA_PACKAGE_HEADER_SIZE 28
+#define OTA_PACKAGE_COMPRESSED 0x01
+#define OTA_PACKAGE_DELTA 0x02
+#define OTA_DELTA_COPY 0x01    // source offset (u32) | length (u32)
+#define OTA_DELTA_INSERT 0x02  // length (u32) | bytes
+
+#define OTA_PACKAGE_INPUT_SIZE 2048
+#define OTA_PACKAGE_OUTPUT_SIZE 4096  // one flash sector per write
+#define OTA_PACKAGE_STEP_BYTES 8192   // written (or source bytes checked) per process()
+
+struct OTAPackageHeader {
+    uint8_t flags = 0;
+    uint8_t windowBits = 0;
+    uint32_t imageSize = 0;
+    uint32_t imageCrc = 0;
+    uint32_t sourceSize = 0;
+    uint32_t sourceCrc = 0;
+    uint32_t payloadSize = 0;
+
+    bool parse(const uint8_t* data);  // OTA_PACKAGE_HEADER_SIZE bytes
+    bool isPlain() { return flags == 0; }
+};
+
+/*
+Signed manifest of an image, fetched next to it (<url>.manifest):
+  magic "EMOM" | format (u8) | reserved (3 bytes) | image size (u32) | image SHA-256 (32 bytes) | signature
+The signature is a DER ECDSA signature of the SHA-256 of the first OTA_MANIFEST_SIGNED_SIZE bytes.
+*/
+#define OTA_MANIFEST_MAGIC "EMOM"
+#define OTA_MANIFEST_FORMAT 1
+#define OTA_MANIFEST_SIGNED_SIZE 44
+#define OTA_MANIFEST_MAX_SIZE 160
+
+struct OTAManifest {
+    uint32_t imageSize = 0;
+    uint8_t sha256[32];
+    String error;
+
+    bool load(const uint8_t* data, size_t length, const char* publicKey);  // PEM public key
+};
+
+/*
+Streaming decoder: inflates the payload in a 2^windowBits bytes window, applies the delta and writes
+the image through the output callback by OTA_PACKAGE_OUTPUT_SIZE blocks.
+RAM is only allocated between begin() and end(): window + ~11 KB inflate state + input and output buffers.
+A plain payload (flags 0) is written as is.
+*/
+class OTAPackageDecoder
+{
+  public:
+    typedef std::function<bool(const uint8_t* data, size_t length)> OutputCallback;
+    typedef std::function<bool(uint32_t offset, uint8_t* data, size_t length)> SourceCallback;
+
+    ~OTAPackageDecoder() { end(); }
+
+    void setOutput(OutputCallback output) { this->output = output; }
+    void setSource(SourceCallback source) { this->source = source; }
+
+    bool begin(const OTAPackageHeader& header);
+    void end();
+
+    // Payload bytes are received in place: write up to `space` bytes at getInput() then commit them
+    uint8_t* getInput(size_t& space);
+    void commitInput(size_t length);
+    bool needsInput() { return starved; }
+
+    bool process();  // false on error
+    bool flush();
+    bool isComplete();
+
+    size_t getProduced() { return produced; }
+    uint32_t getCrc() { return crc; }
+    String getError() { return error; }
+
+  private:
+    OutputCallback output;
+    SourceCallback source;
+    OTAPackageHeader header;
+    String error;
+
+    tinfl_decompressor* inflator = nullptr;
+    uint8_t* window = nullptr;
+    size_t windowPos = 0;
+    bool inflateDone = false;
+
+    uint8_t* input = nullptr;
+    size_t inputStart = 0;
+    size_t inputEnd = 0;
+    size_t payloadReceived = 0;
+    bool starved = false;
+
+    const uint8_t* pending = nullptr;  // decoded payload not yet applied
+    size_t pendingLength = 0;
+
+    uint8_t op[9];
+    size_t opLength = 0;
+    uint32_t copyOffset = 0;
+    uint32_t copyRemaining = 0;
+    uint32_t insertRemaining = 0;
+    uint32_t sourceChecked = 0;
+    uint32_t sourceCrc = 0;
+
+    uint8_t* outputBuffer = nullptr;
+    size_t outputLength = 0;
+    size_t produced = 0;
+    size_t stepBytes = 0;
+    uint32_t crc = 0;
+
+    bool checkSource();
+    bool decode();
+    size_t patch(const uint8_t* data, size_t length);
+    bool copy();
+    bool emit(const uint8_t* data, size_t length);
+    bool fail(const String& error);
+};
+#endif
+
+#endif
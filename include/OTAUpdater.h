@@ -0,0 +1,174 @@
+#ifndef OTAUPDATER_H
+#define OTAUPDATER_H
+
+#include <Arduino.h>
+#include <EventManager.h>
+#ifdef ESP32
+#include <OTAPackage.h>
+#include <esp_https_ota.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+#endif
+
+typedef enum {
+    OTA_IDLE = 0,
+    OTA_DOWNLOADING = 1,
+    OTA_DONE = 2,  // restarting on the new image
+    OTA_FAILED = 3,
+    OTA_ABORTED = 4
+} ota_state;
+
+typedef enum {
+    OTA_STEP_CONTINUE = 0,
+    OTA_STEP_DONE = 1,
+    OTA_STEP_ERROR = 2
+} ota_step_result;
+
+/*
+Transport + flash writer of an update, driven chunk by chunk by OTAUpdater.
+step() must return after at most one network read: its duration bounds how far a loop() can exceed the budget.
+*/
+class OTABackend
+{
+  public:
+    virtual ~OTABackend() {}
+
+    virtual bool begin(const String& url) = 0;  // connect and read the headers
+    virtual ota_step_result step() = 0;
+    virtual bool finish() = 0;  // validate the image and select it for the next boot
+    virtual void abort() = 0;
+
+    virtual size_t getReceived() = 0;
+    virtual size_t getTotal() = 0;  // 0 if unknown
+    virtual String getError() = 0;
+    virtual String getInfos() { return ""; }
+};
+
+#ifdef ESP32
+#define OTA_CONNECT_TIMEOUT 5000  // ms, connection (TLS handshake included) and manifest request
+#define OTA_READ_TIMEOUT 20       // ms, a read without data returns after it (ESP-IDF 5+)
+
+// esp_https_ota advanced API: one esp_https_ota_perform() per step, each read blocks up to OTA_CONNECT_TIMEOUT
+class EspHttpsOTABackend : public OTABackend
+{
+  public:
+    bool begin(const String& url) override;
+    ota_step_result step() override;
+    bool finish() override;
+    void abort() override;
+
+    size_t getReceived() override;
+    size_t getTotal() override;
+    String getError() override { return error; }
+
+  private:
+    String url;  // referenced by the HTTP client until the end
+    esp_https_ota_handle_t handle = nullptr;
+    size_t received = 0;
+    size_t total = 0;
+    String error;
+};
+
+/*
+HTTP(S) download written with esp_ota_*, accepting OTA packages (compressed and/or delta, see OTAPackage.h)
+as well as plain images. The package is decoded while it is received, the image CRC and SHA-256 are
+computed as it is written.
+With a public key, the signed manifest (<url>.manifest) is fetched first and the new partition is only
+selected if the image matches it.
+A broken or stalled download is resumed with a Range request, up to OTA_RESUME_RETRIES times in a row.
+Blocking: begin() and each (re)connection block up to OTA_CONNECT_TIMEOUT (plus the manifest request), a read
+waits up to OTA_READ_TIMEOUT for data on ESP-IDF 5+, up to OTA_CONNECT_TIMEOUT on older versions.
+*/
+#define OTA_RESUME_RETRIES 5
+#define OTA_STALL_TIMEOUT 10000  // ms without data before reconnecting
+
+class PackageOTABackend : public OTABackend
+{
+  public:
+    void setPublicKey(const char* publicKey) { this->publicKey = publicKey; }  // PEM, nullptr: no manifest
+
+    bool begin(const String& url) override;
+    ota_step_result step() override;
+    bool finish() override;
+    void abort() override;
+
+    size_t getReceived() override { return received; }
+    size_t getTotal() override { return total; }
+    String getError() override { return error; }
+    String getInfos() override;
+
+  private:
+    String url;
+    const char* publicKey = nullptr;
+    esp_http_client_handle_t client = nullptr;
+    const esp_partition_t* partition = nullptr;  // written
+    const esp_partition_t* running = nullptr;    // delta source
+    esp_ota_handle_t handle = 0;
+    bool writing = false;
+
+    OTAManifest manifest;
+    bool hasManifest = false;
+    mbedtls_sha256_context sha;
+
+    OTAPackageHeader header;
+    OTAPackageDecoder decoder;
+    uint8_t headerBuffer[OTA_PACKAGE_HEADER_SIZE];
+    size_t headerLength = 0;
+    bool decoding = false;
+
+    size_t received = 0;
+    size_t total = 0;
+    String error;
+
+    int retries = 0;  // since the last data received
+    int resumes = 0;
+    unsigned long reconnectAt = 0;
+    unsigned long lastData = 0;
+
+    bool fetchManifest();
+    bool connect(size_t offset);
+    ota_step_result retry(const String& reason);
+    bool startImage();
+    void close();
+};
+#endif
+
+/*
+Non-blocking update: each loop() processes chunks for `budget` ms, reports progress with ota/progress
+events (percent, received, total) and restarts once the image is validated.
+The budget is checked between steps, a loop() takes up to budget + one step: see the backends for
+the duration of a step (a (re)connection blocks for seconds when the server does not answer).
+*/
+class OTAUpdater
+{
+  public:
+    OTAUpdater(EventManager& eventMgr) : eventManager(&eventMgr) {}
+
+    void setBackend(OTABackend* backend) { this->backend = backend; }  // not owned
+    bool start(const String& url);
+    void loop();
+    void abort();
+
+    ota_state getState() { return state; }
+    bool isRunning() { return state == OTA_DOWNLOADING; }
+    String getInfos();
+
+    uint budget = 20;  // ms per loop
+
+  private:
+    EventManager* eventManager;
+    OTABackend* backend = nullptr;
+    ota_state state = OTA_IDLE;
+    String error;
+
+    unsigned long startedAt = 0;
+    unsigned long duration = 0;
+    unsigned long restartAt = 0;
+    int lastProgress = -1;  // percent, or 64 KB steps if the size is unknown
+
+    void reportProgress();
+    void fail(const String& error);
+    uint32_t getThroughput();  // bytes/s
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <Arduino.h>
+
+/*
+Fixed-size byte FIFO, no allocation. Data is read in place: peek() gives the longest contiguous
+readable block, consume() releases it once sent.
+*/
+template <size_t N>
+class RingBuffer
+{
+  public:
+    size_t capacity() const { return N; }
+    size_t size() const { return count; }
+    size_t available() const { return N - count; }
+    bool empty() const { return count == 0; }
+
+    // Returns the number of bytes written, less than length if the buffer is full
+    size_t write(const uint8_t* data, size_t length)
+    {
+        if (length > available()) {
+            length = available();
+        }
+        for (size_t i = 0; i < length; i++) {
+            buffer[(head + count + i) % N] = data[i];
+        }
+        count += length;
+        return length;
+    }
+
+    size_t peek(const uint8_t*& data) const
+    {
+        data = buffer + head;
+        return head + count <= N ? count : N - head;
+    }
+
+    int indexOf(uint8_t c) const
+    {
+        for (size_t i = 0; i < count; i++) {
+            if (buffer[(head + i) % N] == c) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void consume(size_t length)
+    {
+        if (length > count) {
+            length = count;
+        }
+        head = (head + length) % N;
+        count -= length;
+    }
+
+    void clear()
+    {
+        head = 0;
+        count = 0;
+    }
+
+  private:
+    uint8_t buffer[N];
+    size_t head = 0;
+    size_t count = 0;
+};
+
+#endif
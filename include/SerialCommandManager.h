@@ -8,6 +8,21 @@
 #include <map>
 #include <vector>
 
+#define SERIAL_RX_BUFFER_SIZE 1024  // UART driver buffer, ~90 ms at 115200 baud between two loops
+// Longest command line, also the ring size: a configuration snapshot is restored in several lines (sys:restore)
+#ifndef SERIAL_LINE_SIZE
+#define SERIAL_LINE_SIZE 512
+#endif
+#define SERIAL_FRAME_START 0x01  // SOH | length (u16 LE) | bytes
+
+/*
+Reads everything available with bulk reads straight into a fixed ring buffer, where lines are assembled
+without heap allocation (a complete line is then sent as a serial/input event).
+A line ends with CR, LF or CR LF, backspace removes the previous byte and whitespace is trimmed.
+A frame starting with SERIAL_FRAME_START carries its length and is sent as is: CR, LF, NUL... are kept.
+Lines and frames longer than SERIAL_LINE_SIZE are dropped with a warning.
+Power saving is suspended when a line starts and resumed when it ends.
+*/
 class SerialCommandManager
 {
   public:
@@ -26,9 +41,21 @@ class SerialCommandManager
     int baudRate = 115200;
     Configuration& config;
 
-    String inputBuffer;
+    uint8_t ring[SERIAL_LINE_SIZE];
+    size_t lineStart = 0;  // ring index of the first byte of the current line
+    size_t lineLength = 0;
+    bool lineStarted = false;
+    bool overflow = false;    // dropped until the end of the line
+    bool lastCR = false;      // the LF of a CR LF is not another line
+    uint8_t frameHeader = 0;  // length bytes still expected
+    size_t frameRemaining = 0;
+    bool frame = false;
 
     void handleSerialInput();
+    void processByte(size_t pos);
+    void append(size_t pos);
+    void startLine();
+    void endLine();
 
     static EventManager* eventManager;
 };
@@ -0,0 +1,84 @@
+#ifndef TELNETCONSOLE_H
+#define TELNETCONSOLE_H
+
+#include <Arduino.h>
+#include <EventManager.h>
+#include <RingBuffer.h>
+#include <SerialCommandManager.h>
+#ifdef ESP32
+#include <WiFi.h>
+#else
+#include <ESP8266WiFi.h>
+#endif
+
+#ifndef TELNET_MAX_CLIENTS
+#define TELNET_MAX_CLIENTS 3
+#endif
+#ifndef TELNET_BUFFER_SIZE
+#ifdef ESP32
+#define TELNET_BUFFER_SIZE 2048
+#else
+#define TELNET_BUFFER_SIZE 1024
+#endif
+#endif
+
+typedef enum {
+    TELNET_DROP_OLDEST = 0,  // discard the oldest lines to make room
+    TELNET_DROP_NEWEST = 1   // discard what does not fit
+} telnet_drop_policy;
+
+/*
+Console server for several telnet clients. print() only copies the text to a ring buffer per
+client, loop() sends it without blocking: lines are batched into segments of up to
+SEGMENT_SIZE bytes, or sent after FLUSH_DELAY ms. A slow client only loses its own output.
+Input lines trigger the telnet/input event, longer lines than MAX_INPUT are rejected with an error.
+*/
+class TelnetConsole
+{
+  public:
+    static const size_t SEGMENT_SIZE = 536;  // TCP MSS
+    static const uint FLUSH_DELAY = 20;      // ms
+    static const size_t MAX_INPUT = SERIAL_LINE_SIZE;  // same commands as the serial console
+
+    TelnetConsole(EventManager& eventMgr) : eventManager(&eventMgr) {}
+
+    bool begin(uint16_t port);
+    void stop();
+    void loop();
+
+    size_t print(const String& text);
+    size_t write(const uint8_t* data, size_t length);
+    bool isConnected();
+    uint getClientCount();
+
+    void setDropPolicy(telnet_drop_policy policy) { dropPolicy = policy; }
+    String getInfos();
+
+  private:
+    struct Client {
+        WiFiClient client;
+        bool active = false;
+        RingBuffer<TELNET_BUFFER_SIZE> output;
+        String input;
+        bool overflow = false;  // input line too long, rejected at its end
+        uint8_t skip = 0;  // telnet negotiation bytes to ignore
+        unsigned long pendingSince = 0;
+        uint32_t sent = 0;
+        uint32_t segments = 0;
+        uint32_t dropped = 0;
+    };
+
+    EventManager* eventManager;
+    WiFiServer* server = nullptr;
+    uint16_t port = 23;
+    Client clients[TELNET_MAX_CLIENTS];
+    telnet_drop_policy dropPolicy = TELNET_DROP_OLDEST;
+
+    void accept();
+    void readInput(Client& client, uint index);
+    void drain(Client& client);
+    int sendNonBlocking(Client& client, const uint8_t* data, size_t length);
+    void close(Client& client, uint index);
+};
+
+#endif
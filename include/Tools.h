@@ -1,3 +1,6 @@
+#ifndef TOOLS_H
+#define TOOLS_H
+
 #include <Arduino.h>
 #include <vector>
 
@@ -5,3 +8,43 @@ String splitString(String data, char separator, int index);
 std::vector<String> split(const String& str, char delimiter);
 std::vector<String> splitParameters(const String& paramStr);
 bool isInteger(const String& str);
+
+// Copy a (not null terminated) buffer into a String
+String bytesToString(const uint8_t* data, size_t length);
+
+// Print a quoted and escaped JSON string
+size_t printJsonString(Print& out, const char* str);
+
+// Number in the JSON grammar: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? (no nan, inf, hex or spaces)
+bool isJsonNumber(const String& str);
+
+// CRC-32 (IEEE 802.3, same as zlib), can be chained by passing the previous crc
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0);
+
+// Decode an hexadecimal string, returns an empty vector if invalid
+std::vector<uint8_t> fromHex(const String& hex);
+
+// Print adapter writing each byte as two hexadecimal characters
+class HexPrint : public Print
+{
+  public:
+    HexPrint(Print& out) : out(out) {}
+
+    size_t write(uint8_t c) override;
+    using Print::write;
+
+  private:
+    Print& out;
+};
+
+// Print sink counting the bytes written, to size a payload before streaming it
+class PrintCounter : public Print
+{
+  public:
+    size_t write(uint8_t c) override { count++; return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { count += size; return size; }
+
+    size_t count = 0;
+};
+
+#endif
@@ -3,16 +3,19 @@
 
 #include <Arduino.h>
 #include <Configuration.h>
-#include <ESPTelnet.h>
+#include <TelnetConsole.h>
 #ifndef DISABLE_ESPUI
 #include <ESPUI.h>
 #endif
 #include <EventManager.h>
+#include <ConnectionStats.h>
 #include <Tools.h>
+#include <atomic>
+#include <vector>
 
+#include <OTAUpdater.h>
 #ifdef ESP32
 #include <WiFi.h>
-#include <esp_https_ota.h>
 #endif
 #ifdef ESP8266
 #include <ESP8266WiFi.h>
@@ -25,13 +28,37 @@ typedef enum {
     WM_AP_MODE_ON_ERROR = 2
 } wm_ap_mode;
 
+// Driver events, recorded by the callbacks and processed in WiFiManager::loop
+typedef enum {
+    WM_EVENT_GOT_IP = 1,
+    WM_EVENT_DISCONNECTED = 2,
+    WM_EVENT_LOST_IP = 4
+} wm_wifi_event;
+
+// Stored network: slot 0 is wf_ssid / wf_pass, slots 1..3 are wf_ssid<n> / wf_pass<n>
+struct WiFiProfile {
+    uint8_t slot;
+    String ssid;
+    String password;
+};
+
+// Scan result, see WiFiManager::scanNetworks
+struct WiFiNetwork {
+    char ssid[33];
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+    uint8_t auth;  // encryption type
+};
+
 class WiFiManager
 {
   private:
     static const uint CONNECTION_TIMEOUT = 10000;
 
     Configuration& config;
-    ESPTelnet telnet;
+    uint configObserver = 0;  // Configuration::onChange id
+    TelnetConsole telnet;
     uint16_t telnetPort = 23;
 
     bool connected = false;
@@ -39,8 +66,97 @@ class WiFiManager
     // 0 = start, 1 = connection in progress, 2 = initial connection failed, 3 = connection lost, 4 = disconnection, 5 = Access Point, 6 = Wrong Password, 10 = connection success
     uint connectionStatus = 0;
     uint timeout = 0;
-    uint checkDelay = 100;
-    uint tryCount = 0;
+    uint tryCount = 0;  // failed attempts
+
+    std::atomic<uint32_t> pendingEvents{0};  // wm_wifi_event mask
+    std::atomic<uint8_t> disconnectReason{0};
+#ifdef ESP32
+    wifi_event_id_t wifiEventId = 0;  // 0 = not registered
+#else
+    WiFiEventHandler gotIPHandler;  // released = unregistered
+    WiFiEventHandler disconnectedHandler;
+#endif
+
+    void registerWiFiEvents();
+    void unregisterWiFiEvents();
+    void processWiFiEvents(uint32_t events);
+    void checkAttempt();
+
+    // Fast reconnect: the last good BSSID and channel (and optionally the IP configuration, skipping DHCP)
+    // are kept in the preferences and passed to WiFi.begin, with a fallback to a full scan
+    static const uint FAST_CONNECT_TIMEOUT = 3000;
+    uint8_t fastBssid[6] = {0};
+    int32_t fastChannel = 0;  // 0 = nothing cached
+    String fastSSID;          // network of the cached connection
+    bool fastIP = false;
+    IPAddress fastLocalIP;
+    IPAddress fastGateway;
+    IPAddress fastSubnet;
+    IPAddress fastDns;
+    bool fastAttempt = false;  // the current attempt uses the cache
+    unsigned long connectStart = 0;
+
+    // Time to connected
+    unsigned long lastConnectTime = 0;
+    uint fastConnects = 0;
+    uint fullConnects = 0;
+    uint fastFailures = 0;
+    unsigned long fastConnectTotal = 0;
+    unsigned long fullConnectTotal = 0;
+
+    // Asynchronous scan, results ranked by RSSI
+    static const uint SCAN_MAX_AGE = 60000;  // ms, older results are not used to connect
+    std::vector<WiFiNetwork> networks;
+    unsigned long scannedAt = 0;
+    bool scanning = false;
+    bool scanReport = false;  // print the results (wifi:scan)
+
+    void checkScan();
+    const WiFiNetwork* findNetwork(const String& ssid);
+
+    // Network profiles
+    static const uint MAX_PROFILES = 4;
+    std::vector<WiFiProfile> profiles;
+    String activeSSID;  // profile of the current connection attempt
+
+    void loadProfiles();
+    const WiFiProfile* findProfile(const String& ssid);
+    const WiFiNetwork* bestKnownNetwork(const uint8_t* excludeBssid = nullptr);
+    bool connectTo(const WiFiProfile& profile, const WiFiNetwork* target);
+
+    // Link monitoring and roaming: the RSSI is averaged (EWMA) every 2 s, below roamThreshold a
+    // background scan looks for a known AP stronger by at least roamHysteresis dB
+    static const uint RSSI_INTERVAL = 2000;
+    static const uint HISTORY_INTERVAL = 10000;
+    static const uint HISTORY_SIZE = 30;  // 5 minutes
+    int roamThreshold = -75;  // dBm, 0 = roaming disabled
+    uint roamHysteresis = 8;  // dB
+    uint roamInterval = 60000;  // ms between two roaming scans
+    float rssiAverage = 0;
+    int8_t rssiHistory[HISTORY_SIZE];
+    uint historyCount = 0;
+    unsigned long lastRssiSample = 0;
+    unsigned long lastHistorySample = 0;
+    unsigned long lastRoamScan = 0;
+    bool roamScan = false;
+    uint roamCount = 0;
+    uint roamScans = 0;
+
+    void monitorLink();
+    void checkRoaming();
+
+    ConnectionStats stats;
+
+    OTAUpdater ota;
+#ifdef ESP32
+    PackageOTABackend otaBackend;
+#endif
+
+    void loadFastConnect();
+    void saveFastConnect();
+    void clearFastConnect();
+    void fallbackFullConnect();
+    void onConnected();
 
     static EventManager* eventManager;  // Pointeur vers EventManager
 
@@ -51,13 +167,18 @@ class WiFiManager
 #endif
 
   public:
-    WiFiManager(Configuration& config, EventManager& eventMgr) : config(config)
+    WiFiManager(Configuration& config, EventManager& eventMgr) : config(config), telnet(eventMgr), ota(eventMgr)
     {
         this->apIP = IPAddress(192, 168, 1, 249);
         if (eventManager == nullptr) {
             eventManager = &eventMgr;
         }
     }
+    ~WiFiManager()
+    {
+        config.removeOnChange(configObserver);
+        unregisterWiFiEvents();
+    }
 
     wm_ap_mode apMode = WM_AP_MODE_ON_ERROR;
     
@@ -79,6 +200,7 @@ class WiFiManager
     void setupTelnet();
     void stopTelnet();
     void printTelnet(String message);
+    void writeTelnet(const uint8_t* data, size_t length);
     void stopAccessPoint();
     String getStatus();
     String getSSID();
@@ -90,12 +212,29 @@ class WiFiManager
     String retrievePassword();
     String retrieveIP();
     String getInfo(String name);
-    void scanNetworks(bool show_hidden = false);
-    int getNetworks();
-    int getNetworkCount(bool show_hidden = false);
+    // Start an asynchronous scan, completed by the wifi/scan_done event
+    bool scanNetworks(bool show_hidden = false);
+    bool isScanning();
+    // Cached results (strongest first) and their age in ms
+    const std::vector<WiFiNetwork>& getScanResults();
+    unsigned long getScanAge();
+    int getNetworks();  // number of cached results, -1 while scanning
+    int getNetworkCount(bool show_hidden = false);  // cached count, or -1 and a new scan if none is recent
     void setNetwork(int n, bool save = false);
     String getNetworkInfo(int n, String name);
 
+    // Additional networks, tried by signal strength and used for roaming
+    bool addProfile(const String& ssid, const String& password);
+    bool removeProfile(const String& ssid);
+    const std::vector<WiFiProfile>& getProfiles();
+    void setRoaming(int threshold, uint hysteresis, bool save = true);
+    String getLinkInfos();
+
+    // Reuse the cached IP configuration instead of DHCP on fast reconnects
+    void setFastIP(bool enabled, bool save = true);
+    String getConnectInfos();
+    ConnectionStats& getStats();
+
     //void WiFiEvent(WiFiEvent_t event);
 
 #ifndef DISABLE_ESPUI
@@ -103,7 +242,10 @@ class WiFiManager
     void EspUiCallback(Control* sender, int type);
 #endif
 
+    // Non-blocking on ESP32 (see OTAUpdater), blocking on ESP8266
     bool otaUpdate();
+    void otaAbort();
+    String getOtaInfos();
 };
 
 #endif
@@ -1,7 +1,31 @@
 #include "../include/Configuration.h"
+#include "../include/Tools.h"
+#include <StreamString.h>
+#include <algorithm>
 
 EventManager* Configuration::eventManager = nullptr;
 
+#define SNAPSHOT_MAGIC "EMCS"
+#define SNAPSHOT_FORMAT 1
+#define SNAPSHOT_HEADER_SIZE 16
+#define SNAPSHOT_MAX_BODY 16384  // larger announced lengths are corrupted headers
+
+static void writeLE(uint8_t* dest, uint32_t value, int size)
+{
+    for (int i = 0; i < size; i++) {
+        dest[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static uint32_t readLE(const uint8_t* src, int size)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < size; i++) {
+        value |= (uint32_t)src[i] << (8 * i);
+    }
+    return value;
+}
+
 #ifdef ESP32
 Configuration::Configuration() {}
 #else
@@ -40,11 +64,24 @@ bool Configuration::setPreference(const String key, int value)
     }
 
 #ifdef ESP32
+    if (prefs.isKey(key.c_str()) && prefs.getInt(key.c_str()) == value) {
+        storageStats.skippedWrites++;
+        return true;
+    }
+    unsigned long start = micros();
     prefs.putInt(key.c_str(), value);
-    return true;
+    recordCommit(1, key.length() + sizeof(int32_t), 32, start);  // one 32 bytes NVS entry
 #else
-    return writeVariable(key, value);
+    if (json_preferences[key].is<int>() && json_preferences[key].as<int>() == value) {
+        storageStats.skippedWrites++;
+        return true;
+    }
+    if (!writeVariable(key, value)) {
+        return false;
+    }
 #endif
+    notifyChange(key, String(value));
+    return true;
 }
 
 bool Configuration::setPreference(const String key, String value)
@@ -53,15 +90,175 @@ bool Configuration::setPreference(const String key, String value)
         return false;
     }
 #ifdef ESP32
+    if (prefs.isKey(key.c_str()) && prefs.getString(key.c_str()) == value) {
+        storageStats.skippedWrites++;
+        return true;
+    }
+    unsigned long start = micros();
     prefs.putString(key.c_str(), value.c_str());
+    // header entry + data entries of 32 bytes (including the terminating zero)
+    recordCommit(1, key.length() + value.length(), 32 * (1 + (value.length() + 32) / 32), start);
+#else
+    if (json_preferences[key].is<const char*>() && value == json_preferences[key].as<const char*>()) {
+        storageStats.skippedWrites++;
+        return true;
+    }
+    if (!writeVariable(key, value)) {
+        return false;
+    }
+#endif
+    notifyChange(key, value);
     return true;
+}
+
+// Integers and booleans are stored as int preferences, every other value as a string (JSON text if not a string)
+static bool isIntValue(JsonVariantConst value)
+{
+    return value.is<int>() || value.is<bool>();
+}
+
+static String stringValue(JsonVariantConst value)
+{
+    if (value.is<const char*>()) {
+        return value.as<const char*>();
+    }
+    String text;
+    serializeJson(value, text);
+    return text;
+}
+
+// Key + value bytes of a value, as counted in StorageStats::payloadBytes (a null value removes the key)
+static size_t payloadSize(const char* key, JsonVariantConst value)
+{
+    if (value.isNull()) {
+        return strlen(key);
+    }
+    return strlen(key) + (isIntValue(value) ? sizeof(int32_t) : stringValue(value).length());
+}
+
+// First key of values that cannot be stored on both platforms, nullptr if they all can
+static const char* invalidPreference(JsonDocument& values)
+{
+    for (JsonPair kv : values.as<JsonObject>()) {
+        size_t keyLength = strlen(kv.key().c_str());
+        if (keyLength == 0 || keyLength > 16 || (!isIntValue(kv.value()) && !kv.value().isNull() && stringValue(kv.value()).length() > 255)) {
+            return kv.key().c_str();
+        }
+    }
+    return nullptr;
+}
+
+bool Configuration::setPreferences(JsonDocument& values)
+{
+    // nothing is written if one of the values is invalid
+    if (invalidPreference(values) != nullptr) {
+        return false;
+    }
+#ifdef ESP32
+    bool ok = true;
+    for (JsonPair kv : values.as<JsonObject>()) {
+        ok = setJsonPreference(kv.key().c_str(), kv.value()) && ok;
+    }
+    return ok;
 #else
-    return writeVariable(key, value);
+    return mergeJsonPreferences(values, false);
 #endif
 }
 
+#ifdef ESP32
+bool Configuration::setJsonPreference(const String key, JsonVariantConst value)
+{
+    if (value.isNull()) {
+        if (!prefs.isKey(key.c_str())) {
+            return true;
+        }
+        unsigned long start = micros();
+        prefs.remove(key.c_str());
+        recordCommit(1, key.length(), 0, start);  // only the entry state bits are rewritten
+        notifyChange(key, "");
+        return true;
+    }
+    if (isIntValue(value)) {
+        return setPreference(key, value.as<int>());
+    }
+    return setPreference(key, stringValue(value));
+}
+#endif
+
+void Configuration::recordCommit(size_t values, size_t payloadBytes, size_t flashBytes, unsigned long startMicros)
+{
+    uint32_t duration = micros() - startMicros;
+    storageStats.writes += values;
+    storageStats.commits++;
+    storageStats.payloadBytes += payloadBytes;
+    storageStats.flashBytes += flashBytes;
+    storageStats.commitTimeTotal += duration;
+    if (duration > storageStats.commitTimeMax) {
+        storageStats.commitTimeMax = duration;
+    }
+}
+
+Configuration::StorageStats Configuration::getStorageStats()
+{
+    return storageStats;
+}
+
+void Configuration::resetStorageStats()
+{
+    storageStats = StorageStats();
+}
+
+String Configuration::getStorageStatsInfos()
+{
+    const StorageStats& stats = storageStats;
+    String infos = "Reads: " + String(stats.reads);
+    infos += "\nWrites: " + String(stats.writes) + " (" + String(stats.skippedWrites) + " unchanged skipped)";
+    infos += "\nCommits: " + String(stats.commits);
+    if (stats.commits > 0) {
+        infos += ", avg " + String(stats.commitTimeTotal / stats.commits) + " us, max " + String(stats.commitTimeMax) + " us";
+    }
+    infos += "\nBytes: " + String(stats.payloadBytes) + " payload, " + String(stats.flashBytes) + " flash";
+    if (stats.payloadBytes > 0) {
+        infos += " (write amplification x" + String((float)stats.flashBytes / stats.payloadBytes, 1) + ")";
+    }
+    return infos;
+}
+
+uint Configuration::onChange(const String& key, ConfigCallback callback)
+{
+    Observer observer;
+    observer.id = nextObserverId++;
+    observer.prefix = key.endsWith("*");
+    observer.key = observer.prefix ? key.substring(0, key.length() - 1) : key;
+    observer.callback = callback;
+    observers.push_back(observer);
+    return observer.id;
+}
+
+void Configuration::removeOnChange(uint id)
+{
+    observers.erase(std::remove_if(observers.begin(), observers.end(), [id](const Observer& observer) { return observer.id == id; }),
+                    observers.end());
+}
+
+void Configuration::notifyChange(const String& key, const String& value)
+{
+    if (key == "hostname") {
+        hostname = value;
+    }
+    // index loop: a callback may register another observer
+    for (size_t i = 0; i < observers.size(); i++) {
+        const Observer& observer = observers[i];
+        if (observer.prefix ? key.startsWith(observer.key) : key == observer.key) {
+            ConfigCallback callback = observer.callback;
+            callback(key, value);
+        }
+    }
+}
+
 int Configuration::getPreference(const String key, int defaultValue)
 {
+    storageStats.reads++;
 #ifdef ESP32
     return prefs.getInt(key.c_str(), defaultValue);
 #else
@@ -71,6 +268,7 @@ int Configuration::getPreference(const String key, int defaultValue)
 
 String Configuration::getPreference(const String key, const String& defaultValue)
 {
+    storageStats.reads++;
 #ifdef ESP32
     return prefs.getString(key.c_str(), defaultValue);
 #else
@@ -78,62 +276,188 @@ String Configuration::getPreference(const String key, const String& defaultValue
 #endif
 }
 
-String Configuration::getJsonConfig()
+String Configuration::getJsonConfig(const String& prefix)
 {
-    String jsonString;
+    StreamString jsonString;
+    printJsonConfig(jsonString, prefix);
+    return jsonString;
+}
+
+size_t Configuration::printJsonConfig(Print& out, const String& prefix)
+{
+    size_t written = out.print('{');
+    bool first = true;
 #ifdef ESP32
     for (int i = 0; i < prefs.length(); i++) {
+        int type = prefs.type(i);
+        if (type != PREF_INT && type != PREF_STRING) {
+            continue;
+        }
         String key = prefs.key(i);
-        if (prefs.type(i) == PREF_INT) {
-            jsonString += "\"" + key + "\": " + prefs.getInt(key) + ", ";
-        } else if (prefs.type(i) == PREF_STRING) {
-            jsonString += "\"" + key + "\": \"" + prefs.getString(key) + "\", ";
+        if (!key.startsWith(prefix)) {
+            continue;
+        }
+        if (!first) {
+            written += out.print(',');
+        }
+        first = false;
+        written += printJsonString(out, key.c_str());
+        written += out.print(':');
+        if (type == PREF_INT) {
+            written += out.print(prefs.getInt(key.c_str()));
+        } else {
+            written += printJsonString(out, prefs.getString(key.c_str()).c_str());
         }
     }
 #else
-    serializeJson(json_preferences, jsonString);
+    for (JsonPair kv : json_preferences.as<JsonObject>()) {
+        if (strncmp(kv.key().c_str(), prefix.c_str(), prefix.length()) != 0) {
+            continue;
+        }
+        if (!first) {
+            written += out.print(',');
+        }
+        first = false;
+        written += printJsonString(out, kv.key().c_str());
+        written += out.print(':');
+        written += serializeJson(kv.value(), out);
+    }
 #endif
-    return jsonString;
+    written += out.print('}');
+    return written;
 }
 
 bool Configuration::setJsonConfig(const String json)
 {
-#ifdef ESP32
-    DeserializationError error = deserializeJson(json_preferences, json);
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, json);
     if (error) {
         Serial.print("Failed to deserialize JSON: ");
         Serial.println(error.c_str());
         return false;
     }
-    for (JsonPair kv : json_preferences.as<JsonObject>()) {
-        if (kv.value().is<int>()) {
-            setPreference(kv.key().c_str(), kv.value().as<int>());
-        } else if (kv.value().is<String>()) {
-            setPreference(kv.key().c_str(), kv.value().as<String>());
+    return setPreferences(doc);
+}
+
+size_t Configuration::writeSnapshot(Print& out)
+{
+#ifdef ESP32
+    JsonDocument doc;
+    for (int i = 0; i < prefs.length(); i++) {
+        String key = prefs.key(i);
+        if (prefs.type(i) == PREF_INT) {
+            doc[key] = prefs.getInt(key.c_str());
+        } else if (prefs.type(i) == PREF_STRING) {
+            doc[key] = prefs.getString(key.c_str());
         }
     }
-    return true;
 #else
-    json_preferences = json;
-    return writeJsonPreferences();
+    JsonDocument& doc = json_preferences;
 #endif
+    size_t length = measureMsgPack(doc);
+    std::vector<uint8_t> body(length);
+    serializeMsgPack(doc, body.data(), length);
+
+    uint8_t header[SNAPSHOT_HEADER_SIZE];
+    memcpy(header, SNAPSHOT_MAGIC, 4);
+    header[4] = SNAPSHOT_FORMAT;
+    header[5] = 0;
+    writeLE(header + 6, CONFIG_VERSION, 2);
+    writeLE(header + 8, length, 4);
+    writeLE(header + 12, crc32(body.data(), length), 4);
+
+    size_t written = out.write(header, SNAPSHOT_HEADER_SIZE);
+    written += out.write(body.data(), length);
+    return written;
 }
 
-#ifndef ESP32
+int Configuration::getSnapshotLength(const uint8_t* data, size_t length)
+{
+    if (length < SNAPSHOT_HEADER_SIZE) {
+        return 0;
+    }
+    uint32_t bodyLength = readLE(data + 8, 4);
+    if (memcmp(data, SNAPSHOT_MAGIC, 4) != 0 || data[4] != SNAPSHOT_FORMAT || bodyLength > SNAPSHOT_MAX_BODY) {
+        return -1;
+    }
+    return SNAPSHOT_HEADER_SIZE + bodyLength;
+}
 
-bool Configuration::readJsonPreferences()
+bool Configuration::restoreSnapshot(const uint8_t* data, size_t length)
+{
+    if (length < SNAPSHOT_HEADER_SIZE || memcmp(data, SNAPSHOT_MAGIC, 4) != 0 || data[4] != SNAPSHOT_FORMAT) {
+        eventManager->debug("Snapshot: invalid header", 0);
+        return false;
+    }
+    int version = readLE(data + 6, 2);
+    size_t bodyLength = readLE(data + 8, 4);
+    const uint8_t* body = data + SNAPSHOT_HEADER_SIZE;
+    if (bodyLength != length - SNAPSHOT_HEADER_SIZE) {
+        eventManager->debug("Snapshot: wrong length", 0);
+        return false;
+    }
+    if (readLE(data + 12, 4) != crc32(body, bodyLength)) {
+        eventManager->debug("Snapshot: checksum mismatch", 0);
+        return false;
+    }
+    if (version > CONFIG_VERSION) {
+        eventManager->debug("Snapshot: version " + String(version) + " is newer than " + String(CONFIG_VERSION), 0);
+        return false;
+    }
+
+    JsonDocument doc;
+    DeserializationError error = deserializeMsgPack(doc, body, bodyLength);
+    if (error || !doc.is<JsonObject>()) {
+        eventManager->debug("Snapshot: invalid content", 0);
+        return false;
+    }
+
+    // Validate every entry before the first write, so a bad snapshot leaves the configuration untouched
+    const char* invalidKey = invalidPreference(doc);
+    if (invalidKey != nullptr) {
+        eventManager->debug("Snapshot: invalid entry " + String(invalidKey), 0);
+        return false;
+    }
+
+#ifdef ESP32
+    // NVS writes each value on its own: the values are written before the obsolete keys are removed,
+    // so an interrupted restore leaves extra keys rather than missing ones
+    bool ok = true;
+    for (JsonPair kv : doc.as<JsonObject>()) {
+        ok = setJsonPreference(kv.key().c_str(), kv.value()) && ok;
+    }
+    std::vector<String> obsoleteKeys;
+    for (int i = 0; i < prefs.length(); i++) {
+        String key = prefs.key(i);
+        if (doc[key].isNull()) {
+            obsoleteKeys.push_back(key);
+        }
+    }
+    for (const auto& key : obsoleteKeys) {
+        ok = setJsonPreference(key, JsonVariantConst()) && ok;
+    }
+    return ok;
+#else
+    return mergeJsonPreferences(doc, true);
+#endif
+}
+
+String Configuration::getHostname()
 {
-    // Lire l'EEPROM et charger le JSON
-    String jsonStr = "";
-    for (size_t i = 0; i < eeprom.length(); i++) {
-        char c = eeprom.read(i);
-        if (c == '\0')
-            break;
-        jsonStr += c;
+    if (hostname.length() == 0) {
+        hostname = getPreference("hostname", String(HOSTNAME));
     }
+    return hostname;
+}
 
-    // Désérialiser le JSON
-    DeserializationError error = deserializeJson(json_preferences, jsonStr);
+#ifndef ESP32
+
+bool Configuration::readJsonPreferences()
+{
+    // Désérialiser le JSON directement depuis le buffer de l'EEPROM
+    const char* data = (const char*)eeprom.getConstDataPtr();
+    storedLength = strnlen(data, eeprom.length());
+    DeserializationError error = deserializeJson(json_preferences, data, storedLength);
     if (error) {
         Serial.print("Failed to deserialize JSON: ");
         Serial.println(error.c_str());
@@ -141,44 +465,93 @@ bool Configuration::readJsonPreferences()
     }
 
     Serial.println("Preferences loaded");
-    Serial.println(jsonStr);
+    Serial.write(data, storedLength);
+    Serial.println();
 
     return true;
 }
 
-bool Configuration::writeJsonPreferences()
+// values / payloadBytes: the changed values, for the storage stats
+bool Configuration::writeJsonPreferences(size_t values, size_t payloadBytes)
 {
-    // Sérialiser le JSON
-    String jsonStr;
-    serializeJson(json_preferences, jsonStr);
-
-    // Effacer l'EEPROM
-    for (size_t i = 0; i < eeprom.length(); i++) {
-        eeprom.write(i, '\0');
+    size_t length = measureJson(json_preferences);
+    if (length >= eeprom.length()) {
+        Serial.println("Preferences too large for EEPROM: " + String(length));
+        return false;
     }
 
-    // Écrire le JSON dans l'EEPROM
-    for (size_t i = 0; i < jsonStr.length(); i++) {
-        eeprom.write(i, jsonStr[i]);
+    // Sérialiser directement dans le buffer de l'EEPROM, n'effacer que la fin de l'ancien contenu
+    char* data = (char*)eeprom.getDataPtr();
+    serializeJson(json_preferences, data, eeprom.length());
+    if (storedLength > length) {
+        memset(data + length, 0, storedLength - length);
     }
+    storedLength = length;
 
+    unsigned long start = micros();
     eeprom.commit();
+    recordCommit(values, payloadBytes, eeprom.length(), start);  // the whole sector is erased and rewritten
+
+    Serial.println("Preferences saved (" + String(length) + " bytes)");
+    return true;
+}
 
-    Serial.println("Preferences saved");
-    Serial.println(jsonStr);
+// Apply all values of doc with a single EEPROM commit (replace = remove keys missing from doc)
+bool Configuration::mergeJsonPreferences(JsonDocument& doc, bool replace)
+{
+    std::vector<String> changedKeys;
+    size_t payloadBytes = 0;
+    if (replace) {
+        for (JsonPair kv : json_preferences.as<JsonObject>()) {
+            if (doc[kv.key().c_str()].isNull()) {
+                changedKeys.push_back(kv.key().c_str());
+                payloadBytes += strlen(kv.key().c_str());
+            }
+        }
+        for (const auto& key : changedKeys) {
+            json_preferences.remove(key);
+        }
+    }
+    for (JsonPair kv : doc.as<JsonObject>()) {
+        const char* key = kv.key().c_str();
+        if (kv.value().isNull()) {
+            // null removes the key, as on ESP32
+            if (!json_preferences.containsKey(key)) {
+                continue;
+            }
+            json_preferences.remove(key);
+        } else if (json_preferences[key] != kv.value()) {
+            json_preferences[key] = kv.value();
+        } else {
+            storageStats.skippedWrites++;
+            continue;
+        }
+        changedKeys.push_back(key);
+        payloadBytes += payloadSize(key, kv.value());
+    }
+    if (changedKeys.empty()) {
+        return true;
+    }
+    if (!writeJsonPreferences(changedKeys.size(), payloadBytes)) {
+        readJsonPreferences();  // back to the stored values, the EEPROM buffer was not modified
+        return false;
+    }
+    for (const auto& key : changedKeys) {
+        notifyChange(key, readVariableString(key));
+    }
     return true;
 }
 
 bool Configuration::writeVariable(const String key, int value)
 {
     json_preferences[key] = value;
-    return writeJsonPreferences();
+    return writeJsonPreferences(1, key.length() + sizeof(int32_t));
 }
 
 bool Configuration::writeVariable(const String key, String value)
 {
     json_preferences[key] = value;
-    return writeJsonPreferences();
+    return writeJsonPreferences(1, key.length() + value.length());
 }
 
 int Configuration::readVariableInt(const String key, int defaultValue)
@@ -191,11 +564,6 @@ String Configuration::readVariableString(const String key, String defaultValue)
     return json_preferences.containsKey(key) ? json_preferences[key].as<String>() : defaultValue;
 }
 
-String Configuration::getHostname()
-{
-    return getPreference("hostname", String(HOSTNAME));
-}
-
 void Configuration::debugJsonPreferences()
 {
     eventManager->debug("Preferences:", 1);
@@ -0,0 +1,142 @@
+#include "../include/ConnectionStats.h"
+
+void ConnectionStats::connected(unsigned long connectTime)
+{
+    unsigned long now = millis();
+    if (!up && connects > 0 && !roaming) {
+        unsigned long outage = now - changedAt;
+        totalOutage += outage;
+        outages++;
+        if (outage > longestOutage) {
+            longestOutage = outage;
+        }
+    }
+    up = true;
+    roaming = false;
+    changedAt = now;
+    connects++;
+    lastConnectTime = connectTime;
+    static const unsigned long limits[HISTOGRAM_BUCKETS - 1] = {500, 1000, 2000, 5000, 10000};
+    uint bucket = 0;
+    while (bucket < HISTOGRAM_BUCKETS - 1 && connectTime >= limits[bucket]) {
+        bucket++;
+    }
+    histogram[bucket]++;
+}
+
+void ConnectionStats::disconnected(int reason)
+{
+    if (!up) {
+        return;
+    }
+    unsigned long now = millis();
+    upTime += now - changedAt;
+    up = false;
+    changedAt = now;
+    drops++;
+    for (uint i = 0; i < reasonCount; i++) {
+        if (reasons[i].reason == reason) {
+            reasons[i].count++;
+            return;
+        }
+    }
+    if (reasonCount < MAX_REASONS) {
+        reasons[reasonCount++] = {reason, 1};
+    }
+}
+
+void ConnectionStats::roamed()
+{
+    if (!up) {
+        return;
+    }
+    unsigned long now = millis();
+    upTime += now - changedAt;
+    up = false;
+    roaming = true;
+    changedAt = now;
+    roams++;
+}
+
+void ConnectionStats::attemptFailed()
+{
+    failures++;
+}
+
+void ConnectionStats::sampleRssi(int rssi)
+{
+    if (rssiSamples == 0 || rssi < rssiMin) {
+        rssiMin = rssi;
+    }
+    if (rssiSamples == 0 || rssi > rssiMax) {
+        rssiMax = rssi;
+    }
+    rssiSum += rssi;
+    rssiSamples++;
+}
+
+void ConnectionStats::reset()
+{
+    bool wasUp = up;
+    *this = ConnectionStats();
+    up = wasUp;
+    startedAt = millis();
+    changedAt = startedAt;
+}
+
+float ConnectionStats::getUptimeRatio()
+{
+    unsigned long now = millis();
+    unsigned long total = now - startedAt;
+    unsigned long current = up ? now - changedAt : 0;
+    return total > 0 ? (float)(upTime + current) / total : 0;
+}
+
+String ConnectionStats::getInfos()
+{
+    String infos = "Uptime: " + String(getUptimeRatio() * 100, 2) + "%, connects: " + String(connects) + ", reconnects: " + String(getReconnects()) +
+                   ", failed attempts: " + String(failures);
+    infos += "\nConnect time: last " + String(lastConnectTime) + " ms, histogram <0.5s/<1s/<2s/<5s/<10s/more:";
+    for (uint i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        infos += (i == 0 ? " " : "/") + String(histogram[i]);
+    }
+    infos += "\nDrops: " + String(drops);
+    for (uint i = 0; i < reasonCount; i++) {
+        infos += (i == 0 ? " (reason " : ", ") + String(reasons[i].reason) + ": " + String(reasons[i].count);
+    }
+    infos += reasonCount > 0 ? ")" : "";
+    infos += ", roams: " + String(roams);
+    infos += "\nOutages: " + String(outages) + ", longest " + String(longestOutage / 1000) + " s, average " +
+             String(outages > 0 ? totalOutage / outages / 1000 : 0) + " s";
+    if (rssiSamples > 0) {
+        infos += "\nRSSI: min " + String(rssiMin) + ", avg " + String((float)rssiSum / rssiSamples, 1) + ", max " + String(rssiMax) + " dBm";
+    }
+    return infos;
+}
+
+size_t ConnectionStats::printJson(Print& out)
+{
+    size_t written = out.print("{\"up\":");
+    written += out.print(getUptimeRatio() * 100, 2);
+    written += out.print(",\"drops\":");
+    written += out.print(drops);
+    written += out.print(",\"reconnects\":");
+    written += out.print(getReconnects());
+    written += out.print(",\"ct\":");
+    written += out.print(lastConnectTime);
+    if (roams > 0) {
+        written += out.print(",\"roams\":");
+        written += out.print(roams);
+    }
+    if (rssiSamples > 0) {
+        written += out.print(",\"rssi\":[");
+        written += out.print(rssiMin);
+        written += out.print(',');
+        written += out.print((int)(rssiSum / (int64_t)rssiSamples));
+        written += out.print(',');
+        written += out.print(rssiMax);
+        written += out.print(']');
+    }
+    written += out.print('}');
+    return written;
+}
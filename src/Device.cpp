@@ -2,10 +2,33 @@
 
 EventManager* Device::eventManager = nullptr;
 
+Device::~Device()
+{
+    // the callbacks capture this
+    config.removeOnChange(configObserver);
+    if (mqttManager != nullptr) {
+        for (auto& entry : mqttHandlers) {
+            mqttManager->unsubscribeHandler(entry.second);
+        }
+    }
+}
+
 void Device::init()
 {
     retrieveName();
     retrieveTopic();
+    config.removeOnChange(configObserver);  // init() may be called again
+    configObserver = config.onChange(id + "_*", [this](const String& key, const String& value) {
+        if (key == id + "_name") {
+            name = value;
+        } else if (key == id + "_topic" && value != topic) {
+            // changed from outside saveTopic (sys:config, restore...)
+            String previous = topic;
+            topic = value;
+            subscribeMQTT(topic);
+            unsubscribeMQTT(previous);
+        }
+    });
     initEspUI();
     subscribeMQTT(topic);
     eventManager->debug("Device #" + id + " initialized", 1);
@@ -31,11 +54,15 @@ bool Device::handleCommand(const std::string& command)
 
 void Device::saveTopic(String topic)
 {
-    unsubscribeMQTT(this->topic);
+    if (topic == this->topic) {
+        return;  // keep the subscription and its cached value
+    }
+    String previous = this->topic;
     this->topic = topic;
     Serial.println("Saving topic: " + topic);
     config.setPreference(id + "_topic", topic);
     subscribeMQTT(topic);
+    unsubscribeMQTT(previous);
 }
 
 String Device::retrieveTopic()
@@ -57,12 +84,22 @@ String Device::retrieveName()
     return this->name;
 }
 
+void Device::setMQTTManager(MQTTManager* mqttManager)
+{
+    this->mqttManager = mqttManager;
+}
+
 bool Device::subscribeMQTT(String topic)
 {
     if (topic == "") {
         return false;
     }
-    eventManager->triggerEvent("mqtt", "subscribe", {topic});
+    if (mqttManager == nullptr) {
+        eventManager->triggerEvent("mqtt", "subscribe", {topic});
+    } else if (mqttHandlers.find(topic) == mqttHandlers.end()) {
+        // shared with the other devices, the cached value is processed at once
+        mqttHandlers[topic] = mqttManager->subscribeHandler(topic, [this](const String& topic, const String& value) { processMQTT(topic, value); });
+    }
     return true;
 }
 
@@ -71,7 +108,15 @@ bool Device::unsubscribeMQTT(String topic)
     if (topic == "") {
         return false;
     }
-    eventManager->triggerEvent("mqtt", "unsubscribe", {topic});
+    if (mqttManager == nullptr) {
+        eventManager->triggerEvent("mqtt", "unsubscribe", {topic});
+        return true;
+    }
+    auto it = mqttHandlers.find(topic);
+    if (it != mqttHandlers.end()) {
+        mqttManager->unsubscribeHandler(it->second);
+        mqttHandlers.erase(it);
+    }
     return true;
 }
 
@@ -81,7 +126,7 @@ void Device::processEvent(String type, String event, std::vector<String> params)
     if ((type == id) && (event.startsWith("@"))) {
         processCommand(event.substring(1), params);
     }
-    if (type == "mqtt") {
+    if (type == "mqtt" && mqttManager == nullptr) {  // otherwise routed by MQTTManager
         if (event == "message") {
             processMQTT(params[0], params[1]);
         }
@@ -95,7 +140,7 @@ bool Device::processCommand(String command, std::vector<String> params)
         if (params.size() > 0) {
             saveName(params[0]);
         } else {
-            Serial.println("Name: " + retrieveName());
+            Serial.println("Name: " + name);
         }
         return true;
     }
@@ -103,7 +148,7 @@ bool Device::processCommand(String command, std::vector<String> params)
         if (params.size() > 0) {
             saveTopic(params[0]);
         } else {
-            Serial.println("Topic: " + retrieveTopic());
+            Serial.println("Topic: " + topic);
         }
         return true;
     }
@@ -114,7 +159,7 @@ bool Device::processMQTT(String topic, String value)
 {
     eventManager->debug("Processing device #" + id + " MQTT message: " + topic + " = " + value, 3);
     eventManager->debug("MyTopic: " + this->topic, 3);
-    if (topic == this->topic) {
+    if (MQTTTopicTrie::matches(this->topic, topic)) {
         eventManager->debug("Topic " + topic + " matched, command:" + value, 3);
         return handleCommand(value.c_str());
     }
@@ -1,4 +1,5 @@
 #include "../include/EventManager.h"
+#include "../include/Tools.h"
 
 void EventManager::registerMainCallback(MainCallback callback) {
     mainCallback = callback;
@@ -20,6 +21,32 @@ void EventManager::triggerEvent(const String& eventType, const String& event, co
     }
 }
 
+bool EventManager::triggerCommand(const String& input)
+{
+    if (input.length() == 0) {
+        debug("Empty input", 1);
+        return false;
+    }
+    int nsIndex = input.indexOf(':');
+    int cmdIndex = input.indexOf(' ');
+
+    if (nsIndex == -1 || (cmdIndex != -1 && cmdIndex < nsIndex)) {
+        debug("Erreur: Format de commande incorrect: " + input, 0);
+        return false;
+    }
+
+    // Extraction du namespace et de la commande
+    String ns = input.substring(0, nsIndex);
+    String command = cmdIndex == -1 ? input.substring(nsIndex + 1) : input.substring(nsIndex + 1, cmdIndex);
+
+    // Extraction des paramètres
+    String paramStr = cmdIndex == -1 ? "" : input.substring(cmdIndex + 1);
+    std::vector<String> params = paramStr.isEmpty() ? std::vector<String>() : splitParameters(paramStr);
+
+    triggerEvent(ns, "@" + command, params);
+    return true;
+}
+
 void EventManager::registerDebugCallback(DebugCallBack callback) {
     debugCallback = callback;
 }
@@ -0,0 +1,171 @@
+#include "../include/MQTTBatchPublisher.h"
+#include "../include/Tools.h"
+#include <StreamString.h>
+
+bool MQTTBatchPublisher::addStream(const String& topicPrefix, uint maxCount, uint maxBytes, uint maxAge)
+{
+    if (topicPrefix.length() == 0 || maxCount == 0) {
+        return false;
+    }
+    for (const auto& stream : streams) {
+        if (stream.prefix == topicPrefix) {
+            return false;
+        }
+    }
+    BatchStream stream = {};
+    stream.prefix = topicPrefix;
+    stream.maxCount = maxCount;
+    stream.maxBytes = maxBytes;
+    stream.maxAge = maxAge;
+    stream.buffer.reserve(maxBytes);
+    streams.push_back(stream);
+    return true;
+}
+
+bool MQTTBatchPublisher::removeStream(const String& topicPrefix)
+{
+    for (auto it = streams.begin(); it != streams.end(); ++it) {
+        if (it->prefix == topicPrefix) {
+            flushStream(*it, MQTT_BATCH_FLUSH_MANUAL);
+            streams.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void MQTTBatchPublisher::add(const String& topic, int value)
+{
+    addJson(topic, String(value));
+}
+
+void MQTTBatchPublisher::add(const String& topic, float value, int decimals)
+{
+    addJson(topic, isnan(value) || isinf(value) ? String("null") : String(value, decimals));  // no NaN or Infinity in JSON
+}
+
+void MQTTBatchPublisher::add(const String& topic, const String& value)
+{
+    if (isJsonNumber(value)) {
+        addJson(topic, value);
+    } else {
+        StreamString quoted;
+        printJsonString(quoted, value.c_str());
+        addJson(topic, quoted);
+    }
+}
+
+void MQTTBatchPublisher::loop()
+{
+    unsigned long now = millis();
+    for (auto& stream : streams) {
+        if (stream.count > 0 && now - stream.firstAt >= stream.maxAge) {
+            flushStream(stream, MQTT_BATCH_FLUSH_AGE);
+        }
+    }
+}
+
+void MQTTBatchPublisher::flush()
+{
+    for (auto& stream : streams) {
+        flushStream(stream, MQTT_BATCH_FLUSH_MANUAL);
+    }
+}
+
+String MQTTBatchPublisher::getInfos()
+{
+    String infos = "Batch streams: " + String(streams.size());
+    for (const auto& stream : streams) {
+        infos += "\n- " + stream.prefix + ": " + String(stream.count) + " pending, " + String(stream.readings) + " readings in " + String(stream.batches) +
+                 " batches";
+        if (stream.batches > 0) {
+            infos += " (avg " + String((float)stream.readings / stream.batches, 1) + ", max " + String(stream.maxBatch) + ")";
+        }
+        infos += ", flushed by count: " + String(stream.flushes[MQTT_BATCH_FLUSH_COUNT]) + ", size: " + String(stream.flushes[MQTT_BATCH_FLUSH_SIZE]) +
+                 ", age: " + String(stream.flushes[MQTT_BATCH_FLUSH_AGE]) + ", manual: " + String(stream.flushes[MQTT_BATCH_FLUSH_MANUAL]);
+    }
+    return infos;
+}
+
+MQTTBatchPublisher::BatchStream* MQTTBatchPublisher::findStream(const String& topic)
+{
+    BatchStream* found = nullptr;
+    for (auto& stream : streams) {
+        if (topic.length() > stream.prefix.length() && topic[stream.prefix.length()] == '/' && topic.startsWith(stream.prefix) &&
+            (found == nullptr || stream.prefix.length() > found->prefix.length())) {
+            found = &stream;
+        }
+    }
+    return found;
+}
+
+void MQTTBatchPublisher::addJson(const String& topic, const String& jsonValue)
+{
+    BatchStream* stream = findStream(topic);
+    if (stream == nullptr) {
+        mqttManager.publish(topic, jsonValue);
+        return;
+    }
+
+    unsigned long now = millis();
+    StreamString entry;  // ["<subtopic>",<ms since first reading>,<value>]
+    entry.print('[');
+    printJsonString(entry, topic.c_str() + stream->prefix.length() + 1);
+    entry.print(',');
+
+    // envelope {"t":...,"r":[]} and time offset take at most 32 bytes
+    if (stream->count > 0 && stream->buffer.length() + entry.length() + jsonValue.length() + 32 > stream->maxBytes) {
+        flushStream(*stream, MQTT_BATCH_FLUSH_SIZE);
+    }
+    if (stream->count == 0) {
+        stream->firstAt = now;
+    } else {
+        stream->buffer += ',';
+    }
+    stream->buffer += entry;
+    stream->buffer += String(now - stream->firstAt);
+    stream->buffer += ',';
+    stream->buffer += jsonValue;
+    stream->buffer += ']';
+    stream->count++;
+    stream->readings++;
+    if (stream->count >= stream->maxCount) {
+        flushStream(*stream, MQTT_BATCH_FLUSH_COUNT);
+    }
+}
+
+void MQTTBatchPublisher::flushStream(BatchStream& stream, mqtt_batch_flush_reason reason)
+{
+    if (stream.count == 0) {
+        return;
+    }
+    MQTTPayloadWriter writer = [&stream](Print& out) {
+        out.print("{\"t\":");
+        out.print(stream.firstAt);
+        out.print(",\"r\":[");
+        out.print(stream.buffer);
+        out.print("]}");
+    };
+    String topic = stream.prefix + "/batch";
+    if (mqttManager.canPublishStream()) {
+        // streamed from the stream buffer. Not queued again if it fails, part of it may have been sent
+        if (!mqttManager.publishStream(topic, writer)) {
+            eventManager->debug("Batch " + stream.prefix + ": stream failed, " + String(stream.count) + " readings lost", 1);
+        }
+    } else {
+        // copied to the offline queue
+        StreamString payload;
+        payload.reserve(stream.buffer.length() + 20);
+        writer(payload);
+        mqttManager.publish(topic, payload, false);
+    }
+
+    stream.batches++;
+    stream.flushes[reason]++;
+    if (stream.count > stream.maxBatch) {
+        stream.maxBatch = stream.count;
+    }
+    eventManager->debug("Batch " + stream.prefix + ": " + String(stream.count) + " readings sent", 3);
+    stream.buffer = "";
+    stream.count = 0;
+}
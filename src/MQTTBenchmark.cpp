@@ -0,0 +1,120 @@
+#include "../include/MQTTBenchmark.h"
+#include <algorithm>
+
+bool MQTTBenchmark::start(uint count, uint size, uint handlers, uint window)
+{
+    if (running || count == 0 || handlers == 0 || !mqttManager.isConnected()) {
+        return false;
+    }
+    if (count > MQTT_BENCH_MAX_COUNT || size > MQTT_BENCH_MAX_SIZE || handlers > MQTT_BENCH_MAX_HANDLERS) {
+        eventManager->debug("Benchmark: at most " + String(MQTT_BENCH_MAX_COUNT) + " messages of " + String(MQTT_BENCH_MAX_SIZE) + " bytes, " +
+                                String(MQTT_BENCH_MAX_HANDLERS) + " handlers",
+                            0);
+        return false;
+    }
+    if (!topic.isValid()) {
+        topic = mqttManager.addTopic("{hostname}/bench");
+    }
+    const String& benchTopic = mqttManager.getTopic(topic);
+    // the first handler measures, the others only route like devices would
+    String filters[] = {benchTopic, "+/bench", benchTopic.substring(0, benchTopic.lastIndexOf('/')) + "/#"};
+    handlerIds.push_back(mqttManager.addMessageHandler(benchTopic, [this](const MQTTMessage& message) { onMessage(message); }));
+    for (uint i = 1; i < handlers; i++) {
+        handlerIds.push_back(mqttManager.addMessageHandler(filters[i % 3], [this](const MQTTMessage& message) { deliveries++; }));
+    }
+    mqttManager.subscribe(benchTopic);
+
+    this->count = count;
+    this->size = size;
+    this->window = window > 0 ? window : 1;
+    padding = "";
+    for (uint i = 24; i < size; i++) {  // "<seq>:<micros>:" takes up to 22 bytes
+        padding += 'x';
+    }
+    sent = 0;
+    received = 0;
+    deliveries = 0;
+    latencies.clear();
+    latencies.reserve(count);
+    mqttManager.resetDispatchStats();
+    eventManager->debug("Benchmark: " + String(count) + " messages of " + String(size) + " bytes, " + String(handlers) + " handlers", 0);
+    running = true;
+    startedAt = micros();
+    lastReceived = startedAt;
+    return true;
+}
+
+void MQTTBenchmark::stop()
+{
+    if (running) {
+        finish();
+    }
+}
+
+void MQTTBenchmark::loop()
+{
+    if (!running) {
+        return;
+    }
+    while (sent < count && sent - received < window) {
+        String payload = String(sent) + ":" + String(micros()) + ":" + padding;
+        mqttManager.publish(topic, payload, false);
+        sent++;
+        if (sent == count) {
+            sentAt = micros();
+        }
+    }
+    if (received >= count || micros() - lastReceived > 5000000UL) {
+        finish();
+    }
+}
+
+String MQTTBenchmark::getInfos()
+{
+    return result.length() > 0 ? result : String("No benchmark run");
+}
+
+void MQTTBenchmark::onMessage(const MQTTMessage& message)
+{
+    unsigned long now = micros();
+    deliveries++;
+    // payload: <seq>:<micros when sent>:<padding>, not null terminated
+    unsigned long sentMicros = 0;
+    unsigned int i = 0;
+    while (i < message.length && message.payload[i] != ':') {
+        i++;
+    }
+    for (i++; i < message.length && isDigit(message.payload[i]); i++) {
+        sentMicros = sentMicros * 10 + (message.payload[i] - '0');
+    }
+    if (received < count) {
+        latencies.push_back(now - sentMicros);
+    }
+    received++;
+    lastReceived = now;
+}
+
+void MQTTBenchmark::finish()
+{
+    running = false;
+    unsigned long elapsed = lastReceived - startedAt;
+    unsigned long sendTime = (sent == count ? sentAt : micros()) - startedAt;
+
+    for (uint id : handlerIds) {
+        mqttManager.removeHandler(id);
+    }
+    handlerIds.clear();
+    mqttManager.unsubscribe(mqttManager.getTopic(topic));
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [this](uint p) { return latencies.empty() ? 0 : latencies[(latencies.size() - 1) * p / 100]; };
+
+    result = "Benchmark " + String(count) + " x " + String(size) + " bytes, " + String(sent) + " sent in " + String(sendTime / 1000) + " ms (" +
+             String(sendTime > 0 ? sent * 1000000.0f / sendTime : 0, 0) + " msg/s), " + String(received) + " received in " + String(elapsed / 1000) +
+             " ms (" + String(elapsed > 0 ? received * 1000000.0f / elapsed : 0, 0) + " msg/s), " + String(count - (received < count ? received : count)) +
+             " lost, " + String(deliveries) + " handler calls\nRound trip: p50 " + String(percentile(50)) + " us, p99 " + String(percentile(99)) +
+             " us, max " + String(latencies.empty() ? 0 : latencies.back()) + " us\n" + mqttManager.getDispatchInfos();
+    latencies.clear();
+    latencies.shrink_to_fit();
+    eventManager->debug(result, 0);
+}
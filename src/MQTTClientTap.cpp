@@ -0,0 +1,143 @@
+#include "../include/MQTTClientTap.h"
+
+#define MQTT_PACKET_PUBLISH 3
+#define MQTT_PACKET_PUBACK 4
+
+void MQTTClientTap::onPuback(std::function<void(uint16_t packetId)> callback)
+{
+    pubackCallback = callback;
+}
+
+int MQTTClientTap::connect(IPAddress ip, uint16_t port)
+{
+    reset();
+    return client.connect(ip, port);
+}
+
+int MQTTClientTap::connect(const char* host, uint16_t port)
+{
+    reset();
+    return client.connect(host, port);
+}
+
+#ifdef ESP32
+// the timeout is set on the wrapped client
+int MQTTClientTap::connect(IPAddress ip, uint16_t port, int32_t timeout)
+{
+    return connect(ip, port);
+}
+
+int MQTTClientTap::connect(const char* host, uint16_t port, int32_t timeout)
+{
+    return connect(host, port);
+}
+#endif
+
+size_t MQTTClientTap::write(uint8_t c)
+{
+    return client.write(c);
+}
+
+size_t MQTTClientTap::write(const uint8_t* buf, size_t size)
+{
+    return client.write(buf, size);
+}
+
+int MQTTClientTap::available()
+{
+    return client.available();
+}
+
+int MQTTClientTap::read()
+{
+    int c = client.read();
+    if (c >= 0) {
+        feed(c);
+    }
+    return c;
+}
+
+int MQTTClientTap::read(uint8_t* buf, size_t size)
+{
+    int count = client.read(buf, size);
+    for (int i = 0; i < count; i++) {
+        feed(buf[i]);
+    }
+    return count;
+}
+
+int MQTTClientTap::peek()
+{
+    return client.peek();
+}
+
+void MQTTClientTap::flush()
+{
+    client.flush();
+}
+
+void MQTTClientTap::stop()
+{
+    client.stop();
+    reset();
+}
+
+uint8_t MQTTClientTap::connected()
+{
+    return client.connected();
+}
+
+MQTTClientTap::operator bool()
+{
+    return client;
+}
+
+// Follow the fixed header (type + variable length remaining length) of each packet
+void MQTTClientTap::feed(uint8_t c)
+{
+    switch (state) {
+        case TAP_HEADER:
+            packetType = c >> 4;
+            if (packetType == MQTT_PACKET_PUBLISH) {
+                publishFlags = c & 0x0F;
+            }
+            remaining = 0;
+            multiplier = 1;
+            bodyIndex = 0;
+            state = TAP_LENGTH;
+            break;
+        case TAP_LENGTH:
+            remaining += (c & 0x7F) * multiplier;
+            multiplier *= 128;
+            if ((c & 0x80) == 0) {
+                if (remaining == 0) {
+                    packetDone();
+                } else {
+                    state = TAP_BODY;
+                }
+            }
+            break;
+        case TAP_BODY:
+            if (bodyIndex < sizeof(body)) {
+                body[bodyIndex] = c;
+            }
+            bodyIndex++;
+            if (bodyIndex == remaining) {
+                packetDone();
+            }
+            break;
+    }
+}
+
+void MQTTClientTap::packetDone()
+{
+    if (packetType == MQTT_PACKET_PUBACK && remaining >= 2 && pubackCallback) {
+        pubackCallback((body[0] << 8) | body[1]);
+    }
+    state = TAP_HEADER;
+}
+
+void MQTTClientTap::reset()
+{
+    state = TAP_HEADER;
+}
@@ -0,0 +1,113 @@
+#include "../include/MQTTLogShipper.h"
+#include "../include/Tools.h"
+#include <StreamString.h>
+
+void MQTTLogShipper::configure(uint interval, uint rate, uint burst)
+{
+    this->interval = interval;
+    this->rate = rate > 0 ? rate : 1;
+    this->burst = burst > 0 ? burst : 1;
+    if (tokens > this->burst) {
+        tokens = this->burst;
+    }
+}
+
+void MQTTLogShipper::add(int level, const String& time, const String& message)
+{
+    if (shipping || !topic.isValid()) {
+        return;
+    }
+    lines.push_back({time, level, message});
+    bufferedBytes += message.length();
+    while (lines.size() > MAX_LINES || bufferedBytes > MAX_BYTES) {
+        bufferedBytes -= lines.front().message.length();
+        lines.pop_front();
+        pendingDropped++;
+        dropped++;
+    }
+}
+
+void MQTTLogShipper::loop()
+{
+    refill();
+    if (lines.empty() && pendingDropped == 0) {
+        lastFlush = millis();
+        return;
+    }
+    if (!mqttManager.isConnected()) {
+        return;  // keep buffering, the oldest lines are dropped if it lasts
+    }
+    bool full = bufferedBytes >= MAX_PAYLOAD || lines.size() >= MAX_LINES / 2;
+    if (!full && millis() - lastFlush < interval) {
+        return;
+    }
+    if (tokens < 1) {
+        throttled++;
+        return;
+    }
+    tokens -= 1;
+    lastFlush = millis();
+    publishBatch();
+}
+
+String MQTTLogShipper::getInfos()
+{
+    return "Log shipping: " + String(shipped) + " lines in " + String(batches) + " batches, " + String(lines.size()) + " pending (" +
+           String(bufferedBytes) + " bytes), " + String(dropped) + " dropped, " + String(throttled) + " throttled, every " + String(interval) +
+           "ms, max " + String(rate) + " batches/min (burst " + String(burst) + ")";
+}
+
+void MQTTLogShipper::refill()
+{
+    unsigned long now = millis();
+    tokens += (float)(now - lastRefill) * rate / 60000.0f;
+    if (tokens > burst) {
+        tokens = burst;
+    }
+    lastRefill = now;
+}
+
+size_t MQTTLogShipper::entrySize(const LogEntry& entry) const
+{
+    return entry.message.length() + entry.time.length() + 40;  // {"time":"","level":N,"message":""}, and some escaping
+}
+
+void MQTTLogShipper::publishBatch()
+{
+    StreamString payload;
+    payload.reserve(MAX_PAYLOAD);
+    payload.print('[');
+    uint count = 0;
+    if (pendingDropped > 0) {
+        payload.print("{\"level\":1,\"message\":\"" + String(pendingDropped) + " log messages dropped\"}");
+        pendingDropped = 0;
+        count++;
+    }
+    while (!lines.empty()) {
+        const LogEntry& entry = lines.front();
+        // always send at least one line, even a long one
+        if (count > 0 && payload.length() + entrySize(entry) > MAX_PAYLOAD) {
+            break;
+        }
+        if (count > 0) {
+            payload.print(',');
+        }
+        payload.print('{');
+        if (entry.time.length() > 0) {
+            payload.print("\"time\":\"" + entry.time + "\",");
+        }
+        payload.print("\"level\":" + String(entry.level) + ",\"message\":");
+        printJsonString(payload, entry.message.c_str());
+        payload.print('}');
+        bufferedBytes -= entry.message.length();
+        lines.pop_front();
+        shipped++;
+        count++;
+    }
+    payload.print(']');
+
+    shipping = true;
+    mqttManager.publish(topic, payload, false);
+    shipping = false;
+    batches++;
+}
@@ -1,7 +1,51 @@
 #include "../include/MQTTManager.h"
+#include "../include/Tools.h"
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
 
 EventManager* MQTTManager::eventManager = nullptr;
 
+// Print adapter sending a payload to the client by chunks, never more than the announced length
+class MQTTPayloadPrint : public Print
+{
+  public:
+    MQTTPayloadPrint(Print& client, size_t length) : client(client), remaining(length) {}
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* data, size_t size) override
+    {
+        size_t accepted = size < remaining ? size : remaining;
+        overflow += size - accepted;
+        remaining -= accepted;
+        written += accepted;
+        for (size_t i = 0; i < accepted; i++) {
+            chunk[used++] = data[i];
+            if (used == sizeof(chunk)) {
+                sendChunk();
+            }
+        }
+        return accepted;
+    }
+    bool sendChunk()
+    {
+        if (used > 0 && client.write(chunk, used) != used) {
+            failed = true;
+        }
+        used = 0;
+        return !failed;
+    }
+
+    size_t written = 0;
+    size_t overflow = 0;
+    bool failed = false;
+
+  private:
+    Print& client;
+    size_t remaining;
+    uint8_t chunk[64];
+    size_t used = 0;
+};
+
 void MQTTManager::init()
 {
     eventManager->debug("MQTTManager init...", 1);
@@ -11,6 +55,41 @@ void MQTTManager::init()
     retrieveUsername();
     retrievePassword();
 
+    // keep the connection settings in RAM, in sync with the configuration (init() may be called again)
+    config.removeOnChange(serverObserver);
+    config.removeOnChange(hostnameObserver);
+    serverObserver = config.onChange("mq_*", [this](const String& key, const String& value) {
+        if (key == "mq_serv") {
+            server = value;
+        } else if (key == "mq_port") {
+            port = value.toInt();
+        } else if (key == "mq_user") {
+            username = value;
+        } else if (key == "mq_pass") {
+            password = value;
+        }
+        if (key == "mq_serv") {
+            // a lookup of the previous server is abandoned, dnsFound ignores its answer
+            serverResolved = false;
+            dnsPending = false;
+            dnsAddress = 0;
+        }
+    });
+
+    // topic handles depending on the hostname
+    hostnameObserver = config.onChange("hostname", [this](const String& key, const String& value) {
+        for (auto& entry : topics) {
+            buildTopic(entry);
+        }
+    });
+
+    clientTap.onPuback([this](uint16_t packetId) { onPuback(packetId); });
+
+    messageEvents = config.getPreference("mq_events", 1) == 1;
+    if (config.getPreference("mq_spill", 0) == 1) {
+        setQueueSpill(true, false);
+    }
+
     if (server == "") {
         eventManager->debug("No MQTT server configured", 1);
         return;
@@ -18,47 +97,289 @@ void MQTTManager::init()
     if (username == "") {
         eventManager->debug("No MQTT username configured", 1);
     }
-    mqttClient.setServer(server.c_str(), port);
 
     mqttClient.setKeepAlive(5);
-    mqttClient.setSocketTimeout(100);
+    mqttClient.setSocketTimeout((connectTimeout + 999) / 1000);  // seconds
+#ifdef ESP32
+    wifiClient.setTimeout((connectTimeout + 999) / 1000);  // seconds on ESP32
+#else
+    wifiClient.setTimeout(connectTimeout);
+#endif
 
     /*mqttClient.setCallback([this](char *topic, byte *payload, unsigned int length)
                            { eventManager->triggerEvent("mqtt", "message", {topic, String((char *)payload, length)}); });*/
-    mqttClient.setCallback([this](char* topic, byte* payload, unsigned int length) {
-        // Créer une instance de String avec la bonne longueur
-        String payloadString;
-        payloadString.reserve(length);  // Réserver de l'espace pour éviter les reallocations
-        for (unsigned int i = 0; i < length; ++i) {
-            payloadString += (char)payload[i];
-        }
-        eventManager->triggerEvent("mqtt", "message", {topic, payloadString});
-    });
+    mqttClient.setCallback([this](char* topic, byte* payload, unsigned int length) { onMessage(topic, payload, length); });
 }
 
 void MQTTManager::loop()
 {
-    static unsigned long lastMillis = 0;
-    unsigned long currentMillis = millis();
+    if (mqttClient.connected()) {
+        mqttClient.loop();
+        if (connectState == MQTT_STATE_SUBSCRIBING) {
+            replaySubscription();
+        }
+        replayQueue();
+        return;
+    }
 
-    /*if (!wifiClient.available()) {
-        eventManager->debug("No WiFi connection, MQTT disabled", 1);
+    if (connectState >= MQTT_STATE_SUBSCRIBING) {
+        stats.disconnected(mqttClient.state());
+        eventManager->debug("MQTT connection lost (state " + String(mqttClient.state()) + ")", 1);
+        eventManager->triggerEvent("mqtt", "Disconnected", {});
+        for (auto& inflightMessage : inflight) {
+            inflightMessage.sentAt = 0;  // resent with DUP after reconnection
+        }
+        backoff = 0;
+        scheduleRetry();
+    }
+    if (status < 2 || server == "") {
+        connectState = MQTT_STATE_IDLE;
         return;
-    }*/
+    }
+
+    switch (connectState) {
+        case MQTT_STATE_IDLE:
+            connectState = MQTT_STATE_RESOLVING;
+            attemptStart = millis();
+            break;
+        case MQTT_STATE_BACKOFF:
+            if (millis() - lastAttempt >= retryDelay) {
+                connectState = MQTT_STATE_RESOLVING;
+                attemptStart = millis();
+            }
+            break;
+        case MQTT_STATE_RESOLVING: {
+            int resolved = resolveServer();
+            if (resolved > 0) {
+                connectState = MQTT_STATE_CONNECTING;
+            } else if (resolved < 0) {
+                scheduleRetry();
+            }
+            break;
+        }
+        case MQTT_STATE_CONNECTING:
+            if (connectBroker()) {
+                subscriptionIndex = 0;
+                connectState = MQTT_STATE_SUBSCRIBING;
+            } else {
+                scheduleRetry();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Asynchronous DNS lookup: polled once per loop, lwIP gives up after its own retries
+int MQTTManager::resolveServer()
+{
+    if (serverResolved) {
+        return 1;
+    }
+    if (!dnsPending) {
+        if (serverIP.fromString(server)) {
+            serverResolved = true;
+            return 1;
+        }
+        ip_addr_t address;
+        LOCK_TCPIP_CORE();
+        dnsName = server;
+        dnsDone = false;
+        err_t err = dns_gethostbyname(server.c_str(), &address, &MQTTManager::dnsFound, this);
+        UNLOCK_TCPIP_CORE();
+        if (err == ERR_OK) {
+            // in the lwIP cache
+            serverIP = IPAddress(ip4_addr_get_u32(ip_2_ip4(&address)));
+            serverResolved = true;
+            return 1;
+        }
+        if (err != ERR_INPROGRESS) {
+            eventManager->debug("MQTT: cannot resolve " + server, 1);
+            return -1;
+        }
+        dnsPending = true;
+        return 0;
+    }
+    if (!dnsDone) {
+        return 0;
+    }
+    dnsPending = false;
+    if (dnsAddress == 0) {
+        eventManager->debug("MQTT: cannot resolve " + server, 1);
+        return -1;
+    }
+    serverIP = IPAddress((uint32_t)dnsAddress);
+    serverResolved = true;
+    return 1;
+}
+
+void MQTTManager::dnsFound(const char* name, const ip_addr_t* address, void* arg)
+{
+    MQTTManager* manager = (MQTTManager*)arg;
+    if (manager->dnsName != name) {
+        return;  // lookup of a server changed since
+    }
+    manager->dnsAddress = address != nullptr ? ip4_addr_get_u32(ip_2_ip4(address)) : 0;
+    manager->dnsDone = true;
+}
+
+bool MQTTManager::connectBroker()
+{
+    connectAttempts++;
+    lastAttempt = millis();
+    eventManager->triggerEvent("mqtt", "ConnectionInProgress", {});
+    eventManager->debug("Attempting MQTT connection...", 1);
+    mqttClient.setServer(serverIP, port);
+    if (!mqttClient.connect(config.getHostname().c_str(), username.c_str(), password.c_str())) {
+        connectFailures++;
+        stats.attemptFailed();
+        // the address may have changed, resolve it again after a few failures
+        if (++consecutiveFailures % 3 == 0) {
+            serverResolved = false;
+        }
+        eventManager->triggerEvent("mqtt", "ConnectionFailed", {});
+        eventManager->debug("MQTT error: " + String(mqttClient.state()), 2);
+        return false;
+    }
+    lastConnectLatency = millis() - attemptStart;
+    totalConnectLatency += lastConnectLatency;
+    if (lastConnectLatency > maxConnectLatency) {
+        maxConnectLatency = lastConnectLatency;
+    }
+    connectCount++;
+    stats.connected(lastConnectLatency);
+    consecutiveFailures = 0;
+    backoff = 0;
+    eventManager->triggerEvent("mqtt", "Connected", {this->server});
+    eventManager->debug("MQTT connected (hostname = " + config.getHostname() + ", " + String(lastConnectLatency) + " ms)", 1);
+    return true;
+}
+
+// Exponential backoff with jitter, so that nodes don't retry in lockstep
+void MQTTManager::scheduleRetry()
+{
+    backoff = backoff == 0 ? backoffMin : backoff * 2;
+    if (backoff > backoffMax) {
+        backoff = backoffMax;
+    }
+    retryDelay = backoff / 2 + random(backoff / 2 + 1);
+    lastAttempt = millis();
+    connectState = MQTT_STATE_BACKOFF;
+    eventManager->debug("MQTT: next attempt in " + String(retryDelay) + " ms", 2);
+}
+
+void MQTTManager::replaySubscription()
+{
+    if (subscriptionIndex < subscriptions.size()) {
+        eventManager->debug("Process subscription " + subscriptions[subscriptionIndex], 2);
+        subscribe(subscriptions[subscriptionIndex]);
+        subscriptionIndex++;
+    }
+    if (subscriptionIndex >= subscriptions.size()) {
+        connectState = MQTT_STATE_CONNECTED;
+    }
+}
+
+ConnectionStats& MQTTManager::getStats()
+{
+    return stats;
+}
+
+String MQTTManager::getConnectInfos()
+{
+    static const char* states[] = {"idle", "backoff", "resolving", "connecting", "subscribing", "connected"};
+    String infos = "State: " + String(states[connectState]);
+    if (connectState == MQTT_STATE_BACKOFF) {
+        infos += " (" + String(retryDelay - (millis() - lastAttempt)) + " ms)";
+    }
+    infos += "\nAttempts: " + String(connectAttempts) + ", failures: " + String(connectFailures);
+    if (connectCount > 0) {
+        infos += "\nConnect latency: last " + String(lastConnectLatency) + " ms, avg " + String(totalConnectLatency / connectCount) + " ms, max " +
+                 String(maxConnectLatency) + " ms";
+    }
+    return infos;
+}
 
-    if (currentMillis - lastMillis >= 1000) {
-        if ((status >= 2) && server != "" && !mqttClient.connected()) {
-            if (!reconnect()) {
-                eventManager->debug("MQTT connection failed, try again in 1 seconds", 1);
+// Paced replay of the messages queued while disconnected, oldest first
+void MQTTManager::replayQueue()
+{
+    if (publishQueue.isEmpty() || !mqttClient.connected()) {
+        return;
+    }
+    unsigned long currentMillis = millis();
+    if (currentMillis - lastReplay < replayInterval) {
+        return;
+    }
+    lastReplay = currentMillis;
+    for (uint i = 0; i < replayBurst && !publishQueue.isEmpty(); i++) {
+        MQTTQueuedMessage* message = publishQueue.front();
+        if (message == nullptr) {
+            break;  // spill file lost
+        }
+        if (!sendMessage(message->topic, message->payload, message->retained)) {
+            if (!mqttClient.connected()) {
+                return;  // keep the message for the next connection
             }
+            eventManager->debug("MQTT replay failed, message dropped: " + message->topic, 1);
         }
-        lastMillis = currentMillis;
+        publishQueue.pop();
+    }
+    if (publishQueue.isEmpty()) {
+        eventManager->debug("MQTT queue replayed", 2);
+    }
+}
+
+void MQTTManager::onMessage(char* topic, byte* payload, unsigned int length)
+{
+    unsigned long start = micros();
+    MQTTMessage message(topic, payload, length);
+    if (!subscriptionRefs.empty()) {
+        cacheValue(message);
+    }
+    handlers.match(message.topicString(), [&message](const MQTTMessageHandler& handler) { handler(message); });
+    // a retained command would run again at each connection
+    if (commandTopic.isValid() && !clientTap.isLastPublishRetained() && getTopic(commandTopic) == message.topicString()) {
+        eventManager->triggerCommand(message.payloadString());
+    }
+    if (messageEvents) {
+        eventManager->triggerEvent("mqtt", "message", {message.topicString(), message.payloadString()});
+    }
+    uint32_t elapsed = micros() - start;
+    dispatchCount++;
+    dispatchTime += elapsed;
+    if (elapsed > dispatchMax) {
+        dispatchMax = elapsed;
+    }
+}
+
+String MQTTManager::getDispatchInfos()
+{
+    return "Dispatch: " + String(dispatchCount) + " messages, avg " + String(dispatchCount > 0 ? (uint32_t)(dispatchTime / dispatchCount) : 0) +
+           " us, max " + String(dispatchMax) + " us, " + String(handlers.size()) + " handlers";
+}
+
+void MQTTManager::resetDispatchStats()
+{
+    dispatchCount = 0;
+    dispatchTime = 0;
+    dispatchMax = 0;
+}
+
+void MQTTManager::setMessageEvents(bool enabled, bool save)
+{
+    messageEvents = enabled;
+    if (save) {
+        config.setPreference("mq_events", enabled ? 1 : 0);
     }
-    mqttClient.loop();
 }
 
 void MQTTManager::setStatus(uint status)
 {
+    if (status >= 2 && this->status < 2 && connectState == MQTT_STATE_BACKOFF) {
+        // WiFi is back, don't wait for the backoff delay
+        connectState = MQTT_STATE_IDLE;
+        backoff = 0;
+    }
     this->status = status;
 }
 
@@ -69,41 +390,234 @@ bool MQTTManager::isConnected()
 
 bool MQTTManager::reconnect()
 {
-    if (!mqttClient.connected()) {
-        eventManager->triggerEvent("mqtt", "ConnectionInProgress", {});
-        eventManager->debug("Attempting MQTT connection...", 1);
-        if (mqttClient.connect(config.getHostname().c_str(), username.c_str(), password.c_str())) {
-            eventManager->triggerEvent("mqtt", "Connected", {this->server});
-            eventManager->debug("MQTT connected (hostname = " + config.getHostname() + ")", 1);
-            for (const auto& topic : subscriptions) {
-                eventManager->debug("Process subscription " + topic, 2);
-                subscribe(topic);
-            }
-            for (const auto& pub : publications) {
-                eventManager->debug("Publishing stored publication: " + pub.first + " = " + pub.second, 2);
-                publish(pub.first, pub.second);
-                removePublication(pub.first);
-            }
-            return true;
-        } else {
-            eventManager->triggerEvent("mqtt", "ConnectionFailed", {});
-            eventManager->debug("MQTT error: " + String(mqttClient.state()), 2);
-            return false;
-        }
+    if (!mqttClient.connected() && connectState <= MQTT_STATE_BACKOFF) {
+        backoff = 0;
+        connectState = MQTT_STATE_RESOLVING;
+        attemptStart = millis();
     }
-    return true;
+    return mqttClient.connected();
 }
 
-void MQTTManager::publish(String topic, String payload, bool enableDebug)
+void MQTTManager::publish(const String& topic, const String& payload, bool enableDebug, bool retained)
 {
     if (enableDebug) {
         eventManager->debug("Publishing to " + topic + ": " + payload, 2);
     }
+    // queue while disconnected, and while older messages are waiting to keep the order
+    if (!mqttClient.connected() || !publishQueue.isEmpty()) {
+        if (!publishQueue.push(topic, payload, retained) && enableDebug) {
+            eventManager->debug("MQTT queue full, oldest message dropped", 1);
+        }
+        return;
+    }
+    if (!sendMessage(topic, payload, retained) && enableDebug) {
+        eventManager->debug("MQTT publish failed: " + topic, 1);
+    }
+}
+
+void MQTTManager::publish(MQTTTopicHandle handle, const String& payload, bool enableDebug, bool retained)
+{
+    if (handle.isValid() && (size_t)handle.index < topics.size()) {
+        publish(topics[handle.index].topic, payload, enableDebug, retained);
+    }
+}
+
+bool MQTTManager::publishStream(MQTTTopicHandle handle, MQTTPayloadWriter writer, bool retained)
+{
+    return publishStream(getTopic(handle), writer, retained);
+}
+
+bool MQTTManager::canPublishStream()
+{
+    return mqttClient.connected() && publishQueue.isEmpty();
+}
+
+bool MQTTManager::publishStream(String topic, MQTTPayloadWriter writer, bool retained)
+{
+    if (!canPublishStream()) {
+        eventManager->debug("MQTT stream not sent (not connected or queue not empty): " + topic, 2);
+        return false;
+    }
+    PrintCounter counter;
+    writer(counter);
+    eventManager->debug("Publishing to " + topic + ": " + String(counter.count) + " bytes (streamed)", 2);
+    return sendStream(topic, counter.count, retained, writer);
+}
+
+bool MQTTManager::publishStream(String topic, Stream& source, size_t length, bool retained)
+{
+    if (!canPublishStream()) {
+        eventManager->debug("MQTT stream not sent (not connected or queue not empty): " + topic, 2);
+        return false;
+    }
+    eventManager->debug("Publishing to " + topic + ": " + String(length) + " bytes (streamed)", 2);
+    return sendStream(topic, length, retained, [&source, length](Print& out) {
+        uint8_t buffer[64];
+        size_t remaining = length;
+        while (remaining > 0) {
+            size_t read = source.readBytes(buffer, remaining < sizeof(buffer) ? remaining : sizeof(buffer));
+            if (read == 0) {
+                return;  // source ended early, detected by sendStream
+            }
+            out.write(buffer, read);
+            remaining -= read;
+        }
+    });
+}
+
+bool MQTTManager::sendMessage(const String& topic, const String& payload, bool retained)
+{
+    // fixed header (5) + topic length (2) + topic + payload must fit in the PubSubClient buffer
+    if (7 + topic.length() + payload.length() <= mqttClient.getBufferSize()) {
+        return mqttClient.publish(topic.c_str(), payload.c_str(), retained);
+    }
+    return sendStream(topic, payload.length(), retained, [&payload](Print& out) { out.write((const uint8_t*)payload.c_str(), payload.length()); });
+}
+
+bool MQTTManager::sendStream(const String& topic, size_t length, bool retained, const MQTTPayloadWriter& writer)
+{
+    if (!mqttClient.beginPublish(topic.c_str(), length, retained)) {
+        return false;
+    }
+    MQTTPayloadPrint out(mqttClient, length);
+    writer(out);
+    out.sendChunk();
+    if (out.failed || out.written < length) {
+        // the packet announced more bytes than were sent, the stream is out of sync
+        eventManager->debug("MQTT stream to " + topic + " incomplete (" + String(out.written) + "/" + String(length) + " bytes), disconnecting", 1);
+        mqttClient.disconnect();
+        return false;
+    }
+    if (out.overflow > 0) {
+        eventManager->debug("MQTT stream to " + topic + " truncated: writer produced " + String(out.overflow) + " extra bytes", 1);
+    }
+    return mqttClient.endPublish() == 1 && out.overflow == 0;
+}
+
+bool MQTTManager::publishQos1(String topic, String payload, bool retained)
+{
+    eventManager->debug("Publishing (QoS 1) to " + topic + ": " + payload, 2);
+    bool queued = qos1Queue.push(topic, payload, retained);
+    fillInflight();
+    return queued;
+}
+
+void MQTTManager::setInflightWindow(uint window, uint ackTimeout, uint maxRetries)
+{
+    this->inflightWindow = window > 0 ? window : 1;
+    this->ackTimeout = ackTimeout;
+    this->maxRetries = maxRetries;
+}
+
+void MQTTManager::checkInflight()
+{
     if (!mqttClient.connected()) {
-        eventManager->debug("MQTT not connected, can't publish: " + topic + " = " + payload, 1);
         return;
     }
-    mqttClient.publish(topic.c_str(), payload.c_str());
+    unsigned long now = millis();
+    for (auto it = inflight.begin(); it != inflight.end();) {
+        if (it->sentAt != 0 && now - it->sentAt < ackTimeout) {
+            ++it;
+            continue;
+        }
+        if (it->sentAt != 0) {
+            if (it->retries >= maxRetries) {
+                eventManager->debug("MQTT QoS 1: no ack for " + it->message.topic + ", message dropped", 1);
+                qos1Stats.failed++;
+                it = inflight.erase(it);
+                continue;
+            }
+            it->retries++;
+            qos1Stats.retries++;
+        }
+        sendQos1(*it);
+        ++it;
+    }
+    fillInflight();
+}
+
+String MQTTManager::getQos1Infos()
+{
+    return "QoS 1: " + String(inflight.size()) + "/" + String(inflightWindow) + " in flight, " + String(qos1Queue.size()) + " waiting\nSent: " +
+           String(qos1Stats.sent) + ", acked: " + String(qos1Stats.acked) + ", retries: " + String(qos1Stats.retries) + ", failed: " +
+           String(qos1Stats.failed);
+}
+
+void MQTTManager::onPuback(uint16_t packetId)
+{
+    for (auto it = inflight.begin(); it != inflight.end(); ++it) {
+        if (it->packetId == packetId) {
+            qos1Stats.acked++;
+            inflight.erase(it);
+            break;
+        }
+    }
+    // the window is refilled by checkInflight, not while PubSubClient is reading the packet
+}
+
+void MQTTManager::fillInflight()
+{
+    while (mqttClient.connected() && inflight.size() < inflightWindow && !qos1Queue.isEmpty()) {
+        MQTTQueuedMessage* message = qos1Queue.front();
+        if (message == nullptr) {
+            break;
+        }
+        InflightMessage inflightMessage;
+        inflightMessage.packetId = allocatePacketId();
+        inflightMessage.message = *message;
+        inflightMessage.sentAt = 0;
+        inflightMessage.retries = 0;
+        inflightMessage.transmitted = false;
+        qos1Queue.pop();
+        inflight.push_back(inflightMessage);
+        sendQos1(inflight.back());
+    }
+}
+
+// PubSubClient only publishes with QoS 0, the PUBLISH packet is written directly on the connection
+bool MQTTManager::sendQos1(InflightMessage& inflightMessage)
+{
+    const MQTTQueuedMessage& message = inflightMessage.message;
+    size_t remainingLength = 2 + message.topic.length() + 2 + message.payload.length();
+    uint8_t header[5 + 2];
+    size_t headerLength = 0;
+    header[headerLength++] = 0x32 | (inflightMessage.transmitted ? 0x08 : 0) | (message.retained ? 0x01 : 0);
+    do {
+        uint8_t digit = remainingLength % 128;
+        remainingLength /= 128;
+        header[headerLength++] = digit | (remainingLength > 0 ? 0x80 : 0);
+    } while (remainingLength > 0);
+    header[headerLength++] = message.topic.length() >> 8;
+    header[headerLength++] = message.topic.length() & 0xFF;
+
+    uint8_t packetId[2] = {(uint8_t)(inflightMessage.packetId >> 8), (uint8_t)(inflightMessage.packetId & 0xFF)};
+    bool ok = clientTap.write(header, headerLength) == headerLength;
+    ok = ok && clientTap.write((const uint8_t*)message.topic.c_str(), message.topic.length()) == message.topic.length();
+    ok = ok && clientTap.write(packetId, 2) == 2;
+    ok = ok && clientTap.write((const uint8_t*)message.payload.c_str(), message.payload.length()) == message.payload.length();
+    inflightMessage.transmitted = true;
+    inflightMessage.sentAt = millis();
+    if (inflightMessage.sentAt == 0) {
+        inflightMessage.sentAt = 1;
+    }
+    qos1Stats.sent++;
+    return ok;
+}
+
+uint16_t MQTTManager::allocatePacketId()
+{
+    while (true) {
+        if (++nextPacketId < 0x8000) {
+            nextPacketId = 0x8000;
+        }
+        bool used = false;
+        for (const auto& inflightMessage : inflight) {
+            used = used || inflightMessage.packetId == nextPacketId;
+        }
+        if (!used) {
+            return nextPacketId;
+        }
+    }
 }
 
 void MQTTManager::subscribe(String topic)
@@ -172,7 +686,7 @@ String MQTTManager::retrievePassword()
 
 String MQTTManager::getDebugInfos()
 {
-    return "Server: " + retrieveServer() + "\nPort: " + retrievePort() + "\nUsername: " + retrieveUsername() + "\nPassword: " + retrievePassword();
+    return "Server: " + server + "\nPort: " + port + "\nUsername: " + username + "\nPassword: " + password;
 }
 
 void MQTTManager::processEvent(String type, String event, std::vector<String> params)
@@ -234,31 +748,40 @@ bool MQTTManager::processCommand(String command, std::vector<String> params)
             saveServer(params[0]);
             eventManager->debug("Server set to: " + params[0], 0);
         } else {
-            eventManager->debug("Server: " + retrieveServer(), 0);
+            eventManager->debug("Server: " + server, 0);
         }
     } else if (command == "port") {
         if (params.size() > 0) {
             savePort(params[0].toInt());
             eventManager->debug("Port set to: " + params[0], 0);
         } else {
-            eventManager->debug("Port: " + String(retrievePort()), 0);
+            eventManager->debug("Port: " + String(port), 0);
         }
     } else if (command == "user") {
         if (params.size() > 0) {
             saveUsername(params[0]);
             eventManager->debug("Username set to: " + params[0], 0);
         } else {
-            eventManager->debug("Username: " + retrieveUsername(), 0);
+            eventManager->debug("Username: " + username, 0);
         }
     } else if (command == "pass") {
         if (params.size() > 0) {
             savePassword(params[0]);
             eventManager->debug("Password set to: " + params[0], 0);
         } else {
-            eventManager->debug("Password: " + retrievePassword(), 0);
+            eventManager->debug("Password: " + password, 0);
         }
     } else if (command == "status") {
         eventManager->debug("Status: " + String(isConnected()), 0);
+        eventManager->debug(getConnectInfos(), 0);
+        eventManager->debug(getDispatchInfos(), 0);
+    } else if (command == "stats") {
+        eventManager->debug(stats.getInfos(), 0);
+        if (params.size() > 0 && params[0] == "reset") {
+            stats.reset();
+        }
+    } else if (command == "cache") {
+        eventManager->debug(getCacheInfos(), 0);
     } else if (command == "connect") {
         reconnect();
     } else if (command == "subscribe") {
@@ -287,12 +810,165 @@ bool MQTTManager::processCommand(String command, std::vector<String> params)
         }
     } else if (command == "debug") {
         eventManager->debug(getDebugInfos(), 0);
+    } else if (command == "events") {
+        if (params.size() > 0) {
+            setMessageEvents(params[0].toInt() == 1);
+        }
+        eventManager->debug("Message events: " + String(messageEvents ? "ON" : "OFF"), 0);
+    } else if (command == "qos1") {
+        eventManager->debug(getQos1Infos(), 0);
+    } else if (command == "queue") {
+        if (params.size() > 0 && params[0] == "clear") {
+            publishQueue.clear();
+        }
+        eventManager->debug(getQueueInfos(), 0);
+    } else if (command == "spill") {
+        if (params.size() > 0) {
+            setQueueSpill(params[0].toInt() == 1);
+        }
+        eventManager->debug("Queue spill: " + String(publishQueue.isSpillEnabled() ? "ON" : "OFF"), 0);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+uint MQTTManager::addHandler(String filter, MQTTHandler handler)
+{
+    return addMessageHandler(filter, [handler](const MQTTMessage& message) { handler(message.topicString(), message.payloadString()); });
+}
+
+uint MQTTManager::addMessageHandler(String filter, MQTTMessageHandler handler)
+{
+    uint id = handlers.add(filter, handler);
+    if (id == 0) {
+        eventManager->debug("Invalid MQTT topic filter: " + filter, 1);
+    }
+    return id;
+}
+
+bool MQTTManager::removeHandler(uint id)
+{
+    return handlers.remove(id);
+}
+
+uint MQTTManager::subscribeHandler(String filter, MQTTHandler handler)
+{
+    uint id = addHandler(filter, handler);
+    if (id == 0) {
+        return 0;
+    }
+    sharedHandlers[id] = filter;
+    if (subscriptionRefs[filter]++ == 0) {
+        addSubscription(filter);
+        if (mqttClient.connected()) {
+            subscribe(filter);
+        }
     } else {
+        eventManager->debug("Shared subscription: " + filter + " (" + String(subscriptionRefs[filter]) + " handlers)", 3);
+    }
+    // no need to wait for the broker to resend retained values, copied first as the handler may change the cache
+    std::vector<std::pair<String, String>> cached;
+    for (auto& value : lastValues) {
+        if (MQTTTopicTrie::matches(filter, value.first)) {
+            value.second.used = ++cacheClock;
+            cached.push_back(std::make_pair(value.first, value.second.payload));
+        }
+    }
+    for (const auto& value : cached) {
+        cacheHits++;
+        handler(value.first, value.second);
+    }
+    return id;
+}
+
+bool MQTTManager::unsubscribeHandler(uint id)
+{
+    auto it = sharedHandlers.find(id);
+    if (it == sharedHandlers.end()) {
         return false;
     }
+    String filter = it->second;
+    sharedHandlers.erase(it);
+    removeHandler(id);
+    if (--subscriptionRefs[filter] > 0) {
+        return true;
+    }
+    subscriptionRefs.erase(filter);
+    removeSubscription(filter);
+    if (mqttClient.connected()) {
+        unsubscribe(filter);
+    }
+    // forget the values no other subscription covers
+    for (auto value = lastValues.begin(); value != lastValues.end();) {
+        bool covered = false;
+        for (const auto& ref : subscriptionRefs) {
+            if (MQTTTopicTrie::matches(ref.first, value->first)) {
+                covered = true;
+                break;
+            }
+        }
+        value = covered ? std::next(value) : lastValues.erase(value);
+    }
     return true;
 }
 
+void MQTTManager::cacheValue(const MQTTMessage& message)
+{
+    if (message.length == 0) {
+        if (clientTap.isLastPublishRetained()) {  // retained value cleared
+            lastValues.erase(message.topicString());
+        }
+        return;
+    }
+    if (message.length > CACHE_MAX_PAYLOAD) {
+        return;
+    }
+    auto it = lastValues.find(message.topicString());
+    if (it != lastValues.end()) {
+        it->second.payload = message.payloadString();
+        it->second.used = ++cacheClock;
+        return;
+    }
+    bool subscribed = false;
+    for (const auto& ref : subscriptionRefs) {
+        if (MQTTTopicTrie::matches(ref.first, message.topicString())) {
+            subscribed = true;
+            break;
+        }
+    }
+    if (!subscribed) {
+        return;
+    }
+    if (lastValues.size() >= CACHE_MAX_ENTRIES) {
+        auto oldest = lastValues.begin();
+        for (auto value = lastValues.begin(); value != lastValues.end(); ++value) {
+            if (value->second.used < oldest->second.used) {
+                oldest = value;
+            }
+        }
+        lastValues.erase(oldest);
+        cacheEvictions++;
+    }
+    CachedValue value;
+    value.payload = message.payloadString();
+    value.used = ++cacheClock;
+    lastValues[message.topicString()] = value;
+}
+
+String MQTTManager::getCacheInfos()
+{
+    String infos = "Shared subscriptions: " + String(subscriptionRefs.size()) + ", cached values: " + String(lastValues.size()) + "/" +
+                   String(CACHE_MAX_ENTRIES) + ", delivered from cache: " + String(cacheHits) + ", evicted: " + String(cacheEvictions);
+    for (const auto& ref : subscriptionRefs) {
+        infos += "\n- " + ref.first + " (" + String(ref.second) + " handlers)";
+    }
+    for (const auto& value : lastValues) {
+        infos += "\n  " + value.first + " = " + value.second.payload;
+    }
+    return infos;
+}
+
 bool MQTTManager::addSubscription(String topic)
 {
     if (topic.length() == 0) {
@@ -324,28 +1000,104 @@ std::vector<String> MQTTManager::getSubscriptions()
     return subscriptions;
 }
 
-bool MQTTManager::storePublication(String topic, String payload)
+MQTTTopicHandle MQTTManager::addTopic(const String& pattern, bool subscribe)
 {
-    eventManager->debug("Storing MQTT publication: " + topic + " = " + payload, 3);
-    auto it = publications.find(topic);
-    if (it != publications.end()) {
-        publications[topic] = payload;
-        return true;
+    MQTTTopicHandle handle;
+    handle.index = topics.size();
+    topics.push_back({pattern, "", subscribe});
+    buildTopic(topics.back());
+    return handle;
+}
+
+void MQTTManager::setTopic(MQTTTopicHandle handle, const String& pattern)
+{
+    if (handle.isValid() && (size_t)handle.index < topics.size()) {
+        topics[handle.index].pattern = pattern;
+        buildTopic(topics[handle.index]);
+    }
+}
+
+const String& MQTTManager::getTopic(MQTTTopicHandle handle) const
+{
+    static const String empty;
+    if (handle.isValid() && (size_t)handle.index < topics.size()) {
+        return topics[handle.index].topic;
+    }
+    return empty;
+}
+
+void MQTTManager::setCommandTopic(const String& pattern)
+{
+    if (commandTopic.isValid()) {
+        setTopic(commandTopic, pattern);
     } else {
-        publications[topic] = payload;
-        return false;
+        commandTopic = addTopic(pattern, true);
+    }
+}
+
+void MQTTManager::buildTopic(TopicEntry& entry)
+{
+    String topic = entry.pattern;
+    topic.replace("{hostname}", config.getHostname());
+    if (topic == entry.topic) {
+        return;
     }
+    if (entry.subscribe) {
+        if (entry.topic.length() > 0) {
+            removeSubscription(entry.topic);
+            if (mqttClient.connected()) {
+                unsubscribe(entry.topic);
+            }
+        }
+        addSubscription(topic);
+        if (mqttClient.connected()) {
+            subscribe(topic);
+        }
+    }
+    eventManager->debug("MQTT topic: " + topic, 3);
+    entry.topic = topic;
+}
+
+// Queue the latest value of topic until the next connection, returns true if a previous value was replaced
+bool MQTTManager::storePublication(String topic, String payload)
+{
+    eventManager->debug("Storing MQTT publication: " + topic + " = " + payload, 3);
+    bool replaced = publishQueue.remove(topic);
+    publishQueue.push(topic, payload, false, MQTT_QUEUE_LATEST_ONLY);
+    return replaced;
 }
 
 bool MQTTManager::removePublication(String topic)
 {
     eventManager->debug("Removing MQTT publication: " + topic, 3);
-    auto it = publications.find(topic);
-    if (it != publications.end()) {
-        publications.erase(it);
-        return true;
+    return publishQueue.remove(topic);
+}
+
+void MQTTManager::setQueuePolicy(String topicPrefix, mqtt_queue_policy policy)
+{
+    publishQueue.setPolicy(topicPrefix, policy);
+}
+
+bool MQTTManager::setQueueSpill(bool enabled, bool save)
+{
+    bool ok = true;
+    if (enabled) {
+        ok = publishQueue.enableSpill();
+        if (!ok) {
+            eventManager->debug("MQTT queue: LittleFS not available, spill disabled", 1);
+        }
+    } else {
+        publishQueue.disableSpill();
     }
-    return false;
+    if (save) {
+        config.setPreference("mq_spill", enabled && ok ? 1 : 0);
+    }
+    return ok;
+}
+
+String MQTTManager::getQueueInfos()
+{
+    return publishQueue.getInfos();
 }
 
 #ifndef DISABLE_ESPUI
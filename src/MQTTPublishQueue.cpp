@@ -0,0 +1,334 @@
+#include "../include/MQTTPublishQueue.h"
+
+#define SPILL_RECORD_HEADER_SIZE 5  // retained (u8) + topic length (u16) + payload length (u16)
+
+void MQTTPublishQueue::setPolicy(const String& topicPrefix, mqtt_queue_policy policy)
+{
+    for (auto& entry : policies) {
+        if (entry.first == topicPrefix) {
+            entry.second = policy;
+            return;
+        }
+    }
+    policies.push_back(std::make_pair(topicPrefix, policy));
+}
+
+mqtt_queue_policy MQTTPublishQueue::getPolicy(const String& topic)
+{
+    // longest matching prefix wins
+    mqtt_queue_policy policy = MQTT_QUEUE_KEEP_ALL;
+    unsigned int matchLength = 0;
+    for (const auto& entry : policies) {
+        if (entry.first.length() >= matchLength && topic.startsWith(entry.first)) {
+            policy = entry.second;
+            matchLength = entry.first.length();
+        }
+    }
+    return policy;
+}
+
+bool MQTTPublishQueue::enableSpill(const char* path, size_t maxFileSize)
+{
+    if (!LittleFS.begin()) {
+        return false;
+    }
+    spillPath = path;
+    spillMaxSize = maxFileSize;
+    spillReadOffset = 0;
+    spillSize = 0;
+    spillCount = 0;
+    spillPending = 0;
+
+    // messages left by a previous run are replayed too, from the last saved position
+    File offsetFile = LittleFS.open(getOffsetPath(), "r");
+    if (offsetFile) {
+        uint8_t data[4];
+        if (offsetFile.read(data, 4) == 4) {
+            spillReadOffset = data[0] | data[1] << 8 | data[2] << 16 | (size_t)data[3] << 24;
+        }
+        offsetFile.close();
+    }
+    File file = LittleFS.open(spillPath, "r");
+    if (file && spillReadOffset > file.size()) {
+        spillReadOffset = 0;
+    }
+    spillSize = spillReadOffset;
+    if (file && file.seek(spillSize)) {
+        uint8_t header[SPILL_RECORD_HEADER_SIZE];
+        while (file.read(header, SPILL_RECORD_HEADER_SIZE) == SPILL_RECORD_HEADER_SIZE) {
+            size_t recordSize = SPILL_RECORD_HEADER_SIZE + (header[1] | header[2] << 8) + (header[3] | header[4] << 8);
+            if (spillSize + recordSize > file.size()) {
+                break;  // truncated record
+            }
+            spillSize += recordSize;
+            spillCount++;
+            file.seek(spillSize);
+        }
+    }
+    if (file) {
+        file.close();
+    }
+    spillEnabled = true;
+    return true;
+}
+
+void MQTTPublishQueue::disableSpill()
+{
+    spillEnabled = false;
+}
+
+bool MQTTPublishQueue::isSpillEnabled()
+{
+    return spillEnabled;
+}
+
+bool MQTTPublishQueue::push(const String& topic, const String& payload, bool retained)
+{
+    return push(topic, payload, retained, getPolicy(topic));
+}
+
+bool MQTTPublishQueue::push(const String& topic, const String& payload, bool retained, mqtt_queue_policy policy)
+{
+    stats.queued++;
+    if (policy == MQTT_QUEUE_LATEST_ONLY) {
+        for (auto it = messages.begin(); it != messages.end(); ++it) {
+            if (it->topic == topic) {
+                eraseMessage(it);
+                stats.replaced++;
+                break;
+            }
+        }
+    }
+
+    size_t messageBytes = topic.length() + payload.length();
+    bool ok = true;
+    if (policy == MQTT_QUEUE_KEEP_ALL && spillEnabled && (spillCount > 0 || isFull(messageBytes))) {
+        // keep the order: once spilling started, keep-all messages go to the file until it is replayed
+        if (spill(topic, payload, retained)) {
+            return true;
+        }
+        stats.dropped++;
+        return false;
+    }
+    while (!messages.empty() && isFull(messageBytes)) {
+        dropOldest();
+        ok = false;
+    }
+    pushRam(topic, payload, retained);
+    return ok;
+}
+
+bool MQTTPublishQueue::remove(const String& topic)
+{
+    bool removed = false;
+    for (auto it = messages.begin(); it != messages.end();) {
+        if (it->topic == topic) {
+            it = eraseMessage(it);
+            removed = true;
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+void MQTTPublishQueue::clear()
+{
+    messages.clear();
+    bytes = 0;
+    clearSpill();
+}
+
+bool MQTTPublishQueue::isEmpty()
+{
+    return messages.empty() && spillCount == 0;
+}
+
+size_t MQTTPublishQueue::size()
+{
+    return messages.size() + spillCount;
+}
+
+MQTTQueuedMessage* MQTTPublishQueue::front()
+{
+    if (messages.empty()) {
+        refill();
+    }
+    return messages.empty() ? nullptr : &messages.front();
+}
+
+void MQTTPublishQueue::pop()
+{
+    if (messages.empty()) {
+        refill();
+    }
+    if (messages.empty()) {
+        return;
+    }
+    eraseMessage(messages.begin());
+    stats.replayed++;
+}
+
+MQTTPublishQueue::Stats MQTTPublishQueue::getStats()
+{
+    return stats;
+}
+
+String MQTTPublishQueue::getInfos()
+{
+    String infos = "Queued: " + String(messages.size()) + " in RAM (" + String(bytes) + " bytes)";
+    if (spillEnabled) {
+        infos += ", " + String(spillCount) + " spilled (" + String(spillSize - spillReadOffset) + " bytes)";
+    }
+    infos += "\nTotal: " + String(stats.queued) + " queued, " + String(stats.replayed) + " replayed, " + String(stats.replaced) + " replaced, " +
+             String(stats.spilled) + " spilled, " + String(stats.dropped) + " dropped";
+    return infos;
+}
+
+bool MQTTPublishQueue::isFull(size_t extraBytes)
+{
+    return messages.size() >= maxMessages || bytes + extraBytes > maxBytes;
+}
+
+void MQTTPublishQueue::pushRam(const String& topic, const String& payload, bool retained)
+{
+    MQTTQueuedMessage message;
+    message.topic = topic;
+    message.payload = payload;
+    message.retained = retained;
+    messages.push_back(message);
+    bytes += topic.length() + payload.length();
+}
+
+void MQTTPublishQueue::dropOldest()
+{
+    eraseMessage(messages.begin());
+    stats.dropped++;
+}
+
+// The messages read back from the spill file are the first spillPending ones of the RAM tier
+std::deque<MQTTQueuedMessage>::iterator MQTTPublishQueue::eraseMessage(std::deque<MQTTQueuedMessage>::iterator it)
+{
+    bool refilled = (size_t)(it - messages.begin()) < spillPending;
+    bytes -= it->topic.length() + it->payload.length();
+    it = messages.erase(it);
+    if (refilled) {
+        spillSent();
+    }
+    return it;
+}
+
+bool MQTTPublishQueue::spill(const String& topic, const String& payload, bool retained)
+{
+    size_t recordSize = SPILL_RECORD_HEADER_SIZE + topic.length() + payload.length();
+    if (spillSize + recordSize > spillMaxSize || topic.length() > 0xFFFF || payload.length() > 0xFFFF) {
+        return false;
+    }
+    File file = LittleFS.open(spillPath, "a");
+    if (!file) {
+        return false;
+    }
+    uint8_t header[SPILL_RECORD_HEADER_SIZE] = {(uint8_t)retained, (uint8_t)(topic.length() & 0xFF), (uint8_t)(topic.length() >> 8),
+                                                (uint8_t)(payload.length() & 0xFF), (uint8_t)(payload.length() >> 8)};
+    bool ok = file.write(header, SPILL_RECORD_HEADER_SIZE) == SPILL_RECORD_HEADER_SIZE;
+    ok = ok && file.write((const uint8_t*)topic.c_str(), topic.length()) == topic.length();
+    ok = ok && file.write((const uint8_t*)payload.c_str(), payload.length()) == payload.length();
+    file.close();
+    if (!ok) {
+        return false;
+    }
+    spillSize += recordSize;
+    spillCount++;
+    stats.spilled++;
+    return true;
+}
+
+static String readFileString(File& file, size_t length)
+{
+    String str;
+    str.reserve(length);
+    char buffer[64];
+    while (length > 0) {
+        size_t chunk = length < sizeof(buffer) ? length : sizeof(buffer);
+        size_t read = file.read((uint8_t*)buffer, chunk);
+        if (read == 0) {
+            break;
+        }
+        str.concat(buffer, read);
+        length -= read;
+    }
+    return str;
+}
+
+// Move the oldest spilled messages back to the RAM tier
+void MQTTPublishQueue::refill()
+{
+    if (spillCount == 0) {
+        return;
+    }
+    File file = LittleFS.open(spillPath, "r");
+    if (!file || !file.seek(spillReadOffset)) {
+        clearSpill();
+        return;
+    }
+    while (spillCount > 0 && messages.size() < maxMessages) {
+        uint8_t header[SPILL_RECORD_HEADER_SIZE];
+        if (file.read(header, SPILL_RECORD_HEADER_SIZE) != SPILL_RECORD_HEADER_SIZE) {
+            spillCount = 0;
+            break;
+        }
+        size_t topicLength = header[1] | header[2] << 8;
+        size_t payloadLength = header[3] | header[4] << 8;
+        if (!messages.empty() && bytes + topicLength + payloadLength > maxBytes) {
+            file.seek(spillReadOffset);
+            break;
+        }
+        String topic = readFileString(file, topicLength);
+        String payload = readFileString(file, payloadLength);
+        pushRam(topic, payload, header[0] != 0);
+        spillReadOffset += SPILL_RECORD_HEADER_SIZE + topicLength + payloadLength;
+        spillCount--;
+        spillPending++;
+    }
+    file.close();
+    if (spillCount == 0 && spillPending == 0) {
+        clearSpill();
+    }
+}
+
+// A message read back from the spill file left the RAM tier: save the replay position after each batch
+void MQTTPublishQueue::spillSent()
+{
+    if (spillPending == 0 || --spillPending > 0) {
+        return;
+    }
+    if (spillCount == 0) {
+        clearSpill();
+    } else {
+        saveSpillOffset();
+    }
+}
+
+void MQTTPublishQueue::saveSpillOffset()
+{
+    File file = LittleFS.open(getOffsetPath(), "w");
+    if (!file) {
+        return;
+    }
+    uint8_t data[4] = {(uint8_t)(spillReadOffset & 0xFF), (uint8_t)(spillReadOffset >> 8), (uint8_t)(spillReadOffset >> 16),
+                       (uint8_t)(spillReadOffset >> 24)};
+    file.write(data, 4);
+    file.close();
+}
+
+void MQTTPublishQueue::clearSpill()
+{
+    if (spillPath.length() > 0) {
+        LittleFS.remove(spillPath.c_str());
+        LittleFS.remove(getOffsetPath().c_str());
+    }
+    spillReadOffset = 0;
+    spillSize = 0;
+    spillCount = 0;
+    spillPending = 0;
+}
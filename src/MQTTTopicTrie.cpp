@@ -0,0 +1,179 @@
+#include "../include/MQTTTopicTrie.h"
+#include "../include/Tools.h"
+
+const String& MQTTMessage::topicString() const
+{
+    if (!topicCopied) {
+        topicCopy = topic;
+        topicCopied = true;
+    }
+    return topicCopy;
+}
+
+const String& MQTTMessage::payloadString() const
+{
+    if (!payloadCopied) {
+        payloadCopy = bytesToString(payload, length);
+        payloadCopied = true;
+    }
+    return payloadCopy;
+}
+
+bool MQTTMessage::payloadEquals(const char* str) const
+{
+    return strlen(str) == length && memcmp(payload, str, length) == 0;
+}
+
+uint MQTTTopicTrie::add(const String& filter, MQTTMessageHandler handler)
+{
+    if (filter.length() == 0) {
+        return 0;
+    }
+    std::vector<String> levels = split(filter, '/');
+    Node* node = &root;
+    for (size_t i = 0; i < levels.size(); i++) {
+        const String& level = levels[i];
+        if (level == "#") {
+            if (i != levels.size() - 1) {
+                return 0;  // '#' must be the last level
+            }
+            break;
+        }
+        std::unique_ptr<Node>& child = level == "+" ? node->plus : node->children[level];
+        if (!child) {
+            child.reset(new Node());
+        }
+        node = child.get();
+    }
+
+    uint id = nextId++;
+    if (levels.back() == "#") {
+        node->multi.push_back(id);
+    } else {
+        node->handlers.push_back(id);
+    }
+    entries[id] = {filter, std::make_shared<MQTTMessageHandler>(handler)};
+    return id;
+}
+
+bool MQTTTopicTrie::remove(uint id)
+{
+    auto it = entries.find(id);
+    if (it == entries.end()) {
+        return false;
+    }
+    std::vector<String> levels = split(it->second.filter, '/');
+    entries.erase(it);
+    return removeNode(&root, levels, 0, id);
+}
+
+size_t MQTTTopicTrie::size()
+{
+    return entries.size();
+}
+
+size_t MQTTTopicTrie::match(const String& topic, std::function<void(const MQTTMessageHandler&)> visitor)
+{
+    if (entries.empty()) {
+        return 0;
+    }
+    // a visitor may dispatch another message: the buffer is taken for this call
+    std::vector<uint> ids;
+    ids.swap(matched);
+    ids.clear();
+    matchNode(&root, split(topic, '/'), 0, ids);
+    size_t count = 0;
+    for (uint id : ids) {
+        auto it = entries.find(id);
+        if (it == entries.end()) {
+            continue;  // removed by a previous handler
+        }
+        std::shared_ptr<MQTTMessageHandler> handler = it->second.handler;
+        visitor(*handler);
+        count++;
+    }
+    matched.swap(ids);
+    return count;
+}
+
+void MQTTTopicTrie::matchNode(Node* node, const std::vector<String>& levels, size_t index, std::vector<uint>& ids)
+{
+    // wildcards don't match topics starting with '$' (e.g. $SYS)
+    bool wildcards = index > 0 || !levels[0].startsWith("$");
+
+    if (wildcards) {
+        ids.insert(ids.end(), node->multi.begin(), node->multi.end());
+    }
+    if (index == levels.size()) {
+        ids.insert(ids.end(), node->handlers.begin(), node->handlers.end());
+        return;
+    }
+    auto it = node->children.find(levels[index]);
+    if (it != node->children.end()) {
+        matchNode(it->second.get(), levels, index + 1, ids);
+    }
+    if (wildcards && node->plus) {
+        matchNode(node->plus.get(), levels, index + 1, ids);
+    }
+}
+
+bool MQTTTopicTrie::removeNode(Node* node, const std::vector<String>& levels, size_t index, uint id)
+{
+    if (index == levels.size()) {
+        return removeId(node->handlers, id);
+    }
+    const String& level = levels[index];
+    if (level == "#") {
+        return removeId(node->multi, id);
+    }
+    bool removed = false;
+    if (level == "+") {
+        if (node->plus) {
+            removed = removeNode(node->plus.get(), levels, index + 1, id);
+            if (node->plus->isEmpty()) {
+                node->plus.reset();
+            }
+        }
+    } else {
+        auto it = node->children.find(level);
+        if (it != node->children.end()) {
+            removed = removeNode(it->second.get(), levels, index + 1, id);
+            if (it->second->isEmpty()) {
+                node->children.erase(it);
+            }
+        }
+    }
+    return removed;
+}
+
+bool MQTTTopicTrie::removeId(std::vector<uint>& ids, uint id)
+{
+    for (auto it = ids.begin(); it != ids.end(); ++it) {
+        if (*it == id) {
+            ids.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MQTTTopicTrie::matches(const String& filter, const String& topic)
+{
+    if (filter == topic) {
+        return true;
+    }
+    std::vector<String> filterLevels = split(filter, '/');
+    std::vector<String> topicLevels = split(topic, '/');
+    if (topic.startsWith("$") && (filterLevels[0] == "+" || filterLevels[0] == "#")) {
+        return false;
+    }
+    for (size_t i = 0; i < filterLevels.size(); i++) {
+        if (filterLevels[i] == "#") {
+            return i == filterLevels.size() - 1;
+        }
+        if (i >= topicLevels.size() || (filterLevels[i] != "+" && filterLevels[i] != topicLevels[i])) {
+            return false;
+        }
+    }
+    return filterLevels.size() == topicLevels.size();
+}
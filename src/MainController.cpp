@@ -1,4 +1,66 @@
 #include "../include/MainController.h"
+#include <StreamString.h>
+
+// Print adapter sending a command output to the consoles (serial and telnet) by chunks, for the
+// outputs too large for a single debug message (sys:config, sys:snapshot)
+class ConsolePrint : public Print
+{
+  public:
+    ConsolePrint(WiFiManager& wiFiManager) : wiFiManager(wiFiManager) {}
+    ~ConsolePrint() { sendChunk(); }
+
+    size_t write(uint8_t c) override
+    {
+        chunk[used++] = c;
+        if (used == sizeof(chunk)) {
+            sendChunk();
+        }
+        return 1;
+    }
+    using Print::write;
+
+  private:
+    WiFiManager& wiFiManager;
+    uint8_t chunk[64];
+    size_t used = 0;
+
+    void sendChunk()
+    {
+        if (used > 0) {
+            Serial.write(chunk, used);
+            wiFiManager.writeTelnet(chunk, used);
+            used = 0;
+        }
+    }
+};
+
+// Snapshot bytes per sys:restore line, so that the line fits the console (SERIAL_LINE_SIZE)
+#define SNAPSHOT_LINE_BYTES ((SERIAL_LINE_SIZE - 16) / 2)
+
+// Print adapter writing a snapshot as sys:restore commands, to paste back on a console
+class RestoreCommandPrint : public Print
+{
+  public:
+    RestoreCommandPrint(Print& out) : out(out), hex(out) {}
+
+    size_t write(uint8_t c) override
+    {
+        if (count % SNAPSHOT_LINE_BYTES == 0) {
+            if (count > 0) {
+                out.println();
+            }
+            out.print("sys:restore ");
+        }
+        count++;
+        return hex.write(c);
+    }
+    using Print::write;
+
+  private:
+    Print& out;
+    HexPrint hex;
+    size_t count = 0;
+};
 
 MainController::MainController(Configuration& config)
     : eventManager(),
@@ -7,7 +69,10 @@ MainController::MainController(Configuration& config)
       displayManager(config),
       wiFiManager(config, eventManager),
       mqttManager(config, eventManager),
-      timeManager(config, eventManager)
+      timeManager(config, eventManager),
+      telemetry(mqttManager, eventManager),
+      logShipper(mqttManager, eventManager),
+      benchmark(mqttManager, eventManager)
 #ifndef DISABLE_ESPUI
       ,
       espUIManager(config, eventManager)
@@ -23,13 +88,20 @@ void MainController::init()
 {
     delay(500);
     config.init(eventManager);
+    debugLevel = config.getPreference("debug_level", 0);
+    config.onChange("debug_level", [this](const String& key, const String& value) { debugLevel = value.toInt(); });
 
     serialCommandManager.init();
     displayManager.init();
     wiFiManager.init();
     timeManager.init();
     mqttManager.init();
-    mqttManager.addSubscription(config.getHostname() + "/cmd");
+    mqttManager.setCommandTopic("{hostname}/cmd");
+    logShipper.setTopic(mqttManager.addTopic("{hostname}/log"));
+    logShipper.configure(config.getPreference("log_interval", 2000), config.getPreference("log_rate", 30));
+    timeManager.setInterval([this]() { mqttManager.checkInflight(); }, 100);  // QoS 1 retransmit timer
+    statusTopic = mqttManager.addTopic("{hostname}/status");
+    setStatusInterval(config.getPreference("status_int", 60), false);
 #ifndef DISABLE_ESPUI
     espUIManager.init();
     wiFiManager.initEspUI();
@@ -56,6 +128,9 @@ void MainController::loop()
     serialCommandManager.loop();
     timeManager.loop();
     wiFiManager.loop();
+    telemetry.loop();
+    logShipper.loop();
+    benchmark.loop();
     if (wiFiManager.isConnected()) {
         mqttManager.loop();
         if (mqttManager.isConnected() && timeManager.isInitialized && powerSaving > 0) {
@@ -144,7 +219,7 @@ void MainController::processEvent(String type, String event, std::vector<String>
         if (event == "ap_started") {
             // ESPUI.begin();
         }
-        if (event == "disconnected" || event == "lost") {
+        if (event == "disconnected" || event == "lost" || event == "roaming") {
             mqttManager.setStatus(1);
         }
     } else if (type == "sys") {
@@ -193,6 +268,12 @@ void MainController::processEvent(String type, String event, std::vector<String>
             eventManager.debug("Connected to MQTT server: " + params[0], 1);
         } else if (event == "message") {
             processMQTT(params[0], params[1]);
+        } else if (event == "batch") {
+            if (params.size() > 1) {
+                telemetry.add(params[0], params[1]);
+            }
+        } else if (event == "@batches") {
+            eventManager.debug(telemetry.getInfos(), 0);
         }
 #ifndef DISABLE_ESPUI
     } else if (type == "espui") {
@@ -222,29 +303,7 @@ void MainController::processEvent(String type, String event, std::vector<String>
 bool MainController::processInput(const String input)
 {
     eventManager.debug("Processing input: " + input, 2);
-    if (input.length() == 0) {
-        eventManager.debug("Empty input", 1);
-        return false;
-    }
-    int nsIndex = input.indexOf(':');
-    int cmdIndex = input.indexOf(' ');
-
-    if (nsIndex == -1 || (cmdIndex != -1 && cmdIndex < nsIndex)) {
-        eventManager.debug("Erreur: Format de commande incorrect: " + input, 0);
-        return false;
-    }
-
-    // Extraction du namespace et de la commande
-    String ns = input.substring(0, nsIndex);
-    String command = cmdIndex == -1 ? input.substring(nsIndex + 1) : input.substring(nsIndex + 1, cmdIndex);
-
-    // Extraction des paramètres
-    String paramStr = cmdIndex == -1 ? "" : input.substring(cmdIndex + 1);
-    std::vector<String> params = paramStr.isEmpty() ? std::vector<String>() : splitParameters(paramStr);
-
-    //eventManager.triggerEvent("serial", "command", {input});
-    eventManager.triggerEvent(ns, "@" + command, params);
-    return true;
+    return eventManager.triggerCommand(input);
 }
 
 void MainController::processCommand(String command, std::vector<String> params)
@@ -275,7 +334,7 @@ void MainController::processCommand(String command, std::vector<String> params)
 #endif
         eventManager.debug("Reset reason: " + ESP.getResetReason(), 0);
         eventManager.debug("Hostname: " + config.getHostname(), 0);
-        eventManager.debug("Debug level: " + String(config.getPreference("debug_level", 0)), 0);
+        eventManager.debug("Debug level: " + String(debugLevel), 0);
         eventManager.debug("Power saving: " + String(wifi_get_sleep_type() == NONE_SLEEP_T ? "disabled" : "enabled"), 0);
         eventManager.debug("Power saving time: " + String(powerSaving), 0);
         eventManager.debug("Time: " + timeManager.getFormattedDateTime("%d/%m/%Y %H:%M:%S"), 0);
@@ -299,6 +358,10 @@ void MainController::processCommand(String command, std::vector<String> params)
         eventManager.debug(timeManager.getFormattedDateTime("%d/%m/%Y"), 0);
     } else if (command == "ota") {
         wiFiManager.otaUpdate();
+    } else if (command == "ota_abort") {
+        wiFiManager.otaAbort();
+    } else if (command == "ota_status") {
+        eventManager.debug(wiFiManager.getOtaInfos(), 0);
     } else if (command == "restart" || command == "reboot") {
         eventManager.debug("Restarting (command)...", 1);
         ESP.restart();
@@ -307,7 +370,6 @@ void MainController::processCommand(String command, std::vector<String> params)
             config.setPreference("debug_level", params[0].toInt());
             eventManager.debug("Debug level set to: " + params[0], 1);
         } else {
-            int debugLevel = config.getPreference("debug_level", 0);
             eventManager.debug("Debug level: " + String(debugLevel), 0);
         }
     } else if (command == "power_saving") {
@@ -330,11 +392,89 @@ void MainController::processCommand(String command, std::vector<String> params)
             eventManager.debug("Hostname: " + config.getHostname(), 0);
         }
     } else if (command == "config") {
-        if (params.size() > 0) {
+        if (params.size() > 0 && params[0].startsWith("{")) {
             config.setJsonConfig(params[0]);
             eventManager.debug("Configuration updated", 1);
         } else {
-            eventManager.debug(config.getJsonConfig(), 0);
+            // streamed to the consoles, only keys starting with the optional prefix (sys:publish config for MQTT)
+            ConsolePrint console(wiFiManager);
+            config.printJsonConfig(console, params.size() > 0 ? params[0] : "");
+            console.println();
+        }
+    } else if (command == "config_stats") {
+        eventManager.debug(config.getStorageStatsInfos(), 0);
+        if (params.size() > 0 && params[0] == "reset") {
+            config.resetStorageStats();
+        }
+    } else if (command == "snapshot") {
+        ConsolePrint console(wiFiManager);  // same sink as sys:config
+        RestoreCommandPrint restore(console);
+        config.writeSnapshot(restore);
+        console.println();
+    } else if (command == "restore") {
+        if (params.size() > 0) {
+            restoreChunk(params[0]);
+        } else if (!restoreBuffer.empty()) {
+            restoreBuffer = std::vector<uint8_t>();
+            eventManager.debug("Configuration restore cancelled", 0);
+        } else {
+            eventManager.debug("Usage: sys:restore <hex snapshot part>, as many lines as sys:snapshot prints", 0);
+        }
+    } else if (command == "log_shipping") {
+        if (params.size() > 1 && isInteger(params[0]) && isInteger(params[1])) {
+            config.setPreference("log_interval", params[0].toInt());
+            config.setPreference("log_rate", params[1].toInt());
+            logShipper.configure(params[0].toInt(), params[1].toInt());
+        } else if (params.size() > 0) {
+            eventManager.debug("Usage: sys:log_shipping <interval ms> <max batches per minute>", 0);
+        }
+        eventManager.debug(logShipper.getInfos(), 0);
+    } else if (command == "publish") {
+        // large payloads are streamed to <hostname>/<what>, without building them in memory
+        String what = params.size() > 0 ? params[0] : "";
+        bool sent = false;
+        if (what == "config") {
+            String prefix = params.size() > 1 ? params[1] : "";
+            sent = mqttManager.publishStream(config.getHostname() + "/config", [this, prefix](Print& out) { config.printJsonConfig(out, prefix); });
+        } else if (what == "devices") {
+            sent = mqttManager.publishStream(config.getHostname() + "/devices", [this](Print& out) {
+                out.print('[');
+                for (size_t i = 0; i < devices.size(); i++) {
+                    out.print(i > 0 ? ",{\"id\":" : "{\"id\":");
+                    printJsonString(out, devices[i]->id.c_str());
+                    out.print(",\"type\":");
+                    printJsonString(out, devices[i]->type.c_str());
+                    out.print(",\"name\":");
+                    printJsonString(out, devices[i]->name.c_str());
+                    out.print(",\"topic\":");
+                    printJsonString(out, devices[i]->topic.c_str());
+                    out.print('}');
+                }
+                out.print(']');
+            });
+        } else {
+            eventManager.debug("Usage: sys:publish config [prefix] | devices", 0);
+            return;
+        }
+        eventManager.debug(sent ? "Published " + what : "Failed to publish " + what, 0);
+    } else if (command == "mqtt_bench") {
+        // sys:mqtt_bench <count> <size> [handlers] [window], loopback through the broker
+        if (params.size() > 1 && isInteger(params[0]) && isInteger(params[1])) {
+            uint handlers = params.size() > 2 ? params[2].toInt() : 1;
+            uint window = params.size() > 3 ? params[3].toInt() : 8;
+            if (!benchmark.start(params[0].toInt(), params[1].toInt(), handlers, window)) {
+                eventManager.debug("Benchmark not started (already running, MQTT not connected or over the limits)", 0);
+            }
+        } else if (params.size() > 0 && params[0] == "stop") {
+            benchmark.stop();
+        } else {
+            eventManager.debug(benchmark.getInfos(), 0);
+        }
+    } else if (command == "status_interval") {
+        if (params.size() > 0 && isInteger(params[0])) {
+            setStatusInterval(params[0].toInt());
+        } else {
+            eventManager.debug("Status interval: " + String(config.getPreference("status_int", 60)) + " s (0 = disabled)", 0);
         }
     } else if (command == "ntp") {
         if (timeManager.update(true)) {
@@ -377,6 +517,7 @@ EventManager* MainController::getEventManager()
 
 void MainController::addDevice(Device* device)
 {
+    device->setMQTTManager(&mqttManager);
     devices.push_back(device);
 }
 
@@ -414,26 +555,80 @@ Device* MainController::getDeviceByTopic(const String& topic) const
 
 void MainController::processDebugMessage(String message, int level, bool displayTime)
 {
-    if (level <= config.getPreference("debug_level", 0)) {
-        String logJson;
+    if (level <= debugLevel) {
+        String time;
         if (displayTime && level > 0) {
-            String time = timeManager.getFormattedDateTime("%H:%M:%S");
-            logJson = "{\"time\":\"" + time + "\",\"level\":" + String(level) + ",\"message\":\"" + message + "\"}";
+            time = timeManager.getFormattedDateTime("%H:%M:%S");
+            logShipper.add(level, time, message);
             message = time + "> " + message;
         } else {
-            logJson = "{\"level\":" + String(level) + ",\"message\":\"" + message + "\"}";
+            logShipper.add(level, time, message);
         }
         Serial.println(message);
         wiFiManager.printTelnet(message + "\n");
 #ifndef DISABLE_ESPUI
         espUIManager.addDebugMessage(message, level);
 #endif
-        if (mqttManager.isConnected()) {
-            mqttManager.publish(config.getHostname() + "/log", logJson, false);
-        }
     }
 }
 
+void MainController::setStatusInterval(int seconds, bool save)
+{
+    if (statusTimer > 0) {
+        timeManager.clearInterval(statusTimer);
+        statusTimer = 0;
+    }
+    if (seconds > 0) {
+        statusTimer = timeManager.setInterval([this]() { publishStatus(); }, seconds * 1000UL);
+    }
+    if (save) {
+        config.setPreference("status_int", seconds);
+    }
+}
+
+// {"uptime":<s>,"wifi":{...},"mqtt":{...}}, see ConnectionStats::printJson
+void MainController::publishStatus()
+{
+    if (!mqttManager.isConnected()) {
+        return;  // the next one will be up to date
+    }
+    StreamString payload;
+    payload.print("{\"uptime\":");
+    payload.print(millis() / 1000);
+    payload.print(",\"wifi\":");
+    wiFiManager.getStats().printJson(payload);
+    payload.print(",\"mqtt\":");
+    mqttManager.getStats().printJson(payload);
+    payload.print('}');
+    mqttManager.publish(statusTopic, payload, false, true);
+}
+
+// One line of a snapshot: the configuration is restored once the length announced by the header is received
+void MainController::restoreChunk(const String& hex)
+{
+    std::vector<uint8_t> chunk = fromHex(hex);
+    if (chunk.empty()) {
+        restoreBuffer = std::vector<uint8_t>();
+        eventManager.debug("Configuration restore failed: invalid hexadecimal", 0);
+        return;
+    }
+    restoreBuffer.insert(restoreBuffer.end(), chunk.begin(), chunk.end());
+    int expected = config.getSnapshotLength(restoreBuffer.data(), restoreBuffer.size());
+    if (expected < 0) {
+        restoreBuffer = std::vector<uint8_t>();
+        eventManager.debug("Configuration restore failed: invalid header", 0);
+        return;
+    }
+    if (expected == 0 || restoreBuffer.size() < (size_t)expected) {
+        eventManager.debug("Snapshot: " + String(restoreBuffer.size()) + (expected > 0 ? "/" + String(expected) : String("")) + " bytes received", 1);
+        return;
+    }
+    // more bytes than announced: rejected by restoreSnapshot
+    bool restored = config.restoreSnapshot(restoreBuffer.data(), restoreBuffer.size());
+    restoreBuffer = std::vector<uint8_t>();
+    eventManager.debug(restored ? "Configuration restored" : "Configuration restore failed", restored ? 1 : 0);
+}
+
 void MainController::setPowerSaving(int value, bool save)
 {
     if (value < 0) {
@@ -0,0 +1,332 @@
+#include "../include/OTAPackage.h"
+
+#ifdef ESP32
+#include "../include/Tools.h"
+#include <algorithm>
+#include <mbedtls/pk.h>
+#include <mbedtls/sha256.h>
+
+static uint32_t readUint32(const uint8_t* data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+bool OTAPackageHeader::parse(const uint8_t* data)
+{
+    if (memcmp(data, OTA_PACKAGE_MAGIC, 4) != 0 || data[4] != OTA_PACKAGE_FORMAT) {
+        return false;
+    }
+    flags = data[5];
+    windowBits = data[6];
+    imageSize = readUint32(data + 8);
+    imageCrc = readUint32(data + 12);
+    sourceSize = readUint32(data + 16);
+    sourceCrc = readUint32(data + 20);
+    payloadSize = readUint32(data + 24);
+    return true;
+}
+
+bool OTAManifest::load(const uint8_t* data, size_t length, const char* publicKey)
+{
+    if (length <= OTA_MANIFEST_SIGNED_SIZE || memcmp(data, OTA_MANIFEST_MAGIC, 4) != 0 || data[4] != OTA_MANIFEST_FORMAT) {
+        error = "invalid manifest";
+        return false;
+    }
+    uint8_t digest[32];
+    mbedtls_sha256(data, OTA_MANIFEST_SIGNED_SIZE, digest, 0);
+    mbedtls_pk_context key;
+    mbedtls_pk_init(&key);
+    int ret = mbedtls_pk_parse_public_key(&key, (const unsigned char*)publicKey, strlen(publicKey) + 1);
+    if (ret == 0) {
+        ret = mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, digest, sizeof(digest), data + OTA_MANIFEST_SIGNED_SIZE, length - OTA_MANIFEST_SIGNED_SIZE);
+        error = ret == 0 ? "" : "invalid signature";
+    } else {
+        error = "invalid public key";
+    }
+    mbedtls_pk_free(&key);
+    if (ret != 0) {
+        return false;
+    }
+    imageSize = readUint32(data + 8);
+    memcpy(sha256, data + 12, sizeof(sha256));
+    return true;
+}
+
+bool OTAPackageDecoder::begin(const OTAPackageHeader& header)
+{
+    end();
+    this->header = header;
+    error = "";
+    windowPos = 0;
+    inflateDone = false;
+    inputStart = 0;
+    inputEnd = 0;
+    payloadReceived = 0;
+    pending = nullptr;
+    pendingLength = 0;
+    opLength = 0;
+    copyRemaining = 0;
+    insertRemaining = 0;
+    sourceChecked = 0;
+    sourceCrc = 0;
+    outputLength = 0;
+    produced = 0;
+    crc = 0;
+    // a delta starts by checking the running firmware, the others wait for the payload
+    starved = (header.flags & OTA_PACKAGE_DELTA) == 0;
+
+    if ((header.flags & ~(OTA_PACKAGE_COMPRESSED | OTA_PACKAGE_DELTA)) != 0) {
+        return fail("unsupported package flags " + String(header.flags));
+    }
+    if ((header.flags & OTA_PACKAGE_DELTA) && !source) {
+        return fail("no delta source");
+    }
+    input = (uint8_t*)malloc(OTA_PACKAGE_INPUT_SIZE);
+    outputBuffer = (uint8_t*)malloc(OTA_PACKAGE_OUTPUT_SIZE);
+    if (header.flags & OTA_PACKAGE_COMPRESSED) {
+        if (header.windowBits < 9 || header.windowBits > 15) {
+            end();
+            return fail("invalid window size");
+        }
+        window = (uint8_t*)malloc(1 << header.windowBits);
+        inflator = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+        if (inflator != nullptr) {
+            tinfl_init(inflator);
+        }
+    }
+    if (input == nullptr || outputBuffer == nullptr || ((header.flags & OTA_PACKAGE_COMPRESSED) && (window == nullptr || inflator == nullptr))) {
+        end();
+        return fail("out of memory");
+    }
+    return true;
+}
+
+void OTAPackageDecoder::end()
+{
+    free(inflator);
+    free(window);
+    free(input);
+    free(outputBuffer);
+    inflator = nullptr;
+    window = nullptr;
+    input = nullptr;
+    outputBuffer = nullptr;
+    pending = nullptr;
+    pendingLength = 0;
+}
+
+uint8_t* OTAPackageDecoder::getInput(size_t& space)
+{
+    if (inputStart == inputEnd) {
+        inputStart = 0;
+        inputEnd = 0;
+    } else if (inputStart > 0) {
+        memmove(input, input + inputStart, inputEnd - inputStart);
+        inputEnd -= inputStart;
+        inputStart = 0;
+    }
+    space = std::min((size_t)(OTA_PACKAGE_INPUT_SIZE - inputEnd), (size_t)(header.payloadSize - payloadReceived));
+    return input + inputEnd;
+}
+
+void OTAPackageDecoder::commitInput(size_t length)
+{
+    inputEnd += length;
+    payloadReceived += length;
+    if (length > 0) {
+        starved = false;
+    }
+}
+
+bool OTAPackageDecoder::process()
+{
+    stepBytes = 0;
+    while (stepBytes < OTA_PACKAGE_STEP_BYTES) {
+        if (sourceChecked < header.sourceSize && (header.flags & OTA_PACKAGE_DELTA)) {
+            if (!checkSource()) {
+                return false;
+            }
+        } else if (copyRemaining > 0) {
+            if (!copy()) {
+                return false;
+            }
+        } else if (pendingLength > 0) {
+            size_t used = patch(pending, pendingLength);
+            if (error.length() > 0) {
+                return false;
+            }
+            pending += used;
+            pendingLength -= used;
+        } else {
+            if (!decode()) {
+                return false;
+            }
+            if (pendingLength == 0) {
+                if (starved || isComplete()) {
+                    return true;
+                }
+                return fail("payload ended after " + String(produced) + " of " + String(header.imageSize) + " bytes");
+            }
+        }
+    }
+    return true;
+}
+
+bool OTAPackageDecoder::flush()
+{
+    if (outputLength == 0) {
+        return true;
+    }
+    if (!output(outputBuffer, outputLength)) {
+        return fail("write error at " + String(produced));
+    }
+    outputLength = 0;
+    return true;
+}
+
+bool OTAPackageDecoder::isComplete()
+{
+    return produced == header.imageSize && pendingLength == 0 && copyRemaining == 0 && insertRemaining == 0 && opLength == 0 &&
+           (inflateDone || (header.flags & OTA_PACKAGE_COMPRESSED) == 0);
+}
+
+bool OTAPackageDecoder::checkSource()
+{
+    size_t length = std::min((size_t)OTA_PACKAGE_OUTPUT_SIZE, (size_t)(header.sourceSize - sourceChecked));
+    if (!source(sourceChecked, outputBuffer, length)) {
+        return fail("source read error at " + String(sourceChecked));
+    }
+    sourceCrc = crc32(outputBuffer, length, sourceCrc);
+    sourceChecked += length;
+    stepBytes += length;
+    if (sourceChecked == header.sourceSize && sourceCrc != header.sourceCrc) {
+        return fail("the running firmware is not the delta source");
+    }
+    return true;
+}
+
+// Next decoded payload bytes into `pending`, or `starved` if more input is needed
+bool OTAPackageDecoder::decode()
+{
+    if ((header.flags & OTA_PACKAGE_COMPRESSED) == 0) {
+        if (inputStart == inputEnd) {
+            starved = payloadReceived < header.payloadSize;
+            return true;
+        }
+        pending = input + inputStart;
+        pendingLength = inputEnd - inputStart;
+        inputStart = inputEnd;
+        return true;
+    }
+    if (inflateDone) {
+        return true;
+    }
+    // the window is a circular buffer: the output of a call is applied before the next one overwrites it
+    size_t windowSize = 1 << header.windowBits;
+    size_t inSize = inputEnd - inputStart;
+    size_t outSize = windowSize - windowPos;
+    mz_uint32 flags = TINFL_FLAG_PARSE_ZLIB_HEADER | (payloadReceived < header.payloadSize ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+    tinfl_status status = tinfl_decompress(inflator, input + inputStart, &inSize, window, window + windowPos, &outSize, flags);
+    inputStart += inSize;
+    pending = window + windowPos;
+    pendingLength = outSize;
+    windowPos = (windowPos + outSize) & (windowSize - 1);
+    if (status < TINFL_STATUS_DONE) {
+        return fail("inflate error " + String(status));
+    }
+    if (status == TINFL_STATUS_DONE) {
+        inflateDone = true;
+    } else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && outSize == 0) {
+        starved = true;
+    }
+    return true;
+}
+
+// Apply decoded payload bytes, returns how many were used (stops at each COPY, output block or step end)
+size_t OTAPackageDecoder::patch(const uint8_t* data, size_t length)
+{
+    if ((header.flags & OTA_PACKAGE_DELTA) == 0) {
+        size_t count = std::min(length, (size_t)(OTA_PACKAGE_OUTPUT_SIZE - outputLength));
+        return emit(data, count) ? count : 0;
+    }
+    size_t used = 0;
+    while (used < length && copyRemaining == 0 && stepBytes < OTA_PACKAGE_STEP_BYTES) {
+        if (insertRemaining > 0) {
+            size_t count = std::min(std::min((size_t)insertRemaining, length - used), (size_t)(OTA_PACKAGE_OUTPUT_SIZE - outputLength));
+            if (!emit(data + used, count)) {
+                return used;
+            }
+            used += count;
+            insertRemaining -= count;
+            continue;
+        }
+        op[opLength++] = data[used++];
+        size_t opSize = op[0] == OTA_DELTA_COPY ? 9 : op[0] == OTA_DELTA_INSERT ? 5 : 0;
+        if (opSize == 0) {
+            fail("invalid delta operation " + String(op[0]));
+            return used;
+        }
+        if (opLength < opSize) {
+            continue;
+        }
+        opLength = 0;
+        if (op[0] == OTA_DELTA_INSERT) {
+            insertRemaining = readUint32(op + 1);
+            continue;
+        }
+        copyOffset = readUint32(op + 1);
+        copyRemaining = readUint32(op + 5);
+        if (copyRemaining > header.sourceSize || copyOffset > header.sourceSize - copyRemaining) {
+            fail("COPY outside of the source");
+            return used;
+        }
+    }
+    return used;
+}
+
+// Read the next block of the current COPY from the running firmware, straight into the output buffer
+bool OTAPackageDecoder::copy()
+{
+    size_t length = std::min((size_t)copyRemaining, (size_t)(OTA_PACKAGE_OUTPUT_SIZE - outputLength));
+    if (produced + length > header.imageSize) {
+        return fail("image larger than announced");
+    }
+    if (!source(copyOffset, outputBuffer + outputLength, length)) {
+        return fail("source read error at " + String(copyOffset));
+    }
+    crc = crc32(outputBuffer + outputLength, length, crc);
+    outputLength += length;
+    produced += length;
+    stepBytes += length;
+    copyOffset += length;
+    copyRemaining -= length;
+    return outputLength < OTA_PACKAGE_OUTPUT_SIZE || flush();
+}
+
+bool OTAPackageDecoder::emit(const uint8_t* data, size_t length)
+{
+    if (produced + length > header.imageSize) {
+        return fail("image larger than announced");
+    }
+    crc = crc32(data, length, crc);
+    produced += length;
+    stepBytes += length;
+    while (length > 0) {
+        size_t count = std::min(length, (size_t)(OTA_PACKAGE_OUTPUT_SIZE - outputLength));
+        memcpy(outputBuffer + outputLength, data, count);
+        outputLength += count;
+        data += count;
+        length -= count;
+        if (outputLength == OTA_PACKAGE_OUTPUT_SIZE && !flush()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool OTAPackageDecoder::fail(const String& error)
+{
+    this->error = error;
+    return false;
+}
+#endif
@@ -0,0 +1,511 @@
+#include "../include/OTAUpdater.h"
+#ifdef ESP32
+#include <esp_crt_bundle.h>
+#include <esp_idf_version.h>
+#endif
+
+bool OTAUpdater::start(const String& url)
+{
+    if (state == OTA_DOWNLOADING || state == OTA_DONE) {
+        eventManager->debug("OTA already running", 1);
+        return false;
+    }
+    if (backend == nullptr) {
+        eventManager->debug("OTA not supported", 1);
+        return false;
+    }
+    eventManager->debug("OTA update from " + url, 1);
+    error = "";
+    lastProgress = -1;
+    startedAt = millis();
+    duration = 0;
+    if (!backend->begin(url)) {
+        fail(backend->getError());
+        return false;
+    }
+    state = OTA_DOWNLOADING;
+    eventManager->triggerEvent("ota", "started", {String(backend->getTotal())});
+    return true;
+}
+
+void OTAUpdater::loop()
+{
+    if (state == OTA_DONE) {
+        if (millis() >= restartAt) {
+            ESP.restart();
+        }
+        return;
+    }
+    if (state != OTA_DOWNLOADING) {
+        return;
+    }
+    unsigned long loopStart = millis();
+    ota_step_result result = OTA_STEP_CONTINUE;
+    while (result == OTA_STEP_CONTINUE && millis() - loopStart < budget) {
+        result = backend->step();
+    }
+    duration = millis() - startedAt;
+    reportProgress();
+    if (result == OTA_STEP_ERROR) {
+        backend->abort();
+        fail(backend->getError());
+    } else if (result == OTA_STEP_DONE) {
+        if (!backend->finish()) {
+            fail(backend->getError());
+            return;
+        }
+        state = OTA_DONE;
+        restartAt = millis() + 1000;  // time to send the event and the logs
+        eventManager->debug("OTA update done: " + String(backend->getReceived()) + " bytes in " + String(duration / 1000) + " s (" +
+                                String(getThroughput() / 1024) + " KB/s), restarting",
+                            0);
+        eventManager->triggerEvent("ota", "done", {String(backend->getReceived()), String(duration)});
+    }
+}
+
+void OTAUpdater::abort()
+{
+    if (state != OTA_DOWNLOADING) {
+        return;
+    }
+    backend->abort();
+    state = OTA_ABORTED;
+    duration = millis() - startedAt;
+    eventManager->debug("OTA update aborted after " + String(backend->getReceived()) + " bytes", 0);
+    eventManager->triggerEvent("ota", "aborted", {String(backend->getReceived())});
+}
+
+String OTAUpdater::getInfos()
+{
+    static const char* states[] = {"idle", "downloading", "done", "failed", "aborted"};
+    String infos = "OTA: " + String(states[state]);
+    if (state == OTA_IDLE || backend == nullptr) {
+        return infos;
+    }
+    infos += ", " + String(backend->getReceived());
+    if (backend->getTotal() > 0) {
+        infos += "/" + String(backend->getTotal()) + " bytes (" + String(backend->getReceived() * 100 / backend->getTotal()) + "%)";
+    } else {
+        infos += " bytes";
+    }
+    infos += " in " + String(duration / 1000) + " s, " + String(getThroughput() / 1024) + " KB/s";
+    String backendInfos = backend->getInfos();
+    if (backendInfos.length() > 0) {
+        infos += "\n" + backendInfos;
+    }
+    if (error.length() > 0) {
+        infos += "\nError: " + error;
+    }
+    return infos;
+}
+
+void OTAUpdater::reportProgress()
+{
+    size_t received = backend->getReceived();
+    size_t total = backend->getTotal();
+    int progress = total > 0 ? (int)(received * 100 / total) / 5 * 5 : (int)(received / 65536);
+    if (progress == lastProgress) {
+        return;
+    }
+    lastProgress = progress;
+    eventManager->debug("OTA: " + String(received) + (total > 0 ? "/" + String(total) : "") + " bytes, " + String(getThroughput() / 1024) + " KB/s", 2);
+    eventManager->triggerEvent("ota", "progress", {String(total > 0 ? progress : -1), String(received), String(total)});
+}
+
+void OTAUpdater::fail(const String& error)
+{
+    state = OTA_FAILED;
+    this->error = error;
+    duration = millis() - startedAt;
+    eventManager->debug("OTA update failed: " + error, 0);
+    eventManager->triggerEvent("ota", "failed", {error});
+}
+
+uint32_t OTAUpdater::getThroughput()
+{
+    return duration > 0 && backend != nullptr ? (uint64_t)backend->getReceived() * 1000 / duration : 0;
+}
+
+#ifdef ESP32
+bool EspHttpsOTABackend::begin(const String& url)
+{
+    this->url = url;
+    error = "";
+    received = 0;
+    total = 0;
+    esp_http_client_config_t httpConfig = {};
+    httpConfig.url = this->url.c_str();
+    httpConfig.crt_bundle_attach = esp_crt_bundle_attach;
+    httpConfig.timeout_ms = OTA_CONNECT_TIMEOUT;
+    httpConfig.buffer_size = 2048;  // bytes read (and written to flash) per step
+    httpConfig.keep_alive_enable = true;
+    esp_https_ota_config_t otaConfig = {};
+    otaConfig.http_config = &httpConfig;
+    esp_err_t err = esp_https_ota_begin(&otaConfig, &handle);
+    if (err != ESP_OK) {
+        error = "begin: " + String(esp_err_to_name(err));
+        handle = nullptr;
+        return false;
+    }
+    int size = esp_https_ota_get_image_size(handle);
+    total = size > 0 ? size : 0;
+    return true;
+}
+
+ota_step_result EspHttpsOTABackend::step()
+{
+    esp_err_t err = esp_https_ota_perform(handle);
+    received = esp_https_ota_get_image_len_read(handle);
+    if (err == ESP_ERR_HTTPS_OTA_IN_PROGRESS) {
+        return OTA_STEP_CONTINUE;
+    }
+    if (err != ESP_OK) {
+        error = "download: " + String(esp_err_to_name(err));
+        return OTA_STEP_ERROR;
+    }
+    if (!esp_https_ota_is_complete_data_received(handle)) {
+        error = "incomplete image";
+        return OTA_STEP_ERROR;
+    }
+    return OTA_STEP_DONE;
+}
+
+bool EspHttpsOTABackend::finish()
+{
+    esp_err_t err = esp_https_ota_finish(handle);  // validates the image and sets the boot partition
+    handle = nullptr;
+    if (err != ESP_OK) {
+        error = "finish: " + String(esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+void EspHttpsOTABackend::abort()
+{
+    if (handle != nullptr) {
+        esp_https_ota_abort(handle);
+        handle = nullptr;
+    }
+}
+
+size_t EspHttpsOTABackend::getReceived()
+{
+    return received;
+}
+
+size_t EspHttpsOTABackend::getTotal()
+{
+    return total;
+}
+
+bool PackageOTABackend::begin(const String& url)
+{
+    abort();
+    this->url = url;
+    error = "";
+    received = 0;
+    total = 0;
+    headerLength = 0;
+    decoding = false;
+    hasManifest = false;
+    retries = 0;
+    resumes = 0;
+    if (publicKey != nullptr && !fetchManifest()) {
+        return false;
+    }
+    if (!connect(0)) {
+        close();
+        return false;
+    }
+    partition = esp_ota_get_next_update_partition(nullptr);
+    running = esp_ota_get_running_partition();
+    if (partition == nullptr || running == nullptr) {
+        error = "no OTA partition";
+        close();
+        return false;
+    }
+    // the image is hashed as it is written, no second pass over the partition
+    decoder.setOutput([this](const uint8_t* data, size_t length) {
+        mbedtls_sha256_update(&sha, data, length);
+        return esp_ota_write(handle, data, length) == ESP_OK;
+    });
+    decoder.setSource([this](uint32_t offset, uint8_t* data, size_t length) { return esp_partition_read(running, offset, data, length) == ESP_OK; });
+    return true;
+}
+
+// Small blocking request before the download: the image is not written if the manifest is invalid
+bool PackageOTABackend::fetchManifest()
+{
+    String manifestUrl = url + ".manifest";
+    esp_http_client_config_t httpConfig = {};
+    httpConfig.url = manifestUrl.c_str();
+    httpConfig.crt_bundle_attach = esp_crt_bundle_attach;
+    httpConfig.timeout_ms = OTA_CONNECT_TIMEOUT;
+    esp_http_client_handle_t manifestClient = esp_http_client_init(&httpConfig);
+    if (manifestClient == nullptr) {
+        error = "manifest: HTTP client";
+        return false;
+    }
+    uint8_t data[OTA_MANIFEST_MAX_SIZE];
+    int length = -1;
+    esp_err_t err = esp_http_client_open(manifestClient, 0);
+    if (err != ESP_OK) {
+        error = "manifest: " + String(esp_err_to_name(err));
+    } else if (esp_http_client_fetch_headers(manifestClient) < 0 || esp_http_client_get_status_code(manifestClient) != 200) {
+        error = "manifest: HTTP " + String(esp_http_client_get_status_code(manifestClient));
+    } else {
+        length = esp_http_client_read(manifestClient, (char*)data, sizeof(data));
+    }
+    esp_http_client_close(manifestClient);
+    esp_http_client_cleanup(manifestClient);
+    if (length < 0) {
+        return false;
+    }
+    if (!manifest.load(data, length, publicKey)) {
+        error = "manifest: " + manifest.error;
+        return false;
+    }
+    hasManifest = true;
+    return true;
+}
+
+// Open the download at `offset`, with a Range request when resuming
+bool PackageOTABackend::connect(size_t offset)
+{
+    close();
+    error = "";  // a failed attempt before must not fail finish()
+    esp_http_client_config_t httpConfig = {};
+    httpConfig.url = url.c_str();
+    httpConfig.crt_bundle_attach = esp_crt_bundle_attach;
+    httpConfig.timeout_ms = OTA_CONNECT_TIMEOUT;
+    httpConfig.buffer_size = 2048;
+    httpConfig.keep_alive_enable = true;
+    client = esp_http_client_init(&httpConfig);
+    if (client == nullptr) {
+        error = "begin: HTTP client";
+        return false;
+    }
+    if (offset > 0) {
+        String range = "bytes=" + String(offset) + "-";
+        esp_http_client_set_header(client, "Range", range.c_str());
+    }
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) {
+        error = "connect: " + String(esp_err_to_name(err));
+        return false;
+    }
+    int64_t length = esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
+    if (offset == 0) {
+        if (status != 200) {
+            error = "HTTP " + String(status);
+            return false;
+        }
+        total = length > 0 ? length : 0;
+    } else {
+        // 200 would be the whole file again: the server does not support ranges
+        if (status != 206) {
+            error = "resume: HTTP " + String(status);
+            return false;
+        }
+        if (total > 0 && length != (int64_t)(total - offset)) {
+            error = "resume: wrong length";
+            return false;
+        }
+        resumes++;
+    }
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+    // the connection is done, the reads must not block the loop: a read without data returns -ESP_ERR_HTTP_EAGAIN
+    esp_http_client_set_timeout_ms(client, OTA_READ_TIMEOUT);
+#endif
+    lastData = millis();
+    return true;
+}
+
+ota_step_result PackageOTABackend::retry(const String& reason)
+{
+    close();
+    if (++retries > OTA_RESUME_RETRIES) {
+        error = reason + " at " + String(received) + " bytes";
+        return OTA_STEP_ERROR;
+    }
+    reconnectAt = millis() + 1000 * retries;
+    return OTA_STEP_CONTINUE;
+}
+
+ota_step_result PackageOTABackend::step()
+{
+    if (decoding && decoder.isComplete()) {
+        return OTA_STEP_DONE;
+    }
+    if (decoding && !decoder.needsInput()) {
+        if (!decoder.process()) {
+            error = decoder.getError();
+            return OTA_STEP_ERROR;
+        }
+        return OTA_STEP_CONTINUE;
+    }
+    if (client == nullptr) {
+        if (millis() < reconnectAt) {
+            return OTA_STEP_CONTINUE;
+        }
+        return connect(received) ? OTA_STEP_CONTINUE : retry(error);
+    }
+    uint8_t* buffer = headerBuffer + headerLength;
+    size_t space = OTA_PACKAGE_HEADER_SIZE - headerLength;
+    if (decoding) {
+        buffer = decoder.getInput(space);
+    }
+    int count = esp_http_client_read(client, (char*)buffer, space);
+#ifdef ESP_ERR_HTTP_EAGAIN
+    if (count == -ESP_ERR_HTTP_EAGAIN) {
+        count = 0;  // no data within OTA_READ_TIMEOUT
+    }
+#endif
+    if (count > 0) {
+        received += count;
+        lastData = millis();
+        retries = 0;
+        if (decoding) {
+            decoder.commitInput(count);
+            return OTA_STEP_CONTINUE;
+        }
+        headerLength += count;
+        if (headerLength < OTA_PACKAGE_HEADER_SIZE) {
+            return OTA_STEP_CONTINUE;
+        }
+        return startImage() ? OTA_STEP_CONTINUE : OTA_STEP_ERROR;
+    }
+    if (count == 0 && esp_http_client_is_complete_data_received(client)) {
+        error = "incomplete image";
+        return OTA_STEP_ERROR;
+    }
+    if (count < 0 || millis() - lastData > OTA_STALL_TIMEOUT) {
+        return retry(count < 0 ? "read error" : "download stalled");
+    }
+    return OTA_STEP_CONTINUE;
+}
+
+// Called once the header is read: plain image or package, then start writing the partition
+bool PackageOTABackend::startImage()
+{
+    if (header.parse(headerBuffer)) {
+        if (total > 0 && total != OTA_PACKAGE_HEADER_SIZE + header.payloadSize) {
+            error = "wrong package size";
+            return false;
+        }
+        if (header.sourceSize > running->size) {
+            error = "delta source larger than the running partition";
+            return false;
+        }
+    } else {
+        header = OTAPackageHeader();  // plain image, its first bytes are already read
+        header.imageSize = total;
+        header.payloadSize = total;
+        if (total == 0) {
+            error = "unknown image size";
+            return false;
+        }
+    }
+    if (header.imageSize > partition->size) {
+        error = "image larger than the partition";
+        return false;
+    }
+    if (hasManifest && header.imageSize != manifest.imageSize) {
+        error = "image size does not match the manifest";
+        return false;
+    }
+    esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &handle);  // erases each sector when it is first written
+    if (err != ESP_OK) {
+        error = "begin: " + String(esp_err_to_name(err));
+        return false;
+    }
+    writing = true;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    if (!decoder.begin(header)) {
+        error = decoder.getError();
+        return false;
+    }
+    decoding = true;
+    if (header.isPlain()) {
+        size_t space;
+        memcpy(decoder.getInput(space), headerBuffer, headerLength);
+        decoder.commitInput(headerLength);
+    }
+    return true;
+}
+
+bool PackageOTABackend::finish()
+{
+    // the last partial block is only written (and hashed) by the flush
+    bool flushed = decoder.flush();
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    if (!flushed) {
+        error = decoder.getError();
+    } else if (!header.isPlain() && decoder.getCrc() != header.imageCrc) {
+        error = "image checksum mismatch";
+    } else if (hasManifest && memcmp(digest, manifest.sha256, sizeof(digest)) != 0) {
+        error = "image hash does not match the manifest";
+    }
+    decoder.end();
+    close();
+    if (error.length() > 0) {
+        esp_ota_abort(handle);
+        writing = false;
+        return false;
+    }
+    esp_err_t err = esp_ota_end(handle);  // validates the image
+    writing = false;
+    if (err != ESP_OK) {
+        error = "finish: " + String(esp_err_to_name(err));
+        return false;
+    }
+    err = esp_ota_set_boot_partition(partition);
+    if (err != ESP_OK) {
+        error = "boot partition: " + String(esp_err_to_name(err));
+        return false;
+    }
+    return true;
+}
+
+void PackageOTABackend::abort()
+{
+    decoder.end();
+    if (writing) {
+        mbedtls_sha256_free(&sha);
+        esp_ota_abort(handle);
+        writing = false;
+    }
+    close();
+}
+
+String PackageOTABackend::getInfos()
+{
+    String infos = hasManifest ? "Signed manifest" : "No manifest";
+    if (resumes > 0) {
+        infos += ", resumed " + String(resumes) + " times";
+    }
+    if (!decoding) {
+        return infos;
+    }
+    if (header.isPlain()) {
+        return infos + "\nPlain image, " + String(decoder.getProduced()) + "/" + String(header.imageSize) + " bytes written";
+    }
+    return infos + "\n" + (header.flags & OTA_PACKAGE_DELTA ? "Delta" : "Full") + " package" +
+           (header.flags & OTA_PACKAGE_COMPRESSED ? " (zlib, " + String(1 << header.windowBits) + " bytes window)" : String("")) + ", image " +
+           String(decoder.getProduced()) + "/" + String(header.imageSize) + " bytes written";
+}
+
+void PackageOTABackend::close()
+{
+    if (client != nullptr) {
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+        client = nullptr;
+    }
+}
+#endif
@@ -1,9 +1,11 @@
 #include "SerialCommandManager.h"
+#include <algorithm>
 
 EventManager* SerialCommandManager::eventManager = nullptr;
 
 void SerialCommandManager::init()
 {
+    Serial.setRxBufferSize(SERIAL_RX_BUFFER_SIZE);  // before begin() on ESP32
     Serial.begin(baudRate);
     Serial.println();
     Serial.println("SerialCommandManager initialized.");
@@ -16,35 +18,134 @@ void SerialCommandManager::loop()
 
 void SerialCommandManager::handleSerialInput()
 {
-    while (Serial.available() > 0) {
-        char receivedChar = Serial.read();
-        if (receivedChar == 13) {
-            return;
+    size_t total = 0;
+    int available;
+    // bounded: at high speed, bytes arriving while processing are left for the next loop
+    while (total < SERIAL_RX_BUFFER_SIZE && (available = Serial.available()) > 0) {
+        if (lineLength == SERIAL_LINE_SIZE) {
+            // the line fills the ring: dropped, the ring is reused until its end
+            overflow = true;
+            lineLength = 0;
         }
+        // read after the current line, up to the end of the ring or the line start
+        size_t end = (lineStart + lineLength) % SERIAL_LINE_SIZE;
+        size_t space = std::min(SERIAL_LINE_SIZE - end, SERIAL_LINE_SIZE - lineLength);
+        size_t count = Serial.readBytes(ring + end, std::min((size_t)available, space));
+        if (count == 0) {
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            processByte(end + i);
+        }
+        total += count;
+    }
+}
 
-        bool validate = receivedChar == 10;
-
-        if (inputBuffer.length() == 0) {
-            if (validate) {
-                eventManager->triggerEvent("sys", "power_saving_suspend", {"Power saving suspended"});
-                eventManager->triggerEvent("sys", "power_saving_resume", {"Power saving resumed", "60"});  // resume power saving after 60 seconds
-                return;
-            } else {
-                eventManager->triggerEvent("sys", "power_saving_suspend", {});
+// The byte at pos is not processed yet, it is after the end of the current line (or is the end)
+void SerialCommandManager::processByte(size_t pos)
+{
+    uint8_t c = ring[pos];
+    if (frameHeader > 0) {
+        frameRemaining |= (size_t)c << (frameHeader == 2 ? 0 : 8);
+        if (--frameHeader == 0) {
+            overflow = frameRemaining > SERIAL_LINE_SIZE;
+            lineStart = (pos + 1) % SERIAL_LINE_SIZE;
+            if (frameRemaining == 0) {
+                endLine();
             }
         }
+        return;
+    }
+    if (frame) {
+        append(pos);
+        if (--frameRemaining == 0) {
+            endLine();
+        }
+        return;
+    }
+    if (c == '\n' && lastCR) {
+        lastCR = false;
+        lineStart = (pos + 1) % SERIAL_LINE_SIZE;
+        return;
+    }
+    lastCR = c == '\r';
+    if (c == '\r' || c == '\n') {
+        endLine();
+        lineStart = (pos + 1) % SERIAL_LINE_SIZE;
+        return;
+    }
+    if (!lineStarted) {
+        startLine();
+        if (c == SERIAL_FRAME_START) {
+            frame = true;
+            frameHeader = 2;
+            frameRemaining = 0;
+            return;
+        }
+        lineStart = pos;
+    }
+    if (c == '\b' || c == 127) {
+        if (lineLength > 0 && !overflow) {
+            lineLength--;
+        }
+    } else {
+        append(pos);
+    }
+}
+
+// Move the byte at pos to the end of the line (it is already there unless bytes were removed)
+void SerialCommandManager::append(size_t pos)
+{
+    if (overflow) {
+        return;
+    }
+    size_t end = (lineStart + lineLength) % SERIAL_LINE_SIZE;
+    if (end != pos) {
+        ring[end] = ring[pos];
+    }
+    lineLength++;
+}
 
-        if (validate) {
-            inputBuffer.trim();
-            eventManager->triggerEvent("serial", "input", {inputBuffer});
-            inputBuffer = "";
-            eventManager->triggerEvent("sys", "power_saving_resume", {"", "60"});
-        } else if (receivedChar == '\b' || receivedChar == 127) {
-            if (inputBuffer.length() > 0) {
-                inputBuffer.remove(inputBuffer.length() - 1);
+void SerialCommandManager::startLine()
+{
+    lineStarted = true;
+    eventManager->triggerEvent("sys", "power_saving_suspend", {});
+}
+
+void SerialCommandManager::endLine()
+{
+    if (!lineStarted) {
+        // empty line: wake up
+        eventManager->triggerEvent("sys", "power_saving_suspend", {"Power saving suspended"});
+        eventManager->triggerEvent("sys", "power_saving_resume", {"Power saving resumed", "60"});  // resume power saving after 60 seconds
+        return;
+    }
+    if (overflow) {
+        eventManager->debug("Serial " + String(frame ? "frame" : "line") + " longer than " + String(SERIAL_LINE_SIZE) + " bytes dropped", 1);
+    } else {
+        size_t start = lineStart;
+        size_t length = lineLength;
+        if (!frame) {
+            while (length > 0 && isspace(ring[start])) {
+                start = (start + 1) % SERIAL_LINE_SIZE;
+                length--;
+            }
+            while (length > 0 && isspace(ring[(start + length - 1) % SERIAL_LINE_SIZE])) {
+                length--;
             }
-        } else {
-            inputBuffer += receivedChar;
         }
+        // the line may wrap around the end of the ring
+        size_t first = std::min(length, SERIAL_LINE_SIZE - start);
+        String input;
+        input.reserve(length);
+        input.concat((const char*)ring + start, first);
+        input.concat((const char*)ring, length - first);
+        eventManager->triggerEvent("serial", "input", {input});
     }
-}
\ No newline at end of file
+    lineStart = (lineStart + lineLength) % SERIAL_LINE_SIZE;
+    lineLength = 0;
+    lineStarted = false;
+    overflow = false;
+    frame = false;
+    eventManager->triggerEvent("sys", "power_saving_resume", {"", "60"});
+}
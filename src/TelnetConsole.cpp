@@ -0,0 +1,223 @@
+#include "../include/TelnetConsole.h"
+#ifdef ESP32
+#include <lwip/sockets.h>
+#endif
+
+bool TelnetConsole::begin(uint16_t port)
+{
+    if (server != nullptr) {
+        return true;
+    }
+    this->port = port;
+    server = new WiFiServer(port);
+    server->begin();
+    server->setNoDelay(true);
+    return true;
+}
+
+void TelnetConsole::stop()
+{
+    for (uint i = 0; i < TELNET_MAX_CLIENTS; i++) {
+        if (clients[i].active) {
+            close(clients[i], i);
+        }
+    }
+    if (server != nullptr) {
+        server->stop();
+        delete server;
+        server = nullptr;
+    }
+}
+
+void TelnetConsole::loop()
+{
+    if (server == nullptr) {
+        return;
+    }
+    if (server->hasClient()) {
+        accept();
+    }
+    for (uint i = 0; i < TELNET_MAX_CLIENTS; i++) {
+        Client& client = clients[i];
+        if (!client.active) {
+            continue;
+        }
+        if (!client.client.connected()) {
+            close(client, i);
+            continue;
+        }
+        readInput(client, i);
+        drain(client);
+    }
+}
+
+size_t TelnetConsole::print(const String& text)
+{
+    return write((const uint8_t*)text.c_str(), text.length());
+}
+
+size_t TelnetConsole::write(const uint8_t* data, size_t length)
+{
+    for (auto& client : clients) {
+        if (!client.active) {
+            continue;
+        }
+        if (client.output.available() < length && dropPolicy == TELNET_DROP_NEWEST) {
+            client.dropped += length;
+            continue;
+        }
+        if (client.output.available() < length) {
+            // whole lines, so that the client does not get a cut line
+            while (!client.output.empty() && client.output.available() < length) {
+                int end = client.output.indexOf('\n');
+                size_t lineLength = end < 0 ? client.output.size() : end + 1;
+                client.output.consume(lineLength);
+                client.dropped += lineLength;
+            }
+        }
+        if (client.output.empty()) {
+            client.pendingSince = millis();
+        }
+        size_t written = client.output.write(data, length);
+        client.dropped += length - written;
+    }
+    return length;
+}
+
+bool TelnetConsole::isConnected()
+{
+    return getClientCount() > 0;
+}
+
+uint TelnetConsole::getClientCount()
+{
+    uint count = 0;
+    for (const auto& client : clients) {
+        count += client.active ? 1 : 0;
+    }
+    return count;
+}
+
+String TelnetConsole::getInfos()
+{
+    String infos = "Telnet: port " + String(port) + (server != nullptr ? "" : " (stopped)") + ", " + String(getClientCount()) + "/" +
+                   String(TELNET_MAX_CLIENTS) + " clients, drop " + (dropPolicy == TELNET_DROP_OLDEST ? "oldest" : "newest");
+    for (uint i = 0; i < TELNET_MAX_CLIENTS; i++) {
+        Client& client = clients[i];
+        if (client.active) {
+            infos += "\n#" + String(i) + " " + client.client.remoteIP().toString() + ": " + String(client.output.size()) +
+                     " bytes pending, " + String(client.sent) + " sent in " + String(client.segments) + " segments, " + String(client.dropped) + " dropped";
+        }
+    }
+    return infos;
+}
+
+void TelnetConsole::accept()
+{
+    WiFiClient incoming = server->accept();
+    for (uint i = 0; i < TELNET_MAX_CLIENTS; i++) {
+        Client& client = clients[i];
+        if (!client.active) {
+            client.client = incoming;
+            client.client.setNoDelay(true);  // segments are batched here
+            client.active = true;
+            client.output.clear();
+            client.input = "";
+            client.overflow = false;
+            client.skip = 0;
+            client.sent = 0;
+            client.segments = 0;
+            client.dropped = 0;
+            String ip = client.client.remoteIP().toString();
+            eventManager->debug("Telnet client #" + String(i) + " connected: " + ip, 2);
+            eventManager->triggerEvent("telnet", "connected", {ip});
+            return;
+        }
+    }
+    incoming.print("Too many telnet clients\r\n");
+    incoming.stop();
+}
+
+void TelnetConsole::readInput(Client& client, uint index)
+{
+    while (client.client.available() > 0) {
+        int c = client.client.read();
+        if (c < 0) {
+            break;
+        }
+        if (client.skip > 0) {
+            client.skip--;
+        } else if (c == 0xFF) {
+            client.skip = 2;  // IAC <command> <option>
+        } else if (c == '\n') {
+            String line = client.input;
+            client.input = "";
+            if (client.overflow) {
+                client.overflow = false;
+                String error = "Line longer than " + String(MAX_INPUT) + " bytes rejected\r\n";
+                client.output.write((const uint8_t*)error.c_str(), error.length());  // to this client only
+                eventManager->debug("Telnet client #" + String(index) + ": line longer than " + String(MAX_INPUT) + " bytes rejected", 1);
+                continue;
+            }
+            eventManager->debug("Telnet input received: " + line, 2);
+            eventManager->triggerEvent("telnet", "input", {line});
+        } else if (c != '\r' && c != 0 && !client.overflow) {
+            if (client.input.length() < MAX_INPUT) {
+                client.input += (char)c;
+            } else {
+                client.overflow = true;
+                client.input = "";  // the memory is freed at once
+            }
+        }
+    }
+}
+
+void TelnetConsole::drain(Client& client)
+{
+    // wait for a full segment, or for the flush delay
+    while (!client.output.empty()) {
+        if (client.output.size() < SEGMENT_SIZE && millis() - client.pendingSince < FLUSH_DELAY) {
+            return;
+        }
+        const uint8_t* data;
+        size_t length = client.output.peek(data);
+        if (length > SEGMENT_SIZE) {
+            length = SEGMENT_SIZE;
+        }
+        int sent = sendNonBlocking(client, data, length);
+        if (sent <= 0) {
+            return;  // TCP window full (or client lost), retried on the next loop
+        }
+        client.output.consume(sent);
+        client.sent += sent;
+        client.segments++;
+        client.pendingSince = millis();
+    }
+}
+
+// Bytes accepted by the TCP stack, 0 if it would block, -1 on error
+int TelnetConsole::sendNonBlocking(Client& client, const uint8_t* data, size_t length)
+{
+#ifdef ESP32
+    int sent = send(client.client.fd(), data, length, MSG_DONTWAIT);
+    if (sent < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    return sent;
+#else
+    size_t room = client.client.availableForWrite();
+    if (room == 0) {
+        return 0;
+    }
+    return client.client.write(data, length < room ? length : room);
+#endif
+}
+
+void TelnetConsole::close(Client& client, uint index)
+{
+    client.client.stop();
+    client.active = false;
+    client.output.clear();
+    eventManager->debug("Telnet client #" + String(index) + " disconnected", 2);
+    eventManager->triggerEvent("telnet", "disconnected", {});
+}
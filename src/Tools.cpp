@@ -74,4 +74,129 @@ std::vector<String> splitParameters(const String& paramStr)
     }
 
     return params;
-}
\ No newline at end of file
+}
+
+String bytesToString(const uint8_t* data, size_t length)
+{
+    String str;
+    str.reserve(length);  // Réserver de l'espace pour éviter les reallocations
+    str.concat((const char*)data, length);  // une seule copie
+    return str;
+}
+
+size_t printJsonString(Print& out, const char* str)
+{
+    size_t written = out.print('"');
+    for (const char* p = str; *p != '\0'; ++p) {
+        char c = *p;
+        if (c == '"' || c == '\\') {
+            written += out.print('\\');
+            written += out.print(c);
+        } else if (c == '\n') {
+            written += out.print("\\n");
+        } else if (c == '\r') {
+            written += out.print("\\r");
+        } else if (c == '\t') {
+            written += out.print("\\t");
+        } else if ((uint8_t)c < 0x20) {
+            char escaped[7];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (uint8_t)c);
+            written += out.print(escaped);
+        } else {
+            written += out.print(c);
+        }
+    }
+    written += out.print('"');
+    return written;
+}
+
+bool isJsonNumber(const String& str)
+{
+    const char* p = str.c_str();
+    if (*p == '-') {
+        p++;
+    }
+    if (*p == '0') {
+        p++;
+    } else if (isdigit((unsigned char)*p)) {
+        while (isdigit((unsigned char)*p)) {
+            p++;
+        }
+    } else {
+        return false;
+    }
+    if (*p == '.') {
+        p++;
+        if (!isdigit((unsigned char)*p)) {
+            return false;
+        }
+        while (isdigit((unsigned char)*p)) {
+            p++;
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') {
+            p++;
+        }
+        if (!isdigit((unsigned char)*p)) {
+            return false;
+        }
+        while (isdigit((unsigned char)*p)) {
+            p++;
+        }
+    }
+    return p == str.c_str() + str.length();
+}
+
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+std::vector<uint8_t> fromHex(const String& hex)
+{
+    std::vector<uint8_t> data;
+    if (hex.length() % 2 != 0) {
+        return data;
+    }
+    data.reserve(hex.length() / 2);
+    for (unsigned int i = 0; i < hex.length(); i += 2) {
+        int high = hexValue(hex[i]);
+        int low = hexValue(hex[i + 1]);
+        if (high < 0 || low < 0) {
+            return std::vector<uint8_t>();
+        }
+        data.push_back((high << 4) | low);
+    }
+    return data;
+}
+
+size_t HexPrint::write(uint8_t c)
+{
+    static const char digits[] = "0123456789abcdef";
+    out.print(digits[c >> 4]);
+    out.print(digits[c & 0x0F]);
+    return 1;
+}
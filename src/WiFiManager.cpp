@@ -1,4 +1,14 @@
 #include "../include/WiFiManager.h"
+#include <StreamString.h>
+#include <algorithm>
+
+#ifdef ESP8266
+// same disconnection reason codes as ESP32
+#define WIFI_REASON_AUTH_FAIL WIFI_DISCONNECT_REASON_AUTH_FAIL
+#define WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT WIFI_DISCONNECT_REASON_4WAY_HANDSHAKE_TIMEOUT
+#define WIFI_REASON_HANDSHAKE_TIMEOUT WIFI_DISCONNECT_REASON_HANDSHAKE_TIMEOUT
+#define WIFI_REASON_ASSOC_LEAVE WIFI_DISCONNECT_REASON_ASSOC_LEAVE
+#endif
 
 EventManager* WiFiManager::eventManager = nullptr;
 
@@ -7,7 +17,26 @@ void WiFiManager::init(bool auto_connect)
     eventManager->debug("Init WiFiManager", 1);
     retrieveSSID();
     retrievePassword();
+    config.removeOnChange(configObserver);  // init() may be called again
+    configObserver = config.onChange("wf_*", [this](const String& key, const String& value) {
+        if (key == "wf_ssid") {
+            ssid = value;
+        } else if (key == "wf_pass") {
+            password = value;
+        }
+        if (key.startsWith("wf_ssid") || key.startsWith("wf_pass")) {
+            loadProfiles();
+            if (fastChannel > 0 && findProfile(fastSSID) == nullptr) {
+                clearFastConnect();  // cached for a removed network
+            }
+        }
+    });
     apMode = static_cast<wm_ap_mode>(config.getPreference("ap_mode", 2));
+    loadProfiles();
+    loadFastConnect();
+    registerWiFiEvents();
+    roamThreshold = config.getPreference("wf_roam", roamThreshold);
+    roamHysteresis = config.getPreference("wf_roam_hyst", (int)roamHysteresis);
     if (auto_connect) {
         this->autoConnect();
     }
@@ -16,79 +45,139 @@ void WiFiManager::init(bool auto_connect)
 void WiFiManager::loop()
 {
     telnet.loop();
-
-    static unsigned long lastMillis = 0;
-    unsigned long currentMillis = millis();
+    ota.loop();
+    if (scanning) {
+        checkScan();
+    }
 
     if (connectionStatus == 0) {
         this->connect();
-        lastMillis = currentMillis;
-        connectionStatus = 1;
-    }
-
-    unsigned long wait = (tryCount + 1) * checkDelay;
-
-    if (currentMillis - lastMillis >= wait) {
-        if (connectionStatus < 10) {
-            //Serial.println(WiFi.status());
-            if (WiFi.status() != WL_CONNECTED) {
-                this->connected = false;
-                if (WiFi.status() == WL_WRONG_PASSWORD) {
-                    if (connectionStatus != 6) {
-                        connectionStatus = 6;
-                        eventManager->debug("WiFi: Wrong password", 0);
-                        eventManager->triggerEvent("wifi", "wrong_password", {});
-                        this->startAccessPoint();
-                    }
-                }
-                tryCount++;
-                std::vector<String> params;
-                params.push_back(String(tryCount));
-                eventManager->triggerEvent("wifi", "in_progress", params);
-                if (tryCount >= 20) {
-                    tryCount = 0;
-                    if (keepConnected) {
-                        eventManager->debug("WiFi: Connection failed, retrying", 1);
-                    } else {
-                        if (connectionStatus != 6) {
-                            connectionStatus = 2;
-                            eventManager->debug("WiFi: Connection failed", 1);
-                            eventManager->triggerEvent("wifi", "failed", params);
-                            // if wifi mode is AP, restart AP
-                            this->startAccessPoint();
-                        }
-                    }
-                } else {
-                    //Serial.print("*");
-                }
-                eventManager->debug("WiFi: connection in progress #" + String(tryCount) + "...", 2);
-            } else {
-                connected = true;
-                keepConnected = true;
-                connectionStatus = 10;
-                tryCount = 0;
-                std::vector<String> params;
-                params.push_back(WiFi.SSID());
-                params.push_back(WiFi.localIP().toString());
-                eventManager->triggerEvent("wifi", "connected", params);
-            }
-        } else if (connectionStatus == 10)  // Connected
-        {
-            if (WiFi.status() != WL_CONNECTED) {
-                connectionStatus = 3;
-                this->connected = false;
-                eventManager->debug("WiFi: Connection lost", 1);
-                eventManager->triggerEvent("wifi", "lost", {});
-            }
-        } else if (connectionStatus == 3)  // Connection lost
-        {
-            if (WiFi.status() == WL_CONNECTED) {
-                connectionStatus = 10;
-                this->connected = true;
-                eventManager->triggerEvent("wifi", "recovered", {});
+    }
+
+    // link changes are reported by the driver callbacks, no status polling
+    uint32_t events = pendingEvents.exchange(0);
+    if (events != 0) {
+        processWiFiEvents(events);
+    }
+
+    if (connectionStatus == 10) {
+        monitorLink();
+    } else if (connectionStatus == 1 || connectionStatus == 2 || connectionStatus == 3 || connectionStatus == 6) {
+        checkAttempt();
+    }
+}
+
+void WiFiManager::registerWiFiEvents()
+{
+    unregisterWiFiEvents();  // init() may be called again
+    // called from the WiFi driver context: only record the event, processed by loop()
+#ifdef ESP32
+    wifiEventId = WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) {
+        if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+            pendingEvents.fetch_or(WM_EVENT_GOT_IP);
+        } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED) {
+            disconnectReason = info.wifi_sta_disconnected.reason;
+            pendingEvents.fetch_or(WM_EVENT_DISCONNECTED);
+        } else if (event == ARDUINO_EVENT_WIFI_STA_LOST_IP) {
+            pendingEvents.fetch_or(WM_EVENT_LOST_IP);
+        }
+    });
+#else
+    gotIPHandler = WiFi.onStationModeGotIP([this](const WiFiEventStationModeGotIP& event) { pendingEvents.fetch_or(WM_EVENT_GOT_IP); });
+    disconnectedHandler = WiFi.onStationModeDisconnected([this](const WiFiEventStationModeDisconnected& event) {
+        disconnectReason = event.reason;
+        pendingEvents.fetch_or(WM_EVENT_DISCONNECTED);
+    });
+#endif
+}
+
+void WiFiManager::unregisterWiFiEvents()
+{
+#ifdef ESP32
+    if (wifiEventId != 0) {
+        WiFi.removeEvent(wifiEventId);
+        wifiEventId = 0;
+    }
+#else
+    gotIPHandler = nullptr;
+    disconnectedHandler = nullptr;
+#endif
+}
+
+void WiFiManager::processWiFiEvents(uint32_t events)
+{
+    // a disconnection followed by a new IP in the same batch ends connected
+    if (events & (WM_EVENT_DISCONNECTED | WM_EVENT_LOST_IP)) {
+        uint8_t reason = disconnectReason;
+        if (connectionStatus == 10) {
+            connectionStatus = 3;
+            this->connected = false;
+            connectStart = millis();  // outage start, see checkAttempt
+            stats.disconnected(reason);
+            eventManager->debug("WiFi: Connection lost (reason " + String(reason) + ")", 1);
+            eventManager->triggerEvent("wifi", "lost", {String(reason)});
+        } else if (connectionStatus == 1) {
+            if (reason == WIFI_REASON_AUTH_FAIL || reason == WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT || reason == WIFI_REASON_HANDSHAKE_TIMEOUT) {
+                connectionStatus = 6;
+                eventManager->debug("WiFi: Wrong password", 0);
+                eventManager->triggerEvent("wifi", "wrong_password", {});
+                this->startAccessPoint();
+            } else if (fastAttempt && reason != WIFI_REASON_ASSOC_LEAVE) {  // not our own disconnection (new attempt, roaming)
+                fallbackFullConnect();  // AP moved or not found
             }
         }
-        lastMillis = currentMillis;
+    }
+    if ((events & WM_EVENT_GOT_IP) && connectionStatus != 10 && connectionStatus != 4) {
+        bool recovered = connectionStatus == 3;
+        connected = true;
+        keepConnected = true;
+        connectionStatus = 10;
+        tryCount = 0;
+        onConnected();
+        eventManager->triggerEvent("wifi", recovered ? "recovered" : "connected", {WiFi.SSID(), WiFi.localIP().toString()});
+    }
+}
+
+// Timeouts of the current attempt, or of the outage after a connection loss.
+// A wrong password is retried (or the next network tried) once the attempt times out
+void WiFiManager::checkAttempt()
+{
+    unsigned long elapsed = millis() - connectStart;
+    if ((connectionStatus == 1 || connectionStatus == 2) && fastAttempt && elapsed >= FAST_CONNECT_TIMEOUT) {
+        fallbackFullConnect();
+    }
+    if (elapsed < CONNECTION_TIMEOUT) {
+        return;
+    }
+    if (connectionStatus == 3) {
+        // not recovered by the driver auto-reconnect: new attempt (fast path, other networks)
+        eventManager->debug("WiFi: Connection not recovered, reconnecting", 1);
+        connect();
+        return;
+    }
+    tryCount++;
+    stats.attemptFailed();
+    eventManager->triggerEvent("wifi", "in_progress", {String(tryCount)});
+    if (keepConnected || connectionStatus == 6) {
+        eventManager->debug("WiFi: Connection failed, retrying", 1);
+    } else if (connectionStatus != 2) {
+        connectionStatus = 2;
+        eventManager->debug("WiFi: Connection failed", 1);
+        eventManager->triggerEvent("wifi", "failed", {String(tryCount)});
+        // if wifi mode is AP, restart AP
+        this->startAccessPoint();
+    }
+    // next stored network
+    size_t next = 0;
+    for (size_t i = 0; i < profiles.size(); i++) {
+        if (profiles[i].ssid == activeSSID) {
+            next = (i + 1) % profiles.size();
+        }
+    }
+    uint status = connectionStatus;
+    connectTo(profiles[next], nullptr);
+    if (status == 2 || status == 6) {
+        connectionStatus = status;  // keep reporting the failure while retrying
     }
 }
 
@@ -116,13 +205,13 @@ bool WiFiManager::processCommand(String command, std::vector<String> params)
         if (params.size() > 0) {
             this->saveSSID(params[0]);
         } else {
-            eventManager->debug("SSID: " + retrieveSSID(), 0);
+            eventManager->debug("SSID: " + ssid, 0);
         }
     } else if (command == "pass") {
         if (params.size() > 0) {
             this->savePassword(params[0]);
         } else {
-            eventManager->debug("Password: " + retrievePassword(), 0);
+            eventManager->debug("Password: " + password, 0);
         }
     } else if (command == "reset") {
         this->saveSSID("");
@@ -145,12 +234,59 @@ bool WiFiManager::processCommand(String command, std::vector<String> params)
             eventManager->debug("Keep connection: OFF", 0);
         }
     } else if (command == "scan") {
-        uint16_t count = getNetworkCount();
-        eventManager->debug("Networks found: " + String(count), 0);
-        for (int i = 0; i < count; i++) {
-            eventManager->debug(String(i) + ": " + getNetworkInfo(i, "ssid"), 0);
+        // results printed when the scan is done
+        if (scanNetworks(params.size() > 0 && params[0] == "hidden")) {
+            scanReport = true;
+            eventManager->debug("WiFi scan started", 0);
+        } else {
+            eventManager->debug("WiFi scan already running", 0);
         }
-        eventManager->debug("wifi:network <n> to set network", 0);
+    } else if (command == "networks") {
+        eventManager->debug(String(networks.size()) + " networks, scanned " + String(getScanAge() / 1000) + " s ago", 0);
+        for (size_t i = 0; i < networks.size(); i++) {
+            eventManager->debug(String(i) + ": " + getNetworkInfo(i, "ssid") + " (" + getNetworkInfo(i, "rssi") + " dBm, channel " +
+                                    getNetworkInfo(i, "channel") + ")",
+                                0);
+        }
+    } else if (command == "profile") {
+        // wifi:profile add <ssid> <password> | remove <ssid>
+        if (params.size() > 1 && params[0] == "add") {
+            addProfile(params[1], params.size() > 2 ? params[2] : "");
+        } else if (params.size() > 1 && params[0] == "remove") {
+            if (!removeProfile(params[1])) {
+                eventManager->debug("Unknown network: " + params[1], 0);
+            }
+        }
+        for (const auto& profile : profiles) {
+            eventManager->debug(String(profile.slot) + ": " + profile.ssid + (profile.ssid == activeSSID ? " (active)" : ""), 0);
+        }
+    } else if (command == "roam") {
+        // wifi:roam [<threshold dBm, 0 = off> [<hysteresis dB>]]
+        if (params.size() > 0) {
+            setRoaming(params[0].toInt(), params.size() > 1 ? params[1].toInt() : roamHysteresis);
+        }
+        eventManager->debug(getLinkInfos(), 0);
+    } else if (command == "telnet") {
+        // wifi:telnet [oldest|newest]: drop policy when a client buffer is full
+        if (params.size() > 0 && (params[0] == "oldest" || params[0] == "newest")) {
+            telnet_drop_policy policy = params[0] == "oldest" ? TELNET_DROP_OLDEST : TELNET_DROP_NEWEST;
+            telnet.setDropPolicy(policy);
+            config.setPreference("telnet_drop", (int)policy);
+        }
+        eventManager->debug(telnet.getInfos(), 0);
+    } else if (command == "stats") {
+        eventManager->debug(stats.getInfos(), 0);
+        if (params.size() > 0 && params[0] == "reset") {
+            stats.reset();
+        }
+    } else if (command == "fast") {
+        // wifi:fast [ip on|off | clear]
+        if (params.size() > 1 && params[0] == "ip") {
+            setFastIP(params[1] == "on" || params[1] == "1");
+        } else if (params.size() > 0 && params[0] == "clear") {
+            clearFastConnect();
+        }
+        eventManager->debug(getConnectInfos(), 0);
     } else if (command == "network") {
         if (params.size() > 0) {
             this->setNetwork(params[0].toInt(), true);
@@ -185,7 +321,7 @@ bool WiFiManager::autoConnect()
 bool WiFiManager::connect()
 {
     connectionStatus = 1;
-    eventManager->debug("Connecting to: " + this->ssid + "...", 0);
+    eventManager->debug("Connecting to: " + this->ssid + (profiles.size() > 1 ? " (+" + String(profiles.size() - 1) + " networks)" : "") + "...", 0);
 
     WiFiMode_t mode = WIFI_STA;
     if (apMode == WM_AP_MODE_ALWAYS) {
@@ -195,22 +331,59 @@ bool WiFiManager::connect()
         WiFi.mode(mode);
     }
 
-    WiFi.begin(this->ssid.c_str(), this->password.c_str());
-    delay(100);
+    // strongest known network of a recent scan, else the cached connection, else the main network
+    const WiFiNetwork* target = bestKnownNetwork();
+    const WiFiProfile* profile = target != nullptr ? findProfile(target->ssid) : nullptr;
+    if (profile == nullptr && fastChannel > 0) {
+        profile = findProfile(fastSSID);
+    }
+    if (profile == nullptr) {
+        profile = &profiles[0];
+    }
+    return connectTo(*profile, target);
+}
 
-    if (WiFi.status() == WL_CONNECTED) {
-        this->connected = true;
-        connectionStatus = 10;
-        return true;
+bool WiFiManager::connectTo(const WiFiProfile& profile, const WiFiNetwork* target)
+{
+    connectionStatus = 1;
+    activeSSID = profile.ssid;
+    connectStart = millis();
+    // hint from the scan, or from the cache if it is the same network
+    int32_t channel = 0;
+    const uint8_t* bssid = nullptr;
+    bool useLease = false;
+    if (target != nullptr) {
+        channel = target->channel;
+        bssid = target->bssid;
+        useLease = fastIP && fastChannel > 0 && memcmp(target->bssid, fastBssid, sizeof(fastBssid)) == 0;
+    } else if (fastChannel > 0 && fastSSID == profile.ssid) {
+        channel = fastChannel;
+        bssid = fastBssid;
+        useLease = fastIP;
+    }
+    fastAttempt = channel > 0;
+    // the cached lease only belongs to the cached BSSID, anything else uses DHCP
+    if (useLease) {
+        WiFi.config(fastLocalIP, fastGateway, fastSubnet, fastDns);
     } else {
-        return false;
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    }
+    if (fastAttempt) {
+        eventManager->debug("WiFi fast connect to " + profile.ssid + ": channel " + String(channel) + (useLease ? ", IP " + fastLocalIP.toString() : ""), 2);
+        WiFi.begin(profile.ssid.c_str(), profile.password.c_str(), channel, bssid);
+    } else {
+        WiFi.begin(profile.ssid.c_str(), profile.password.c_str());
     }
+    return true;  // completed by the WM_EVENT_GOT_IP event
 }
 
 void WiFiManager::disconnect()
 {
     WiFi.disconnect();
     this->connected = false;
+    if (connectionStatus == 10) {
+        stats.disconnected(WIFI_REASON_ASSOC_LEAVE);
+    }
     connectionStatus = 4;
     eventManager->triggerEvent("wifi", "disconnected", {});
 }
@@ -239,36 +412,15 @@ void WiFiManager::startAccessPoint(bool restart)
     eventManager->triggerEvent("wifi", "ap_started", {});
 }
 
-void WiFiManager::setupTelnet() {  
-  // passing on functions for various telnet events
-  telnet.onConnect([this](const String& str) {
-    eventManager->debug("Telnet connected", 2);
-    eventManager->triggerEvent("telnet", "connected", {});
-  });
-
-  telnet.onConnectionAttempt([this](const String& str) {
-    eventManager->debug("Telnet connection attempt", 2);
-    eventManager->triggerEvent("telnet", "connection_attempt", {str});
-  });
-  telnet.onReconnect([this](const String& str) {
-    eventManager->debug("Telnet reconnected", 2);
-    eventManager->triggerEvent("telnet", "reconnected", {});
-  });
-  telnet.onDisconnect([this](const String& str) {
-    eventManager->debug("Telnet disconnected", 2);
-    eventManager->triggerEvent("telnet", "disconnected", {});
-  });
-  telnet.onInputReceived([this](const String& str) {
-    eventManager->debug("Telnet input received: " + str, 2);
-    eventManager->triggerEvent("telnet", "input", {str});
-  });
-
-  if (telnet.begin(telnetPort)) {
-    eventManager->debug("Telnet server started on port " + String(telnetPort), 1);
-    eventManager->triggerEvent("telnet", "started", {String(telnetPort)});
-  } else {
-    eventManager->debug("Telnet server could not start", 1);
-  }
+void WiFiManager::setupTelnet()
+{
+    telnet.setDropPolicy(static_cast<telnet_drop_policy>(config.getPreference("telnet_drop", 0)));
+    if (telnet.begin(telnetPort)) {
+        eventManager->debug("Telnet server started on port " + String(telnetPort), 1);
+        eventManager->triggerEvent("telnet", "started", {String(telnetPort)});
+    } else {
+        eventManager->debug("Telnet server could not start", 1);
+    }
 }
 
 void WiFiManager::stopTelnet()
@@ -283,7 +435,14 @@ void WiFiManager::printTelnet(String message)
     if (!telnet.isConnected()) {
         return;
     }
-    telnet.print(message);
+    telnet.print(message);  // buffered, sent by loop()
+}
+
+void WiFiManager::writeTelnet(const uint8_t* data, size_t length)
+{
+    if (telnet.isConnected()) {
+        telnet.write(data, length);
+    }
 }
 
 void WiFiManager::stopAccessPoint()
@@ -326,9 +485,279 @@ void WiFiManager::savePassword(String password, bool reconnect)
     }
 }
 
+void WiFiManager::loadFastConnect()
+{
+    fastIP = config.getPreference("wf_fast_ip", 0) == 1;
+    std::vector<uint8_t> bssid = fromHex(config.getPreference("wf_bssid", ""));
+    int32_t channel = config.getPreference("wf_chan", 0);
+    fastSSID = config.getPreference("wf_fssid", ssid);
+    fastChannel = 0;
+    if (bssid.size() == sizeof(fastBssid) && channel > 0) {
+        memcpy(fastBssid, bssid.data(), sizeof(fastBssid));
+        fastChannel = channel;
+    }
+    // "<ip>,<gateway>,<subnet>,<dns>"
+    String lease = config.getPreference("wf_lease", "");
+    if (!fastLocalIP.fromString(splitString(lease, ',', 0)) || !fastGateway.fromString(splitString(lease, ',', 1)) ||
+        !fastSubnet.fromString(splitString(lease, ',', 2)) || !fastDns.fromString(splitString(lease, ',', 3))) {
+        fastIP = false;
+    }
+}
+
+void WiFiManager::saveFastConnect()
+{
+    // one commit for all the values (a whole EEPROM sector on ESP8266), none on usual reconnects as nothing changed
+    const uint8_t* current = WiFi.BSSID();
+    if (current == nullptr) {
+        return;
+    }
+    memcpy(fastBssid, current, sizeof(fastBssid));
+    StreamString bssid;
+    HexPrint hex(bssid);
+    hex.write(fastBssid, sizeof(fastBssid));
+    fastChannel = WiFi.channel();
+    fastSSID = WiFi.SSID();
+    fastLocalIP = WiFi.localIP();
+    fastGateway = WiFi.gatewayIP();
+    fastSubnet = WiFi.subnetMask();
+    fastDns = WiFi.dnsIP();
+    JsonDocument values;
+    values["wf_bssid"] = bssid;
+    values["wf_chan"] = (int)fastChannel;
+    values["wf_fssid"] = fastSSID;
+    values["wf_lease"] = fastLocalIP.toString() + "," + fastGateway.toString() + "," + fastSubnet.toString() + "," + fastDns.toString();
+    config.setPreferences(values);
+}
+
+void WiFiManager::clearFastConnect()
+{
+    if (fastChannel == 0) {
+        return;
+    }
+    fastChannel = 0;
+    config.setPreference("wf_chan", 0);
+}
+
+void WiFiManager::fallbackFullConnect()
+{
+    eventManager->debug("WiFi fast connect failed after " + String(millis() - connectStart) + " ms, full scan", 1);
+    fastAttempt = false;
+    fastFailures++;
+    connectStart = millis();  // the full attempt gets the whole CONNECTION_TIMEOUT
+    WiFi.disconnect();
+    if (fastIP) {
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));  // back to DHCP
+    }
+    const WiFiProfile* profile = findProfile(activeSSID);
+    if (profile == nullptr) {
+        profile = &profiles[0];
+    }
+    WiFi.begin(profile->ssid.c_str(), profile->password.c_str());
+}
+
+void WiFiManager::onConnected()
+{
+    lastConnectTime = millis() - connectStart;
+    if (fastAttempt) {
+        fastConnects++;
+        fastConnectTotal += lastConnectTime;
+    } else {
+        fullConnects++;
+        fullConnectTotal += lastConnectTime;
+    }
+    eventManager->debug("WiFi connected in " + String(lastConnectTime) + " ms (" + (fastAttempt ? "fast" : "full") + ")", 1);
+    stats.connected(lastConnectTime);
+    fastAttempt = false;
+    rssiAverage = WiFi.RSSI();
+    lastRssiSample = millis();
+    saveFastConnect();
+}
+
+void WiFiManager::loadProfiles()
+{
+    profiles.clear();
+    profiles.push_back({0, ssid, password});
+    for (uint slot = 1; slot < MAX_PROFILES; slot++) {
+        String profileSSID = config.getPreference("wf_ssid" + String(slot), "");
+        if (profileSSID.length() > 0) {
+            profiles.push_back({(uint8_t)slot, profileSSID, config.getPreference("wf_pass" + String(slot), "")});
+        }
+    }
+}
+
+const WiFiProfile* WiFiManager::findProfile(const String& ssid)
+{
+    for (const auto& profile : profiles) {
+        if (profile.ssid == ssid && ssid.length() > 0) {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+// Strongest AP of a stored network in the recent scan results
+const WiFiNetwork* WiFiManager::bestKnownNetwork(const uint8_t* excludeBssid)
+{
+    if (networks.empty() || getScanAge() > SCAN_MAX_AGE) {
+        return nullptr;
+    }
+    for (const auto& network : networks) {  // sorted by RSSI
+        if (findProfile(network.ssid) != nullptr && (excludeBssid == nullptr || memcmp(network.bssid, excludeBssid, sizeof(network.bssid)) != 0)) {
+            return &network;
+        }
+    }
+    return nullptr;
+}
+
+bool WiFiManager::addProfile(const String& ssid, const String& password)
+{
+    if (ssid.length() == 0) {
+        return false;
+    }
+    if (ssid == this->ssid) {
+        savePassword(password, false);
+        return true;
+    }
+    const WiFiProfile* existing = findProfile(ssid);
+    uint slot = existing != nullptr ? existing->slot : 0;
+    for (uint i = 1; slot == 0 && i < MAX_PROFILES; i++) {
+        if (config.getPreference("wf_ssid" + String(i), "").length() == 0) {
+            slot = i;
+        }
+    }
+    if (slot == 0) {
+        eventManager->debug("No free network slot (max " + String(MAX_PROFILES) + ")", 0);
+        return false;
+    }
+    JsonDocument values;
+    values["wf_pass" + String(slot)] = password;
+    values["wf_ssid" + String(slot)] = ssid;
+    return config.setPreferences(values);
+}
+
+bool WiFiManager::removeProfile(const String& ssid)
+{
+    const WiFiProfile* profile = findProfile(ssid);
+    if (profile == nullptr || profile->slot == 0) {
+        return false;  // the main network is changed with wifi:ssid / wifi:reset
+    }
+    uint slot = profile->slot;
+    JsonDocument values;
+    values["wf_ssid" + String(slot)] = "";
+    values["wf_pass" + String(slot)] = "";
+    return config.setPreferences(values);
+}
+
+const std::vector<WiFiProfile>& WiFiManager::getProfiles()
+{
+    return profiles;
+}
+
+void WiFiManager::monitorLink()
+{
+    unsigned long now = millis();
+    if (now - lastRssiSample < RSSI_INTERVAL) {
+        return;
+    }
+    lastRssiSample = now;
+    int rssi = WiFi.RSSI();
+    rssiAverage = rssiAverage * 0.8f + rssi * 0.2f;
+    stats.sampleRssi(rssi);
+    if (now - lastHistorySample >= HISTORY_INTERVAL) {
+        lastHistorySample = now;
+        if (historyCount == HISTORY_SIZE) {
+            memmove(rssiHistory, rssiHistory + 1, HISTORY_SIZE - 1);
+            historyCount--;
+        }
+        rssiHistory[historyCount++] = (int8_t)lroundf(rssiAverage);
+    }
+    if (roamThreshold != 0 && rssiAverage < roamThreshold && !scanning && (lastRoamScan == 0 || now - lastRoamScan >= roamInterval)) {
+        eventManager->debug("WiFi link weak (" + String(rssiAverage, 1) + " dBm), looking for a better AP", 2);
+        lastRoamScan = now;
+        if (scanNetworks()) {
+            roamScan = true;
+            roamScans++;
+        }
+    }
+}
+
+void WiFiManager::checkRoaming()
+{
+    roamScan = false;
+    if (connectionStatus != 10) {
+        return;
+    }
+    const WiFiNetwork* candidate = bestKnownNetwork(WiFi.BSSID());
+    if (candidate == nullptr || candidate->rssi < rssiAverage + roamHysteresis) {
+        eventManager->debug("WiFi roaming: no better AP", 2);
+        return;
+    }
+    WiFiProfile profile = *findProfile(candidate->ssid);  // copied, event handlers may reload the profiles
+    WiFiNetwork target = *candidate;
+    roamCount++;
+    eventManager->debug("WiFi roaming to " + profile.ssid + " (" + String(target.rssi) + " dBm, was " + String(rssiAverage, 1) + " dBm)", 1);
+    this->connected = false;
+    stats.roamed();  // not a drop
+    eventManager->triggerEvent("wifi", "roaming", {profile.ssid, String(target.channel)});
+    connectTo(profile, &target);
+}
+
+void WiFiManager::setRoaming(int threshold, uint hysteresis, bool save)
+{
+    roamThreshold = threshold;
+    roamHysteresis = hysteresis;
+    if (save) {
+        config.setPreference("wf_roam", threshold);
+        config.setPreference("wf_roam_hyst", (int)hysteresis);
+    }
+}
+
+String WiFiManager::getLinkInfos()
+{
+    String infos = "RSSI: " + String(connectionStatus == 10 ? WiFi.RSSI() : 0) + " dBm, average " + String(rssiAverage, 1) + " dBm";
+    infos += "\nRoaming: " + (roamThreshold != 0 ? "below " + String(roamThreshold) + " dBm, +" + String(roamHysteresis) + " dB" : String("disabled")) +
+             ", " + String(roamCount) + " roams, " + String(roamScans) + " scans";
+    infos += "\nHistory (every " + String(HISTORY_INTERVAL / 1000) + " s):";
+    for (uint i = 0; i < historyCount; i++) {
+        infos += " " + String(rssiHistory[i]);
+    }
+    infos += "\nNetworks:";
+    for (const auto& profile : profiles) {
+        infos += " " + profile.ssid + (profile.ssid == activeSSID ? "*" : "");
+    }
+    return infos;
+}
+
+void WiFiManager::setFastIP(bool enabled, bool save)
+{
+    fastIP = enabled;
+    if (save) {
+        config.setPreference("wf_fast_ip", enabled ? 1 : 0);
+    }
+}
+
+ConnectionStats& WiFiManager::getStats()
+{
+    return stats;
+}
+
+String WiFiManager::getConnectInfos()
+{
+    String infos = "Last connection: " + String(lastConnectTime) + " ms";
+    infos += "\nFast: " + String(fastConnects) + " (avg " + String(fastConnects > 0 ? fastConnectTotal / fastConnects : 0) + " ms), failed: " +
+             String(fastFailures);
+    infos += "\nFull: " + String(fullConnects) + " (avg " + String(fullConnects > 0 ? fullConnectTotal / fullConnects : 0) + " ms)";
+    if (fastChannel > 0) {
+        infos += "\nCached: channel " + String(fastChannel) + ", IP " + fastLocalIP.toString() + (fastIP ? " (reused)" : " (DHCP)");
+    } else {
+        infos += "\nCached: none";
+    }
+    return infos;
+}
+
 String WiFiManager::getDebugInfos()
 {
-    return "SSID: " + retrieveSSID() + "\nPassword: " + retrievePassword();
+    return "SSID: " + ssid + "\nPassword: " + password;
 }
 
 String WiFiManager::retrieveSSID()
@@ -369,6 +798,8 @@ String WiFiManager::getStatus()
             return "Disconnection";
         case 5:
             return "Access Point";
+        case 6:
+            return "Wrong password";
         case 10:
             return "Connected";
         default:
@@ -414,25 +845,129 @@ String WiFiManager::getInfo(String name)
     return "";
 }
 
-void WiFiManager::scanNetworks(bool show_hidden)
+bool WiFiManager::scanNetworks(bool show_hidden)
 {
+    if (scanning) {
+        return false;
+    }
     WiFi.scanDelete();
-    WiFi.scanNetworks(true, show_hidden);
+    if (WiFi.scanNetworks(true, show_hidden) == WIFI_SCAN_FAILED) {
+        eventManager->debug("WiFi scan failed to start", 1);
+        return false;
+    }
+    scanning = true;
+    return true;
+}
+
+void WiFiManager::checkScan()
+{
+    int count = WiFi.scanComplete();
+    if (count == WIFI_SCAN_RUNNING) {
+        return;
+    }
+    scanning = false;
+    if (count < 0) {
+        roamScan = false;
+        eventManager->debug("WiFi scan failed", 1);
+        eventManager->triggerEvent("wifi", "scan_failed", {});
+        return;
+    }
+    networks.clear();
+    networks.reserve(count);
+    for (int i = 0; i < count; i++) {
+        // all the fields at once instead of one call per field
+        String ssid;
+        uint8_t auth;
+        int32_t rssi;
+        uint8_t* bssid;
+        int32_t channel;
+#ifdef ESP32
+        WiFi.getNetworkInfo(i, ssid, auth, rssi, bssid, channel);
+#else
+        bool hidden;
+        WiFi.getNetworkInfo(i, ssid, auth, rssi, bssid, channel, hidden);
+#endif
+        WiFiNetwork network;
+        strncpy(network.ssid, ssid.c_str(), sizeof(network.ssid) - 1);
+        network.ssid[sizeof(network.ssid) - 1] = '\0';
+        memcpy(network.bssid, bssid, sizeof(network.bssid));
+        network.channel = channel;
+        network.rssi = rssi;
+        network.auth = auth;
+        networks.push_back(network);
+    }
+    WiFi.scanDelete();
+    std::sort(networks.begin(), networks.end(), [](const WiFiNetwork& a, const WiFiNetwork& b) { return a.rssi > b.rssi; });
+    scannedAt = millis();
+    eventManager->debug("WiFi scan done: " + String(networks.size()) + " networks", 2);
+    eventManager->triggerEvent("wifi", "scan_done", {String(networks.size())});
+    if (roamScan) {
+        checkRoaming();
+    }
+
+    if (scanReport) {
+        scanReport = false;
+        for (size_t i = 0; i < networks.size(); i++) {
+            eventManager->debug(String(i) + ": " + getNetworkInfo(i, "ssid") + " (" + getNetworkInfo(i, "rssi") + " dBm, channel " +
+                                    getNetworkInfo(i, "channel") + ", " + getNetworkInfo(i, "bssid") + ")",
+                                0);
+        }
+        eventManager->debug("wifi:network <n> to set network", 0);
+    }
+}
+
+bool WiFiManager::isScanning()
+{
+    return scanning;
+}
+
+const std::vector<WiFiNetwork>& WiFiManager::getScanResults()
+{
+    return networks;
+}
+
+unsigned long WiFiManager::getScanAge()
+{
+    return millis() - scannedAt;
+}
+
+// Strongest cached access point of ssid, if the results are recent enough
+const WiFiNetwork* WiFiManager::findNetwork(const String& ssid)
+{
+    if (networks.empty() || getScanAge() > SCAN_MAX_AGE) {
+        return nullptr;
+    }
+    for (const auto& network : networks) {
+        if (ssid == network.ssid) {
+            return &network;
+        }
+    }
+    return nullptr;
 }
 
 int WiFiManager::getNetworks()
 {
-    return WiFi.scanComplete();
+    return scanning ? -1 : networks.size();
 }
 
 int WiFiManager::getNetworkCount(bool show_hidden)
 {
-    return WiFi.scanNetworks(false, show_hidden);
+    if (scanning) {
+        return -1;
+    }
+    if (!networks.empty() && getScanAge() <= SCAN_MAX_AGE) {
+        return networks.size();
+    }
+    scanNetworks(show_hidden);  // the count is available with the wifi/scan_done event
+    return -1;
 }
 
 void WiFiManager::setNetwork(int n, bool save)
 {
-    this->ssid = WiFi.SSID(n);
+    if (n < 0 || (size_t)n >= networks.size()) {
+        return;
+    }
+    this->ssid = networks[n].ssid;
     if (save) {
         this->saveSSID(this->ssid);
     }
@@ -440,20 +975,30 @@ void WiFiManager::setNetwork(int n, bool save)
 
 String WiFiManager::getNetworkInfo(int n, String name)
 {
+    if (n < 0 || (size_t)n >= networks.size()) {
+        return "";
+    }
+    const WiFiNetwork& network = networks[n];
     if (name == "ssid") {
-        return WiFi.SSID(n);
+        return network.ssid;
     }
     if (name == "bssid") {
-        return WiFi.BSSIDstr(n);
+        char bssid[18];
+        snprintf(bssid, sizeof(bssid), "%02X:%02X:%02X:%02X:%02X:%02X", network.bssid[0], network.bssid[1], network.bssid[2], network.bssid[3],
+                 network.bssid[4], network.bssid[5]);
+        return bssid;
     }
     if (name == "channel") {
-        return String(WiFi.channel(n));
+        return String(network.channel);
     }
     if (name == "rssi") {
-        return String(WiFi.RSSI(n));
+        return String(network.rssi);
     }
     if (name == "encryption") {
-        return String(WiFi.encryptionType(n));
+        return String(network.auth);
+    }
+    if (name == "age") {
+        return String(getScanAge());
     }
     return "";
 }
@@ -572,4 +1117,39 @@ bool WiFiManager::otaUpdate()
     }
     return false;
 }
-#endif
\ No newline at end of file
+#endif
+
+#ifdef ESP32
+bool WiFiManager::otaUpdate()
+{
+    if (connectionStatus != 10) {
+        eventManager->debug("No WiFi connection STA", 1);
+        return false;
+    }
+    String otaHost = config.getPreference("ota_host", config.OTA_HOST);
+    int otaPort = config.getPreference("ota_port", config.OTA_PORT);
+    String otaUrl = config.getPreference("ota_url", config.OTA_URL);
+    if (otaHost.length() == 0 || otaUrl.length() == 0) {
+        eventManager->debug("No OTA Host or URL", 1);
+        return false;
+    }
+    String url = "https://" + otaHost + ":" + String(otaPort) + (otaUrl.startsWith("/") ? "" : "/") + otaUrl;
+    otaBackend.setPublicKey(config.OTA_PUBLIC_KEY);
+    ota.setBackend(&otaBackend);
+    return ota.start(url);
+}
+#endif
+
+void WiFiManager::otaAbort()
+{
+    ota.abort();
+}
+
+String WiFiManager::getOtaInfos()
+{
+#ifdef ESP32
+    return ota.getInfos();
+#else
+    return "OTA: blocking update (ESP8266)";
+#endif
+}
@@ -0,0 +1,178 @@
+#ifndef HOST_MQTT_BROKER_H
+#define HOST_MQTT_BROKER_H
+
+#include "../../include/MQTTTopicTrie.h"
+#include <WiFi.h>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+In-process MQTT 3.1.1 broker stand-in for a single client, reached through the WiFiClient shim:
+CONNECT, SUBSCRIBE, UNSUBSCRIBE, PUBLISH (QoS 0 and 1, routed back to the client when it subscribed
+to the topic), PINGREQ, DISCONNECT. For the tests, the PUBACKs can be withheld and the publications
+received are kept with their flags.
+*/
+class MQTTBroker : public HostServer
+{
+  public:
+    struct Publication {
+        String topic;
+        String payload;
+        uint8_t qos;
+        bool dup;
+        bool retained;
+        uint16_t packetId;  // QoS 1 only
+    };
+
+    MQTTBroker(uint16_t port = 1883) : HostServer(port) {}
+
+    std::vector<String> filters;          // subscriptions of the client
+    std::vector<uint16_t> subscribeIds;   // packet ids of its SUBSCRIBE and UNSUBSCRIBE
+    uint32_t connections = 0;
+    uint32_t published = 0;               // PUBLISH received from the client
+    uint64_t publishedBytes = 0;          // their payloads
+    bool ackPublications = true;          // answer the QoS 1 PUBLISH with a PUBACK
+    bool keepPublications = false;        // keep them in publications
+    std::vector<Publication> publications;
+    std::function<void(const String& topic, const uint8_t* payload, size_t length)> onPublish;
+
+    bool accept() override
+    {
+        input.clear();
+        filters.clear();
+        connections++;
+        return true;
+    }
+
+    void receive(const uint8_t* data, size_t size) override
+    {
+        input.append((const char*)data, size);
+        size_t pos = 0;
+        while (pos < input.size()) {
+            // fixed header, remaining length on 1 to 4 bytes, body
+            uint32_t length = 0;
+            uint32_t multiplier = 1;
+            size_t body = pos + 1;
+            bool complete = false;
+            while (body < input.size() && body < pos + 5 && !complete) {
+                uint8_t digit = input[body++];
+                length += (digit & 127) * multiplier;
+                multiplier *= 128;
+                complete = (digit & 128) == 0;
+            }
+            if (!complete || input.size() - body < length) {
+                break;  // wait for the rest of the packet
+            }
+            handle(input[pos], (const uint8_t*)input.data() + body, length);
+            pos = body + length;
+        }
+        input.erase(0, pos);
+    }
+
+    // PUBLISH from another client, delivered if the client subscribed to a matching filter
+    bool inject(const String& topic, const String& payload)
+    {
+        for (const String& filter : filters) {
+            if (MQTTTopicTrie::matches(filter, topic)) {
+                sendPublish(topic, (const uint8_t*)payload.c_str(), payload.length());
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ack(uint16_t packetId)
+    {
+        const uint8_t puback[] = {0x40, 2, (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF)};
+        send(puback, sizeof(puback));
+    }
+
+  private:
+    std::string input;
+
+    void handle(uint8_t header, const uint8_t* body, uint32_t length)
+    {
+        switch (header >> 4) {
+            case 1: {  // CONNECT
+                const uint8_t connack[] = {0x20, 2, 0, 0};
+                send(connack, sizeof(connack));
+                break;
+            }
+            case 3: {  // PUBLISH
+                uint16_t topicLength = body[0] << 8 | body[1];
+                String topic((const char*)body + 2, topicLength);
+                uint32_t pos = 2 + topicLength;
+                uint8_t qos = (header >> 1) & 0x03;
+                uint16_t packetId = 0;
+                if (qos > 0) {
+                    packetId = body[pos] << 8 | body[pos + 1];
+                    pos += 2;
+                    if (ackPublications) {
+                        ack(packetId);
+                    }
+                }
+                published++;
+                publishedBytes += length - pos;
+                if (keepPublications) {
+                    publications.push_back({topic, String((const char*)body + pos, length - pos), qos, (header & 0x08) != 0, (header & 0x01) != 0, packetId});
+                }
+                if (onPublish) {
+                    onPublish(topic, body + pos, length - pos);
+                }
+                for (const String& filter : filters) {
+                    if (MQTTTopicTrie::matches(filter, topic)) {
+                        sendPublish(topic, body + pos, length - pos);
+                        break;
+                    }
+                }
+                break;
+            }
+            case 8:     // SUBSCRIBE
+            case 10: {  // UNSUBSCRIBE
+                subscribeIds.push_back(body[0] << 8 | body[1]);
+                std::vector<uint8_t> ack = {(uint8_t)((header >> 4) == 8 ? 0x90 : 0xB0), 2, body[0], body[1]};
+                for (uint32_t pos = 2; pos + 2 <= length;) {
+                    uint16_t filterLength = body[pos] << 8 | body[pos + 1];
+                    String filter((const char*)body + pos + 2, filterLength);
+                    pos += 2 + filterLength;
+                    filters.erase(std::remove(filters.begin(), filters.end(), filter), filters.end());
+                    if ((header >> 4) == 8) {
+                        filters.push_back(filter);
+                        ack.push_back(0);  // granted QoS 0
+                        ack[1]++;
+                        pos++;
+                    }
+                }
+                send(ack.data(), ack.size());
+                break;
+            }
+            case 12: {  // PINGREQ
+                const uint8_t pingresp[] = {0xD0, 0};
+                send(pingresp, sizeof(pingresp));
+                break;
+            }
+            case 14:  // DISCONNECT
+                close();
+                break;
+        }
+    }
+
+    void sendPublish(const String& topic, const uint8_t* payload, size_t length)
+    {
+        std::vector<uint8_t> packet = {0x30};
+        size_t remaining = 2 + topic.length() + length;
+        do {
+            packet.push_back((remaining & 127) | (remaining > 127 ? 128 : 0));
+            remaining >>= 7;
+        } while (remaining > 0);
+        packet.push_back(topic.length() >> 8);
+        packet.push_back(topic.length() & 0xFF);
+        packet.insert(packet.end(), topic.c_str(), topic.c_str() + topic.length());
+        packet.insert(packet.end(), payload, payload + length);
+        send(packet.data(), packet.size());
+    }
+};
+
+#endif
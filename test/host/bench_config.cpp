@@ -0,0 +1,141 @@
+/*
+Configuration benchmark on the emulated flash (shim/Preferences, shim/EEPROM), built once for the ESP32
+code path (NVS) and once for the ESP8266 one (JSON in EEPROM): get/set throughput on the host, and per
+operation the modelled flash time and the write amplification (flash bytes programmed / key + value bytes).
+*/
+#include "../../include/Configuration.h"
+#include "HostFlash.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#ifdef ESP32
+#define PLATFORM "ESP32, Preferences (NVS)"
+#else
+#define PLATFORM "ESP8266, JSON in EEPROM"
+#endif
+
+#define KEYS 10
+
+class BytesPrint : public Print
+{
+  public:
+    std::vector<uint8_t> bytes;
+
+    size_t write(uint8_t c) override
+    {
+        bytes.push_back(c);
+        return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        bytes.insert(bytes.end(), buffer, buffer + size);
+        return size;
+    }
+    using Print::write;
+};
+
+static int failures = 0;
+
+static void expect(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+template <typename Operation>
+static void measure(Configuration& config, const char* name, int count, Operation operation)
+{
+    config.resetStorageStats();
+    HostFlash::reset();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        operation(i);
+    }
+    double hostMicros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    Configuration::StorageStats stats = config.getStorageStats();
+    const HostFlashStats& flash = HostFlash::stats;
+    printf("%-22s %7d %12.0f %10.2f %7u %7u %8u %10llu %6u %8s %9u\n", name, count, count * 1e6 / hostMicros, flash.busyMicros / 1000.0 / count,
+           stats.writes, stats.commits, stats.payloadBytes, (unsigned long long)flash.programmedBytes, flash.erasedSectors,
+           stats.payloadBytes > 0 ? String((float)flash.programmedBytes / stats.payloadBytes, 1).c_str() : "-",
+           stats.commits > 0 ? stats.commitTimeTotal / stats.commits : 0);
+}
+
+static String value32(int i)
+{
+    char value[33];
+    snprintf(value, sizeof(value), "value %026d", i);
+    return value;
+}
+
+int main(int argc, char** argv)
+{
+    HostFlash::storageDir = argc > 1 ? argv[1] : ".";
+    // fresh flash
+    remove((HostFlash::storageDir + "/config.nvs").c_str());
+    remove((HostFlash::storageDir + "/eeprom.bin").c_str());
+    Serial.quiet = true;
+
+    EventManager eventManager;
+    Configuration config;
+    config.init(eventManager);
+
+    std::vector<String> intKeys;
+    std::vector<String> stringKeys;
+    std::vector<String> batches;
+    for (int k = 0; k < KEYS; k++) {
+        intKeys.push_back("int" + String(k));
+        stringKeys.push_back("str" + String(k));
+    }
+    for (int i = 0; i < 100; i++) {
+        String json = "{";
+        for (int k = 0; k < KEYS; k++) {
+            json += (k > 0 ? ",\"batch" : "\"batch") + String(k) + "\":" + String(i * KEYS + k);
+        }
+        batches.push_back(json + "}");
+    }
+
+    printf("%s, %d keys of each kind\n", PLATFORM, KEYS);
+    printf("%-22s %7s %12s %10s %7s %7s %8s %10s %6s %8s %9s\n", "operation", "ops", "host ops/s", "flash ms", "writes", "commits", "payload",
+           "programmed", "erases", "amplif.", "commit us");
+
+    measure(config, "set int", 500, [&](int i) { config.setPreference(intKeys[i % KEYS], i); });
+    expect(config.getPreference("int9", 0) == 499, "set int");
+
+    measure(config, "set string (32 B)", 500, [&](int i) { config.setPreference(stringKeys[i % KEYS], value32(i)); });
+    expect(config.getPreference("str9", String()) == value32(499), "set string");
+
+    measure(config, "set unchanged", 2000, [&](int i) { config.setPreference(intKeys[i % KEYS], 490 + i % KEYS); });
+
+    int sum = 0;
+    measure(config, "get int", 20000, [&](int i) { sum += config.getPreference(intKeys[i % KEYS], 0); });
+    expect(sum == 20000 / KEYS * (490 * KEYS + 45), "get int");
+
+    size_t length = 0;
+    measure(config, "get string", 20000, [&](int i) { length += config.getPreference(stringKeys[i % KEYS], String()).length(); });
+    expect(length == 20000 * 32, "get string");
+
+    measure(config, "set 10 values (JSON)", 100, [&](int i) { config.setJsonConfig(batches[i]); });
+    expect(config.getPreference("batch3", 0) == 993, "set 10 values");
+
+    // restore alternately two snapshots differing by every batch value
+    BytesPrint snapshots[2];
+    config.writeSnapshot(snapshots[1]);
+    config.setJsonConfig(batches[0]);
+    config.writeSnapshot(snapshots[0]);
+    measure(config, "restore snapshot", 50,
+            [&](int i) { expect(config.restoreSnapshot(snapshots[i % 2].bytes.data(), snapshots[i % 2].bytes.size()), "restore snapshot"); });
+    expect(config.getPreference("batch3", 0) == 993 && config.getPreference("str0", String()) == value32(490), "restored values");
+
+    // the stored configuration is read back by a new instance
+    Configuration reloaded;
+    reloaded.init(eventManager);
+    expect(reloaded.getJsonConfig() == config.getJsonConfig(), "reloaded configuration");
+
+    printf("\nflash ms: modelled program / erase time per operation; payload: key + value bytes of the written values;\n"
+           "amplif.: programmed / payload bytes; commit us: average commit time seen by Configuration (host + modelled)\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+/*
+MQTTManager with PubSubClient against an in-process broker stand-in (MQTTBroker.h, reached through the
+WiFiClient shim): inbound dispatch rate, publish rate and round trip latency of the commands received
+on <hostname>/cmd (EventManager::triggerCommand, then the devices, as MainController routes them), for
+several device counts and payload sizes. The broker runs in the same thread, its work is included.
+*/
+#include "../../include/Device.h"
+#include "../../include/MQTTManager.h"
+#include "../../include/TimeManager.h"
+#include "HostFlash.h"
+#include "MQTTBroker.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#define BROKER_PORT 1883
+#define COMMANDS 2000    // per dispatch measure
+#define ROUND_TRIPS 1000  // per latency measure
+#define PUBLISHES 5000
+
+// set <value> keeps the value, echo <value> publishes it on bench/reply/<id>
+class BenchDevice : public Device
+{
+  public:
+    BenchDevice(String id, Configuration& config, EventManager& eventMgr, TimeManager& timeManager) : Device(id, config, eventMgr, timeManager)
+    {
+        topic = "bench/" + id;
+        addCommand("on", [this]() { state = 1; });
+    }
+
+    uint32_t commands = 0;
+    String value;
+
+    bool processCommand(String command, std::vector<String> params) override
+    {
+        if (command == "set" || command == "echo") {
+            commands++;
+            value = params.size() > 0 ? params[0] : "";
+            if (command == "echo") {
+                mqttManager->publish("bench/reply/" + id, value, false);
+            }
+            return true;
+        }
+        return Device::processCommand(command, params);
+    }
+};
+
+static int failures = 0;
+
+static void expect(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static double elapsedMicros(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    HostFlash::storageDir = "";  // configuration in RAM
+    Serial.quiet = true;
+
+    MQTTBroker broker(BROKER_PORT);  // outlives the client
+    EventManager eventManager;
+    Configuration config;
+    TimeManager timeManager(config, eventManager);
+    MQTTManager mqttManager(config, eventManager);
+    std::vector<BenchDevice*> devices;
+
+    // MainController: every event goes to MQTTManager and to every device, level 0 messages are printed
+    eventManager.registerMainCallback([&](const String& type, const String& event, const std::vector<String>& params) {
+        eventManager.debug("Processing Event: " + type + " / " + event, 3);
+        mqttManager.processEvent(type, event, params);
+        for (auto& device : devices) {
+            device->processEvent(type, event, params);
+        }
+    });
+    eventManager.registerDebugCallback([](const String& message, int level, bool displayTime) {
+        if (level <= 0) {
+            Serial.println(message);
+        }
+    });
+
+    config.init(eventManager);
+    config.setPreference("hostname", "bench");
+    config.setPreference("mq_serv", "127.0.0.1");
+    config.setPreference("mq_port", BROKER_PORT);
+
+    mqttManager.init();
+    mqttManager.setCommandTopic("{hostname}/cmd");
+    mqttManager.setStatus(2);
+    auto settle = [&]() {
+        for (int i = 0; i < 200; i++) {
+            mqttManager.loop();
+        }
+    };
+    settle();
+    expect(mqttManager.isConnected(), "connected");
+    expect(std::find(broker.filters.begin(), broker.filters.end(), String("bench/cmd")) != broker.filters.end(), "bench/cmd subscribed");
+
+    String replyTopic;
+    bool replied = false;
+    broker.onPublish = [&](const String& topic, const uint8_t* payload, size_t length) {
+        replyTopic = topic;
+        replied = true;
+    };
+
+    printf("Commands on bench/cmd (\"devN:<command> <value>\"), routed by EventManager to every device\n");
+    printf("%-8s %-6s %13s %13s %10s %10s %10s %8s\n", "devices", "value", "dispatch/s", "topic msg/s", "rtt p50", "rtt p99", "rtt max", "lost");
+
+    const int deviceCounts[] = {1, 10, 50};
+    const unsigned int sizes[] = {16, 64, 200};  // the PubSubClient buffer (MQTT_MAX_PACKET_SIZE, 256) drops larger messages
+    for (int deviceCount : deviceCounts) {
+        while ((int)devices.size() < deviceCount) {
+            BenchDevice* device = new BenchDevice("dev" + String((int)devices.size()), config, eventManager, timeManager);
+            device->setMQTTManager(&mqttManager);
+            devices.push_back(device);
+            device->init();
+        }
+        settle();  // device subscriptions
+
+        for (unsigned int size : sizes) {
+            String value(std::string(size, 'v').c_str());
+
+            // inbound commands, all queued at once: dispatch rate
+            for (BenchDevice* device : devices) {
+                device->commands = 0;
+            }
+            for (int i = 0; i < COMMANDS; i++) {
+                broker.inject("bench/cmd", "dev" + String(i % deviceCount) + ":set " + value);
+            }
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < COMMANDS; i++) {
+                mqttManager.loop();
+            }
+            double dispatchMicros = elapsedMicros(start);
+            uint32_t handled = 0;
+            for (BenchDevice* device : devices) {
+                handled += device->commands;
+            }
+            expect(handled == COMMANDS && devices.back()->value == value, "commands dispatched");
+
+            // messages on the device topics (Device::processMQTT)
+            for (int i = 0; i < COMMANDS; i++) {
+                broker.inject("bench/dev" + String(i % deviceCount), "on");
+            }
+            start = std::chrono::steady_clock::now();
+            for (int i = 0; i < COMMANDS; i++) {
+                mqttManager.loop();
+            }
+            double topicMicros = elapsedMicros(start);
+            expect(devices.back()->state == 1, "device topic messages");
+            devices.back()->state = 0;
+
+            // round trips: command sent by the broker until the reply of the device reaches it
+            std::vector<double> latencies;
+            int lost = 0;
+            for (int i = 0; i < ROUND_TRIPS; i++) {
+                int target = i % deviceCount;
+                replied = false;
+                start = std::chrono::steady_clock::now();
+                broker.inject("bench/cmd", "dev" + String(target) + ":echo " + value);
+                for (int loops = 0; loops < 10 && !replied; loops++) {
+                    mqttManager.loop();
+                }
+                if (replied && replyTopic == "bench/reply/dev" + String(target)) {
+                    latencies.push_back(elapsedMicros(start));
+                } else {
+                    lost++;
+                }
+            }
+            std::sort(latencies.begin(), latencies.end());
+            auto percentile = [&latencies](size_t p) { return latencies.empty() ? 0 : latencies[(latencies.size() - 1) * p / 100]; };
+            expect(lost == 0, "round trips");
+
+            printf("%-8d %-6u %13.0f %13.0f %8.1f us %7.1f us %7.1f us %8d\n", deviceCount, size, COMMANDS * 1e6 / dispatchMicros,
+                   COMMANDS * 1e6 / topicMicros, percentile(50), percentile(99), latencies.empty() ? 0 : latencies.back(), lost);
+        }
+    }
+
+    // publications, sent from the client buffer or streamed when larger (MQTTManager::sendMessage)
+    printf("\nPublications (MQTTManager::publish)\n");
+    printf("%-8s %13s %13s\n", "payload", "publish/s", "MB/s");
+    const unsigned int publishSizes[] = {16, 200, 1024, 4096};
+    for (unsigned int size : publishSizes) {
+        String payload(std::string(size, 'p').c_str());
+        broker.published = 0;
+        broker.publishedBytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < PUBLISHES; i++) {
+            mqttManager.publish("bench/out", payload, false);
+        }
+        double publishMicros = elapsedMicros(start);
+        expect(broker.published == PUBLISHES && broker.publishedBytes == (uint64_t)PUBLISHES * size, "publications");
+        printf("%-8u %13.0f %13.1f\n", size, PUBLISHES * 1e6 / publishMicros, broker.publishedBytes / publishMicros);
+    }
+
+    printf("\ndispatch/s: commands handled per second, queued in the client socket (PubSubClient, MQTTManager, EventManager,\n"
+           "devices); topic msg/s: same for messages on the device topics; rtt: command in, reply published, back to the broker\n");
+    for (BenchDevice* device : devices) {
+        delete device;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+/*
+MQTTTopicTrie with thousands of filters (exact, '+' and '#'): add, match and remove times, and the
+linear scan with MQTTTopicTrie::matches that the trie replaces, for reference.
+*/
+#include "../../include/MQTTTopicTrie.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#define ROOMS 50
+#define TOPICS 10000  // messages routed per measure
+
+static int failures = 0;
+
+static void expect(bool condition, const char* what)
+{
+    if (!condition) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+static double elapsedMicros(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 80 % exact "home/<room>/dev<n>/state", 15 % with '+', 5 % ending with '#'
+static std::vector<String> makeFilters(size_t count, std::mt19937& rng)
+{
+    std::vector<String> filters;
+    for (size_t i = 0; i < count; i++) {
+        String room = "room" + String((int)(rng() % ROOMS));
+        String device = "dev" + String((int)i);
+        uint32_t kind = rng() % 100;
+        if (kind < 80) {
+            filters.push_back("home/" + room + "/" + device + "/state");
+        } else if (kind < 88) {
+            filters.push_back("home/+/" + device + "/state");
+        } else if (kind < 95) {
+            filters.push_back("home/" + room + "/+/set");
+        } else {
+            filters.push_back(kind % 2 == 0 ? "home/" + room + "/#" : "home/" + room + "/" + device + "/#");
+        }
+    }
+    return filters;
+}
+
+int main()
+{
+    std::mt19937 rng(31);
+    const size_t counts[] = {1000, 5000, 20000};
+
+    printf("%-8s %10s %12s %12s %10s %14s %10s\n", "filters", "add us", "match us", "msg/s", "handlers", "linear us", "remove us");
+    for (size_t count : counts) {
+        std::vector<String> filters = makeFilters(count, rng);
+        std::vector<String> topics;
+        for (int i = 0; i < TOPICS; i++) {
+            size_t device = rng() % count;
+            topics.push_back("home/room" + String((int)(rng() % ROOMS)) + "/dev" + String((int)device) + (rng() % 4 == 0 ? "/set" : "/state"));
+        }
+
+        MQTTTopicTrie trie;
+        std::vector<uint> ids;
+        uint64_t calls = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const String& filter : filters) {
+            ids.push_back(trie.add(filter, [&calls](const MQTTMessage& message) { calls++; }));
+        }
+        double addMicros = elapsedMicros(start);
+        expect(trie.size() == count, "filters added");
+
+        size_t matched = 0;
+        start = std::chrono::steady_clock::now();
+        for (const String& topic : topics) {
+            MQTTMessage message(topic.c_str(), nullptr, 0);
+            matched += trie.match(topic, [&message](const MQTTMessageHandler& handler) { handler(message); });
+        }
+        double matchMicros = elapsedMicros(start);
+        expect(calls == matched, "handlers called");
+
+        // linear scan over a sample of the topics, checked against the trie
+        int sample = TOPICS / 10;
+        size_t linearMatched = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < sample; i++) {
+            for (const String& filter : filters) {
+                linearMatched += MQTTTopicTrie::matches(filter, topics[i]);
+            }
+        }
+        double linearMicros = elapsedMicros(start);
+        size_t trieMatched = 0;
+        for (int i = 0; i < sample; i++) {
+            trieMatched += trie.match(topics[i], [](const MQTTMessageHandler& handler) {});
+        }
+        expect(linearMatched == trieMatched, "same matches as the linear scan");
+
+        start = std::chrono::steady_clock::now();
+        for (uint id : ids) {
+            trie.remove(id);
+        }
+        double removeMicros = elapsedMicros(start);
+        expect(trie.size() == 0, "filters removed");
+
+        printf("%-8zu %10.2f %12.2f %12.0f %10.2f %14.1f %10.2f\n", count, addMicros / count, matchMicros / TOPICS, TOPICS * 1e6 / matchMicros,
+               (double)matched / TOPICS, linearMicros / sample, removeMicros / count);
+    }
+    printf("\nadd / remove us: per filter; match us: per message, handlers: matches per message; linear us: per message\n"
+           "when every filter is compared with MQTTTopicTrie::matches\n");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+#!/usr/bin/env python3
+"""Write two deterministic fake firmware images for the OTA package tests.
+
+base.bin looks like code (4 bytes aligned words from a small vocabulary, some repeated runs),
+new.bin is base.bin with a few edits: changed words, an inserted and a removed block, a new tail.
+The sizes are not multiples of 4 KB, so the last output block is a partial one.
+
+Usage: ota_images.py <directory>
+"""
+
+import os
+import random
+import struct
+import sys
+
+
+def code(rng, size):
+    vocabulary = [rng.getrandbits(32) for _ in range(512)]
+    words = []
+    while len(words) * 4 < size:
+        if words and rng.random() < 0.1:
+            start = rng.randrange(len(words))
+            words += words[start:start + rng.randrange(4, 64)]
+        else:
+            words.append(rng.choice(vocabulary))
+    return b"".join(struct.pack("<I", w) for w in words)[:size]
+
+
+def main():
+    directory = sys.argv[1]
+    rng = random.Random(48)
+    base = code(rng, 150001)
+    new = bytearray(base)
+    for _ in range(40):
+        offset = rng.randrange(0, len(new) - 4) & ~3
+        new[offset:offset + 4] = struct.pack("<I", rng.getrandbits(32))
+    new[60000:60000] = code(rng, 3001)
+    del new[90000:92500]
+    new += code(rng, 7777)
+    with open(os.path.join(directory, "base.bin"), "wb") as f:
+        f.write(base)
+    with open(os.path.join(directory, "new.bin"), "wb") as f:
+        f.write(new)
+
+
+if __name__ == "__main__":
+    main()
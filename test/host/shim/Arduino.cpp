@@ -0,0 +1,87 @@
+#include "Arduino.h"
+#include <chrono>
+#include <random>
+#include <thread>
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static bool manualClock = false;
+static uint64_t manualMicros = 0;
+static uint64_t clockOffset = 0;  // hostClockAdvance() on the real clock
+static const auto clockStart = std::chrono::steady_clock::now();
+static std::mt19937 generator(1);
+
+static uint64_t now()
+{
+    if (manualClock) {
+        return manualMicros;
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - clockStart).count() + clockOffset;
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(now() / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)now();
+}
+
+void delay(unsigned long ms)
+{
+    delayMicroseconds(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    if (manualClock) {
+        manualMicros += us;
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+void yield() {}
+
+void hostClockManual(bool manual)
+{
+    if (manual && !manualClock) {
+        manualMicros = now();
+    }
+    manualClock = manual;
+}
+
+void hostClockAdvance(unsigned long us)
+{
+    if (manualClock) {
+        manualMicros += us;
+    } else {
+        clockOffset += us;
+    }
+}
+
+void configTime(long gmtOffset, int daylightOffset, const char* server1, const char* server2, const char* server3) {}
+
+bool getLocalTime(struct tm* info, uint32_t ms)
+{
+    time_t now = time(nullptr);
+    return localtime_r(&now, info) != nullptr;
+}
+
+long random(long max)
+{
+    return max > 0 ? (long)(generator() % (unsigned long)max) : 0;
+}
+
+long random(long min, long max)
+{
+    return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed)
+{
+    generator.seed(seed);
+}
@@ -0,0 +1,517 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/*
+Minimal Arduino core for the host tests: String, Print / Stream, Serial (stdout), IPAddress,
+millis() / micros() and ESP. The clock is the real one unless a test switches it to manual.
+*/
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <sys/types.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define PROGMEM
+#define PGM_P const char*
+#define F(string_literal) (string_literal)
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_byte_near(addr) pgm_read_byte(addr)
+#define strlen_P strlen
+#define memcpy_P memcpy
+
+using std::isinf;
+using std::isnan;
+using std::max;
+using std::min;
+
+class String
+{
+  public:
+    String() {}
+    String(const char* cstr) : buffer(cstr != nullptr ? cstr : "") {}
+    String(const char* cstr, unsigned int length) : buffer(cstr, length) {}
+    String(const std::string& str) : buffer(str) {}
+    explicit String(char c) : buffer(1, c) {}
+    explicit String(unsigned char value, unsigned char base = 10) : buffer(format((unsigned long long)value, base)) {}
+    explicit String(int value, unsigned char base = 10) : buffer(formatSigned(value, base)) {}
+    explicit String(unsigned int value, unsigned char base = 10) : buffer(format(value, base)) {}
+    explicit String(long value, unsigned char base = 10) : buffer(formatSigned(value, base)) {}
+    explicit String(unsigned long value, unsigned char base = 10) : buffer(format(value, base)) {}
+    explicit String(long long value, unsigned char base = 10) : buffer(formatSigned(value, base)) {}
+    explicit String(unsigned long long value, unsigned char base = 10) : buffer(format(value, base)) {}
+    explicit String(float value, unsigned int decimals = 2) : buffer(formatFloat(value, decimals)) {}
+    explicit String(double value, unsigned int decimals = 2) : buffer(formatFloat(value, decimals)) {}
+
+    unsigned int length() const { return buffer.size(); }
+    bool isEmpty() const { return buffer.empty(); }
+    const char* c_str() const { return buffer.c_str(); }
+    bool reserve(unsigned int size)
+    {
+        buffer.reserve(size);
+        return true;
+    }
+
+    bool concat(const String& str)
+    {
+        buffer += str.buffer;
+        return true;
+    }
+    bool concat(const char* cstr)
+    {
+        if (cstr == nullptr) {
+            return false;
+        }
+        buffer += cstr;
+        return true;
+    }
+    bool concat(const char* cstr, unsigned int length)
+    {
+        if (cstr == nullptr) {
+            return false;
+        }
+        buffer.append(cstr, length);
+        return true;
+    }
+    bool concat(char c)
+    {
+        buffer += c;
+        return true;
+    }
+    template <typename T>
+    bool concat(T value)
+    {
+        return concat(String(value));
+    }
+
+    String& operator+=(const String& str)
+    {
+        concat(str);
+        return *this;
+    }
+    String& operator+=(const char* cstr)
+    {
+        concat(cstr);
+        return *this;
+    }
+    String& operator+=(char c)
+    {
+        concat(c);
+        return *this;
+    }
+    template <typename T>
+    String& operator+=(T value)
+    {
+        concat(String(value));
+        return *this;
+    }
+
+    char operator[](unsigned int index) const { return index < buffer.size() ? buffer[index] : 0; }
+    char& operator[](unsigned int index) { return buffer[index]; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+    void setCharAt(unsigned int index, char c)
+    {
+        if (index < buffer.size()) {
+            buffer[index] = c;
+        }
+    }
+
+    bool equals(const String& str) const { return buffer == str.buffer; }
+    bool equalsIgnoreCase(const String& str) const
+    {
+        return buffer.size() == str.buffer.size() &&
+               std::equal(buffer.begin(), buffer.end(), str.buffer.begin(), [](char a, char b) { return tolower(a) == tolower(b); });
+    }
+    int compareTo(const String& str) const { return buffer.compare(str.buffer); }
+    bool operator==(const String& str) const { return buffer == str.buffer; }
+    bool operator==(const char* cstr) const { return buffer == (cstr != nullptr ? cstr : ""); }
+    bool operator!=(const String& str) const { return buffer != str.buffer; }
+    bool operator!=(const char* cstr) const { return !(*this == cstr); }
+    bool operator<(const String& str) const { return buffer < str.buffer; }
+    bool operator>(const String& str) const { return buffer > str.buffer; }
+    bool operator<=(const String& str) const { return buffer <= str.buffer; }
+    bool operator>=(const String& str) const { return buffer >= str.buffer; }
+
+    bool startsWith(const String& prefix) const { return buffer.compare(0, prefix.buffer.size(), prefix.buffer) == 0; }
+    bool startsWith(const String& prefix, unsigned int offset) const
+    {
+        return offset <= buffer.size() && buffer.compare(offset, prefix.buffer.size(), prefix.buffer) == 0;
+    }
+    bool endsWith(const String& suffix) const
+    {
+        return buffer.size() >= suffix.buffer.size() && buffer.compare(buffer.size() - suffix.buffer.size(), suffix.buffer.size(), suffix.buffer) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const { return toIndex(buffer.find(c, from)); }
+    int indexOf(const String& str, unsigned int from = 0) const { return toIndex(buffer.find(str.buffer, from)); }
+    int lastIndexOf(char c) const { return toIndex(buffer.rfind(c)); }
+    int lastIndexOf(char c, unsigned int from) const { return toIndex(buffer.rfind(c, from)); }
+    int lastIndexOf(const String& str) const { return toIndex(buffer.rfind(str.buffer)); }
+
+    String substring(unsigned int from) const { return from < buffer.size() ? String(buffer.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to) {
+            std::swap(from, to);
+        }
+        if (from >= buffer.size()) {
+            return String();
+        }
+        return String(buffer.substr(from, std::min((size_t)to, buffer.size()) - from));
+    }
+
+    void remove(unsigned int index)
+    {
+        if (index < buffer.size()) {
+            buffer.erase(index);
+        }
+    }
+    void remove(unsigned int index, unsigned int count)
+    {
+        if (index < buffer.size()) {
+            buffer.erase(index, count);
+        }
+    }
+    void replace(const String& find, const String& replacement)
+    {
+        if (find.buffer.empty()) {
+            return;
+        }
+        for (size_t pos = buffer.find(find.buffer); pos != std::string::npos; pos = buffer.find(find.buffer, pos + replacement.buffer.size())) {
+            buffer.replace(pos, find.buffer.size(), replacement.buffer);
+        }
+    }
+    void replace(char find, char replacement) { std::replace(buffer.begin(), buffer.end(), find, replacement); }
+    void trim()
+    {
+        size_t start = 0;
+        size_t end = buffer.size();
+        while (start < end && isspace((unsigned char)buffer[start])) {
+            start++;
+        }
+        while (end > start && isspace((unsigned char)buffer[end - 1])) {
+            end--;
+        }
+        buffer = buffer.substr(start, end - start);
+    }
+    void toLowerCase() { std::transform(buffer.begin(), buffer.end(), buffer.begin(), [](char c) { return (char)tolower(c); }); }
+    void toUpperCase() { std::transform(buffer.begin(), buffer.end(), buffer.begin(), [](char c) { return (char)toupper(c); }); }
+
+    long toInt() const { return strtol(buffer.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(buffer.c_str(), nullptr); }
+    double toDouble() const { return strtod(buffer.c_str(), nullptr); }
+
+    void toCharArray(char* buf, unsigned int size, unsigned int index = 0) const { getBytes((unsigned char*)buf, size, index); }
+    void getBytes(unsigned char* buf, unsigned int size, unsigned int index = 0) const
+    {
+        if (size == 0) {
+            return;
+        }
+        size_t count = index < buffer.size() ? std::min((size_t)size - 1, buffer.size() - index) : 0;
+        memcpy(buf, buffer.data() + index, count);
+        buf[count] = '\0';
+    }
+
+    const char* begin() const { return buffer.data(); }
+    const char* end() const { return buffer.data() + buffer.size(); }
+
+  private:
+    std::string buffer;
+
+    static int toIndex(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+    static std::string format(unsigned long long value, unsigned char base)
+    {
+        if (value == 0) {
+            return "0";
+        }
+        std::string digits;
+        while (value > 0) {
+            digits += "0123456789abcdefghijklmnopqrstuvwxyz"[value % base];
+            value /= base;
+        }
+        return std::string(digits.rbegin(), digits.rend());
+    }
+    static std::string formatSigned(long long value, unsigned char base)
+    {
+        if (base == 10 && value < 0) {
+            return "-" + format(-(unsigned long long)value, base);
+        }
+        // other bases: two's complement, like Arduino
+        return format(base == 10 ? value : (unsigned long)value, base);
+    }
+    static std::string formatFloat(double value, unsigned int decimals)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+        return buf;
+    }
+};
+
+inline String operator+(const String& a, const String& b)
+{
+    String result(a);
+    result += b;
+    return result;
+}
+inline String operator+(const String& a, const char* b)
+{
+    String result(a);
+    result += b;
+    return result;
+}
+inline String operator+(const char* a, const String& b)
+{
+    String result(a);
+    result += b;
+    return result;
+}
+inline String operator+(const String& a, char b)
+{
+    String result(a);
+    result += b;
+    return result;
+}
+template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+inline String operator+(const String& a, T b)
+{
+    String result(a);
+    result += String(b);
+    return result;
+}
+inline bool operator==(const char* a, const String& b)
+{
+    return b == a;
+}
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size)
+    {
+        size_t written = 0;
+        while (size-- > 0 && write(*buffer++) == 1) {
+            written++;
+        }
+        return written;
+    }
+    size_t write(const char* str) { return str != nullptr ? write((const uint8_t*)str, strlen(str)) : 0; }
+    size_t write(const char* buffer, size_t size) { return write((const uint8_t*)buffer, size); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const String& str) { return write((const uint8_t*)str.c_str(), str.length()); }
+    size_t print(const char* str) { return write(str); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(unsigned char value, int base = 10) { return print(String(value, base)); }
+    size_t print(int value, int base = 10) { return print(String(value, base)); }
+    size_t print(unsigned int value, int base = 10) { return print(String(value, base)); }
+    size_t print(long value, int base = 10) { return print(String(value, base)); }
+    size_t print(unsigned long value, int base = 10) { return print(String(value, base)); }
+    size_t print(long long value, int base = 10) { return print(String(value, base)); }
+    size_t print(unsigned long long value, int base = 10) { return print(String(value, base)); }
+    size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+    template <typename T>
+    size_t println(T value)
+    {
+        size_t written = print(value);
+        return written + println();
+    }
+    template <typename T>
+    size_t println(T value, int format)
+    {
+        size_t written = print(value, format);
+        return written + println();
+    }
+    size_t println() { return write("\r\n"); }
+    size_t printf(const char* format, ...)
+    {
+        char buf[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        if (length < 0) {
+            return 0;
+        }
+        if ((size_t)length < sizeof(buf)) {
+            return write((const uint8_t*)buf, length);
+        }
+        std::string text(length + 1, '\0');
+        va_start(args, format);
+        vsnprintf(&text[0], text.size(), format, args);
+        va_end(args);
+        return write((const uint8_t*)text.data(), length);
+    }
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { this->timeout = timeout; }
+    // no waiting: the host streams have their data at once
+    virtual size_t readBytes(char* buffer, size_t length)
+    {
+        size_t count = 0;
+        int c;
+        while (count < length && (c = read()) >= 0) {
+            buffer[count++] = (char)c;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+    String readString()
+    {
+        String str;
+        int c;
+        while ((c = read()) >= 0) {
+            str += (char)c;
+        }
+        return str;
+    }
+    String readStringUntil(char terminator)
+    {
+        String str;
+        int c;
+        while ((c = read()) >= 0 && c != terminator) {
+            str += (char)c;
+        }
+        return str;
+    }
+
+  protected:
+    unsigned long timeout = 1000;
+};
+
+// Serial port: the output goes to stdout (unless quiet), the input is fed by the tests
+class HardwareSerial : public Stream
+{
+  public:
+    void begin(unsigned long baud) {}
+    void end() {}
+    size_t setRxBufferSize(size_t size) { return size; }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        if (!quiet) {
+            fwrite(buffer, 1, size, stdout);
+        }
+        return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+
+    int available() override { return input.size() - inputPos; }
+    int read() override { return inputPos < input.size() ? (uint8_t)input[inputPos++] : -1; }
+    int peek() override { return inputPos < input.size() ? (uint8_t)input[inputPos] : -1; }
+    void feed(const std::string& data)
+    {
+        input.erase(0, inputPos);
+        inputPos = 0;
+        input += data;
+    }
+
+    bool quiet = false;
+
+  private:
+    std::string input;
+    size_t inputPos = 0;
+};
+extern HardwareSerial Serial;
+
+class IPAddress
+{
+  public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+    IPAddress(uint32_t address) : address(address) {}
+
+    operator uint32_t() const { return address; }
+    uint8_t operator[](int index) const { return (address >> (8 * index)) & 0xFF; }
+    bool operator==(const IPAddress& other) const { return address == other.address; }
+    bool operator!=(const IPAddress& other) const { return address != other.address; }
+
+    String toString() const { return String((*this)[0]) + "." + String((*this)[1]) + "." + String((*this)[2]) + "." + String((*this)[3]); }
+    bool fromString(const char* str)
+    {
+        unsigned int a, b, c, d;
+        char end;
+        if (sscanf(str, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+            return false;
+        }
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+    bool fromString(const String& str) { return fromString(str.c_str()); }
+
+  private:
+    uint32_t address = 0;
+};
+
+// Time: real (default) or manual, advanced by delay(). hostClockAdvance() moves both, it adds the
+// modelled duration of an emulated operation (flash write, ...) to what the code measures
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+void hostClockManual(bool manual);
+void hostClockAdvance(unsigned long us);
+
+// System time (esp32-hal-time): the host time, configTime() does nothing
+void configTime(long gmtOffset, int daylightOffset, const char* server1, const char* server2 = nullptr, const char* server3 = nullptr);
+bool getLocalTime(struct tm* info, uint32_t ms = 5000);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+inline bool isDigit(int c)
+{
+    return isdigit(c) != 0;
+}
+inline bool isSpace(int c)
+{
+    return isspace(c) != 0;
+}
+inline bool isAlpha(int c)
+{
+    return isalpha(c) != 0;
+}
+
+class EspClass
+{
+  public:
+    void restart() { restarts++; }  // recorded, the test decides what to do
+    uint32_t getFreeHeap() { return 200000; }
+    uint32_t getMaxFreeBlockSize() { return 100000; }
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getFlashChipSize() { return 4 * 1024 * 1024; }
+    uint32_t getSketchSize() { return 1024 * 1024; }
+    uint32_t getFreeSketchSpace() { return 1024 * 1024; }
+    uint64_t getEfuseMac() { return 0x0000AABBCCDDEEFFULL; }
+    const char* getChipModel() { return "host"; }
+    uint8_t getChipRevision() { return 0; }
+    uint8_t getChipCores() { return 1; }
+    String getResetReason() { return "host"; }
+
+    int restarts = 0;
+};
+extern EspClass ESP;
+
+#endif
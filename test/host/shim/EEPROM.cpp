@@ -0,0 +1,41 @@
+#include "EEPROM.h"
+
+EEPROMClass EEPROM;
+
+void EEPROMClass::begin(size_t size)
+{
+    std::string stored;
+    HostFlash::load("eeprom.bin", stored);
+    data.assign(size, 0xFF);
+    memcpy(data.data(), stored.data(), std::min(size, stored.size()));
+    dirty = false;
+}
+
+bool EEPROMClass::end()
+{
+    bool committed = commit();
+    data.clear();
+    return committed;
+}
+
+bool EEPROMClass::commit()
+{
+    if (data.empty()) {
+        return false;
+    }
+    if (!dirty) {
+        return true;
+    }
+    HostFlash::erase((data.size() + HOST_FLASH_SECTOR_SIZE - 1) / HOST_FLASH_SECTOR_SIZE);
+    HostFlash::program(data.size());
+    dirty = false;
+    return HostFlash::save("eeprom.bin", std::string(data.begin(), data.end()));
+}
+
+void EEPROMClass::write(int address, uint8_t value)
+{
+    if (address >= 0 && (size_t)address < data.size() && data[address] != value) {
+        data[address] = value;
+        dirty = true;
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include "HostFlash.h"
+#include <Arduino.h>
+#include <vector>
+
+/*
+EEPROMClass (ESP8266 core) emulation, persisted in <storageDir>/eeprom.bin: a RAM copy of the data,
+commit() erases the flash sectors and programs the whole size when the data was modified.
+Unwritten flash reads as 0xFF.
+*/
+class EEPROMClass
+{
+  public:
+    void begin(size_t size);
+    bool end();
+    bool commit();
+
+    uint8_t read(int address) { return address >= 0 && (size_t)address < data.size() ? data[address] : 0; }
+    void write(int address, uint8_t value);
+    uint8_t* getDataPtr()
+    {
+        dirty = true;
+        return data.data();
+    }
+    const uint8_t* getConstDataPtr() const { return data.data(); }
+    size_t length() { return data.size(); }
+
+  private:
+    std::vector<uint8_t> data;
+    bool dirty = false;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
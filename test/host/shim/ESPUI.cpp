@@ -0,0 +1,3 @@
+#include "ESPUI.h"
+
+ESPUIClass ESPUI;
@@ -0,0 +1,43 @@
+#ifndef HOST_ESPUI_H
+#define HOST_ESPUI_H
+
+// ESPUI without web interface: controls are numbered, callbacks are never called
+#include <Arduino.h>
+
+enum ControlType { Tab, Label, Button, Text, Number };
+enum ControlColor { Peterriver, None };
+#define B_DOWN -1
+#define B_UP 1
+
+class Control
+{
+  public:
+    String value;
+    uint16_t id = 0;
+    int type = 0;
+};
+
+class ESPUIClass
+{
+  public:
+    uint16_t addControl(ControlType type, const char* label, const String& value = "", ControlColor color = None, uint16_t parent = 0,
+                        std::function<void(Control*, int)> callback = nullptr)
+    {
+        return ++controls;
+    }
+    void setInputType(uint16_t id, const char* type) {}
+    void setEnabled(uint16_t id, bool enabled) {}
+    void updateLabel(uint16_t id, const String& value) {}
+    Control* getControl(uint16_t id)
+    {
+        control.id = id;
+        return &control;
+    }
+
+  private:
+    uint16_t controls = 0;
+    Control control;
+};
+extern ESPUIClass ESPUI;
+
+#endif
@@ -0,0 +1,50 @@
+#include "HostFlash.h"
+#include <fstream>
+#include <iterator>
+
+std::string HostFlash::storageDir = ".";
+HostFlashStats HostFlash::stats;
+
+void HostFlash::program(size_t bytes)
+{
+    unsigned long duration = (bytes * HOST_FLASH_PROGRAM_US + 255) / 256;
+    stats.programmedBytes += bytes;
+    stats.busyMicros += duration;
+    hostClockAdvance(duration);
+}
+
+void HostFlash::erase(size_t sectors)
+{
+    unsigned long duration = sectors * HOST_FLASH_ERASE_US;
+    stats.erasedSectors += sectors;
+    stats.busyMicros += duration;
+    hostClockAdvance(duration);
+}
+
+bool HostFlash::load(const std::string& name, std::string& data)
+{
+    if (storageDir.empty()) {
+        return false;
+    }
+    std::ifstream file(storageDir + "/" + name, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool HostFlash::save(const std::string& name, const std::string& data)
+{
+    if (storageDir.empty()) {
+        return true;
+    }
+    // written next to the file then renamed, like a committed flash write it is all or nothing
+    std::string path = storageDir + "/" + name;
+    std::ofstream file(path + ".tmp", std::ios::binary | std::ios::trunc);
+    if (!file.write(data.data(), data.size()) || !file.flush()) {
+        return false;
+    }
+    file.close();
+    return rename((path + ".tmp").c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,38 @@
+#ifndef HOST_FLASH_H
+#define HOST_FLASH_H
+
+#include <Arduino.h>
+#include <string>
+
+/*
+Flash cost model of the Preferences (NVS) and EEPROM emulations: the bytes programmed and the sectors
+erased are counted, and their typical SPI NOR timings are added to the clock with hostClockAdvance(),
+so the commit times measured with micros() by the framework include them.
+The emulated partitions are files in HostFlash::storageDir (kept in RAM only if it is empty).
+*/
+#define HOST_FLASH_SECTOR_SIZE 4096
+#define HOST_FLASH_PROGRAM_US 700   // per 256 bytes page
+#define HOST_FLASH_ERASE_US 45000   // per sector
+
+struct HostFlashStats {
+    uint64_t programmedBytes = 0;
+    uint32_t erasedSectors = 0;
+    uint64_t busyMicros = 0;  // modelled program + erase time
+};
+
+class HostFlash
+{
+  public:
+    static std::string storageDir;
+    static HostFlashStats stats;
+
+    static void program(size_t bytes);
+    static void erase(size_t sectors);
+    static void reset() { stats = HostFlashStats(); }
+
+    // Whole file read / replaced, false if it does not exist or cannot be written
+    static bool load(const std::string& name, std::string& data);
+    static bool save(const std::string& name, const std::string& data);
+};
+
+#endif
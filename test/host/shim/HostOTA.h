@@ -0,0 +1,58 @@
+#ifndef HOST_OTA_H
+#define HOST_OTA_H
+
+#include "esp_err.h"
+#include <string>
+#include <vector>
+
+/*
+Canned HTTP server and OTA partitions behind the esp_http_client / esp_ota_* shims (esp_idf.cpp).
+Each connection (esp_http_client_open) takes the next queued HostHttpResponse, or the default one
+when the queue is empty: the file of the URL, 200 or 206 for a Range request ("bytes=<offset>-").
+Reads return at most readChunk bytes. A read without data returns -ESP_ERR_HTTP_EAGAIN after
+advancing the clock by the client timeout, as the ESP-IDF 5 client does.
+*/
+struct HostHttpResponse {
+    esp_err_t openError = ESP_OK;   // connection failure
+    int status = 0;                 // 0: 200, or 206 from the Range offset, 404 if there is no such file
+    int64_t contentLength = -1;     // header, -1: length of the body sent, 0: not given (chunked)
+    std::string body;               // when status is set
+    size_t breakAfter = SIZE_MAX;   // body bytes before the connection is lost (read error)
+    size_t stallAfter = SIZE_MAX;   // body bytes before a pause of the server, without closing
+    unsigned long stallMs = 0;      // pause duration, 0: the server sends nothing more
+};
+
+struct HostHttpRequest {
+    std::string url;
+    std::string range;  // Range header, empty if none
+    unsigned long at;   // millis()
+};
+
+class HostHttp
+{
+  public:
+    static std::vector<std::pair<std::string, std::string>> files;  // url, content
+    static std::vector<HostHttpResponse> responses;                 // next connections
+    static std::vector<HostHttpRequest> requests;                   // received
+    static size_t readChunk;
+    static int openClients;  // initialized, not cleaned up yet
+
+    static void reset();
+};
+
+// Running partition (the delta source) and the partition written by esp_ota_*
+class HostOTA
+{
+  public:
+    static std::string running;
+    static std::string written;
+    static uint32_t partitionSize;
+    static bool validImage;  // esp_ota_end result
+    static bool bootSelected;
+    static int begins;
+    static int aborts;
+
+    static void reset();
+};
+
+#endif
@@ -0,0 +1,2 @@
+// Arduino core header included by PubSubClient
+#include <Arduino.h>
@@ -0,0 +1,20 @@
+#include "LittleFS.h"
+
+LittleFSClass LittleFS;
+
+// "r", "w" (truncated) or "a" (appended), as the LittleFS of the cores
+File LittleFSClass::open(const char* path, const char* mode)
+{
+    if (!hostMounted || (mode[0] == 'r' && files.count(path) == 0)) {
+        return File();
+    }
+    std::string& content = files[path];
+    if (mode[0] == 'w') {
+        content.clear();
+    }
+    File file(&content, mode[0] != 'r');
+    if (mode[0] == 'a') {
+        file.seek(content.size());
+    }
+    return file;
+}
@@ -0,0 +1,74 @@
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+/*
+File system kept in RAM, only mounted by the tests that set LittleFS.hostMounted: otherwise begin() fails,
+so the users fall back to RAM (e.g. no queue spill).
+*/
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+class File : public Stream
+{
+  public:
+    File() {}
+    File(std::string* content, bool writable) : content(content), writable(writable) {}
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        if (content == nullptr || !writable) {
+            return 0;
+        }
+        content->replace(pos, std::min(size, content->size() - pos), (const char*)buffer, size);
+        pos += size;
+        return size;
+    }
+    using Print::write;
+    int available() override { return content != nullptr ? content->size() - pos : 0; }
+    int read() override { return available() > 0 ? (uint8_t)(*content)[pos++] : -1; }
+    int read(uint8_t* buffer, size_t size)
+    {
+        size_t count = std::min(size, (size_t)available());
+        if (count > 0) {
+            memcpy(buffer, content->data() + pos, count);
+            pos += count;
+        }
+        return count;
+    }
+    int peek() override { return available() > 0 ? (uint8_t)(*content)[pos] : -1; }
+    bool seek(uint32_t pos)
+    {
+        if (content == nullptr || pos > content->size()) {
+            return false;
+        }
+        this->pos = pos;
+        return true;
+    }
+    size_t position() const { return pos; }
+    size_t size() const { return content != nullptr ? content->size() : 0; }
+    void close() { content = nullptr; }
+    operator bool() const { return content != nullptr; }
+
+  private:
+    std::string* content = nullptr;
+    bool writable = false;
+    size_t pos = 0;
+};
+
+class LittleFSClass
+{
+  public:
+    bool hostMounted = false;
+    std::map<std::string, std::string> files;
+
+    bool begin(bool formatOnFail = false) { return hostMounted; }
+    File open(const char* path, const char* mode);
+    File open(const String& path, const char* mode) { return open(path.c_str(), mode); }
+    bool exists(const char* path) { return hostMounted && files.count(path) > 0; }
+    bool remove(const char* path) { return hostMounted && files.erase(path) > 0; }
+};
+extern LittleFSClass LittleFS;
+
+#endif
@@ -0,0 +1,185 @@
+#include "Preferences.h"
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partition)
+{
+    this->name = name;
+    this->readOnly = readOnly;
+    entries.clear();
+    std::string data;
+    if (HostFlash::load(this->name + ".nvs", data)) {
+        // one entry per line: <type> <key> <value>, strings in hexadecimal
+        size_t pos = 0;
+        while (pos < data.size()) {
+            size_t end = data.find('\n', pos);
+            if (end == std::string::npos) {
+                end = data.size();
+            }
+            std::string line = data.substr(pos, end - pos);
+            pos = end + 1;
+            size_t keyEnd = line.find(' ', 2);
+            if (line.size() < 4 || keyEnd == std::string::npos) {
+                continue;
+            }
+            Entry entry;
+            entry.type = line[0] == 'i' ? PREF_INT : PREF_STRING;
+            entry.key = line.substr(2, keyEnd - 2);
+            std::string value = line.substr(keyEnd + 1);
+            entry.intValue = entry.type == PREF_INT ? strtol(value.c_str(), nullptr, 10) : 0;
+            for (size_t i = 0; entry.type == PREF_STRING && i + 1 < value.size(); i += 2) {
+                entry.stringValue += (char)strtol(value.substr(i, 2).c_str(), nullptr, 16);
+            }
+            entries.push_back(entry);
+        }
+    }
+    liveEntries = 0;
+    for (const Entry& entry : entries) {
+        liveEntries += entryCount(entry);
+    }
+    pageUsed = liveEntries % HOST_NVS_PAGE_ENTRIES;
+    freePages = HOST_NVS_PAGES - 1 - liveEntries / HOST_NVS_PAGE_ENTRIES;
+    started = true;
+    return true;
+}
+
+void Preferences::end()
+{
+    started = false;
+}
+
+size_t Preferences::putInt(const char* key, int32_t value)
+{
+    Entry entry{key, PREF_INT, value, ""};
+    return store(entry) ? sizeof(int32_t) : 0;
+}
+
+size_t Preferences::putString(const char* key, const char* value)
+{
+    Entry entry{key, PREF_STRING, 0, value};
+    return store(entry) ? entry.stringValue.size() : 0;
+}
+
+int32_t Preferences::getInt(const char* key, int32_t defaultValue)
+{
+    Entry* entry = find(key);
+    return entry != nullptr && entry->type == PREF_INT ? entry->intValue : defaultValue;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue)
+{
+    Entry* entry = find(key);
+    return entry != nullptr && entry->type == PREF_STRING ? String(entry->stringValue) : defaultValue;
+}
+
+bool Preferences::isKey(const char* key)
+{
+    return find(key) != nullptr;
+}
+
+bool Preferences::remove(const char* key)
+{
+    if (!started || readOnly || find(key) == nullptr) {
+        return false;
+    }
+    erase(key);
+    HostFlash::program(4);  // entry state bits of the page
+    return save();
+}
+
+bool Preferences::clear()
+{
+    if (!started || readOnly) {
+        return false;
+    }
+    while (!entries.empty()) {
+        erase(entries.front().key.c_str());
+        HostFlash::program(4);
+    }
+    return save();
+}
+
+size_t Preferences::freeEntries()
+{
+    return (freePages - 1) * HOST_NVS_PAGE_ENTRIES + HOST_NVS_PAGE_ENTRIES - pageUsed;
+}
+
+Preferences::Entry* Preferences::find(const char* key)
+{
+    for (Entry& entry : entries) {
+        if (entry.key == key) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+void Preferences::erase(const char* key)
+{
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].key == key) {
+            liveEntries -= entryCount(entries[i]);
+            entries.erase(entries.begin() + i);
+            return;
+        }
+    }
+}
+
+bool Preferences::store(const Entry& entry)
+{
+    if (!started || readOnly || entry.key.empty() || entry.key.size() > 15) {
+        return false;
+    }
+    size_t count = entryCount(entry);
+    erase(entry.key.c_str());
+    allocate(count);
+    HostFlash::program(count * HOST_NVS_ENTRY_SIZE);
+    entries.push_back(entry);
+    liveEntries += count;
+    return save();
+}
+
+// Room for count entries in the active page, moving to a new one when it is full
+void Preferences::allocate(size_t count)
+{
+    if (pageUsed + count <= HOST_NVS_PAGE_ENTRIES) {
+        pageUsed += count;
+        return;
+    }
+    if (freePages > 1) {
+        freePages--;
+        pageUsed = count;
+        return;
+    }
+    // garbage collection: the oldest page is erased after its live entries are copied to the free one
+    size_t moved = liveEntries / (HOST_NVS_PAGES - 1);
+    HostFlash::program(moved * HOST_NVS_ENTRY_SIZE);
+    HostFlash::erase(1);
+    pageUsed = moved + count;
+}
+
+size_t Preferences::entryCount(const Entry& entry)
+{
+    if (entry.type == PREF_INT) {
+        return 1;
+    }
+    return 1 + (entry.stringValue.size() + HOST_NVS_ENTRY_SIZE) / HOST_NVS_ENTRY_SIZE;  // header + data with its '\0'
+}
+
+bool Preferences::save()
+{
+    std::string data;
+    for (const Entry& entry : entries) {
+        data += entry.type == PREF_INT ? "i " : "s ";
+        data += entry.key + " ";
+        if (entry.type == PREF_INT) {
+            data += std::to_string(entry.intValue);
+        } else {
+            static const char* digits = "0123456789abcdef";
+            for (unsigned char c : entry.stringValue) {
+                data += digits[c >> 4];
+                data += digits[c & 0x0F];
+            }
+        }
+        data += '\n';
+    }
+    return HostFlash::save(name + ".nvs", data);
+}
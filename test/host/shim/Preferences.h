@@ -0,0 +1,68 @@
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include "HostFlash.h"
+#include <Arduino.h>
+#include <string>
+#include <vector>
+
+/*
+Preferences (ESP32 NVS) emulation, persisted in <storageDir>/<namespace>.nvs.
+NVS model: a value is appended to a 4 KB page as 32 bytes entries (one for an int, one header + the
+data for a string), its previous version is only marked erased. Once the pages are used, apart from
+the one kept free, each new page costs a garbage collection: a sector erase and the copy of its live
+entries.
+*/
+#define PREF_INT 1
+#define PREF_STRING 2
+
+#define HOST_NVS_PAGES 5          // 0x5000 bytes, the default nvs partition
+#define HOST_NVS_PAGE_ENTRIES 126
+#define HOST_NVS_ENTRY_SIZE 32
+
+class Preferences
+{
+  public:
+    bool begin(const char* name, bool readOnly = false, const char* partition = nullptr);
+    void end();
+
+    size_t putInt(const char* key, int32_t value);
+    size_t putString(const char* key, const char* value);
+    size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+    int32_t getInt(const char* key, int32_t defaultValue = 0);
+    String getString(const char* key, const String& defaultValue = String());
+
+    bool isKey(const char* key);
+    bool remove(const char* key);
+    bool clear();
+    size_t freeEntries();
+
+    // Iteration over the stored keys
+    int length() { return entries.size(); }
+    String key(int index) { return index < length() ? String(entries[index].key) : String(); }
+    int type(int index) { return index < length() ? entries[index].type : 0; }
+
+  private:
+    struct Entry {
+        std::string key;
+        int type;
+        int32_t intValue;
+        std::string stringValue;
+    };
+    std::string name;
+    bool readOnly = false;
+    bool started = false;
+    std::vector<Entry> entries;  // in write order, as NVS finds them
+    size_t pageUsed = 0;         // entries of the active page
+    size_t freePages = HOST_NVS_PAGES - 1;
+    size_t liveEntries = 0;
+
+    Entry* find(const char* key);
+    void erase(const char* key);
+    bool store(const Entry& entry);
+    void allocate(size_t count);
+    static size_t entryCount(const Entry& entry);
+    bool save();
+};
+
+#endif
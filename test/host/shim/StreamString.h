@@ -0,0 +1,36 @@
+#ifndef HOST_STREAMSTRING_H
+#define HOST_STREAMSTRING_H
+
+#include <Arduino.h>
+
+// A String that can be printed to and read from (the reads consume the front of the string)
+class StreamString : public Stream, public String
+{
+  public:
+    size_t write(uint8_t c) override
+    {
+        concat((char)c);
+        return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override
+    {
+        concat((const char*)buffer, size);
+        return size;
+    }
+    using Print::write;
+    int availableForWrite() override { return 4096; }
+
+    int available() override { return length(); }
+    int read() override
+    {
+        if (length() == 0) {
+            return -1;
+        }
+        int c = (uint8_t)charAt(0);
+        remove(0, 1);
+        return c;
+    }
+    int peek() override { return length() > 0 ? (uint8_t)charAt(0) : -1; }
+};
+
+#endif
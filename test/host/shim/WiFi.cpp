@@ -0,0 +1,316 @@
+#include "WiFi.h"
+#include <map>
+
+WiFiClass WiFi;
+
+static std::map<uint16_t, HostServer*> servers;
+
+HostServer::HostServer(uint16_t port) : port(port)
+{
+    servers[port] = this;
+}
+
+HostServer::~HostServer()
+{
+    servers.erase(port);
+}
+
+HostServer* HostServer::find(uint16_t port)
+{
+    auto it = servers.find(port);
+    return it != servers.end() ? it->second : nullptr;
+}
+
+void HostServer::send(const uint8_t* data, size_t size)
+{
+    if (open) {
+        output.append((const char*)data, size);
+    }
+}
+
+void HostServer::close()
+{
+    open = false;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    stop();
+    HostServer* found = HostServer::find(port);
+    if (found == nullptr || found->open || !found->accept()) {
+        return 0;
+    }
+    server = found;
+    server->open = true;
+    server->output.clear();
+    server->outputPos = 0;
+    return 1;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port)
+{
+    return connect(IPAddress(127, 0, 0, 1), port);
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size)
+{
+    if (server == nullptr || !server->open) {
+        return 0;
+    }
+    server->receive(buf, size);
+    return size;
+}
+
+int WiFiClient::available()
+{
+    return server != nullptr ? server->output.size() - server->outputPos : 0;
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size)
+{
+    size_t count = std::min(size, (size_t)available());
+    if (count == 0) {
+        return -1;
+    }
+    memcpy(buf, server->output.data() + server->outputPos, count);
+    server->outputPos += count;
+    if (server->outputPos == server->output.size()) {
+        server->output.clear();
+        server->outputPos = 0;
+    }
+    return count;
+}
+
+int WiFiClient::peek()
+{
+    return available() > 0 ? (uint8_t)server->output[server->outputPos] : -1;
+}
+
+void WiFiClient::stop()
+{
+    if (server != nullptr) {
+        bool wasOpen = server->open;
+        server->open = false;
+        if (wasOpen) {
+            server->closed();
+        }
+        server = nullptr;
+    }
+}
+
+uint8_t WiFiClient::connected()
+{
+    // like a socket, the data received before the close can still be read
+    return server != nullptr && (server->open || available() > 0);
+}
+
+void WiFiClass::hostProcess()
+{
+    if (associating && millis() - beginAt >= hostDelay) {
+        associating = false;
+        associate();
+    }
+    if (scanning && millis() - scanAt >= hostDelay) {
+        scanning = false;
+        scanDone = true;
+        scanResults = accessPoints;
+    }
+    // the handlers may call the driver again: events queued meanwhile wait for the next call
+    std::vector<Event> pending;
+    pending.swap(events);
+    for (const Event& event : pending) {
+        arduino_event_info_t info = {};
+        info.wifi_sta_disconnected.reason = event.reason;
+        std::vector<Handler> called = handlers;
+        for (const Handler& handler : called) {
+            if (handler.event == ARDUINO_EVENT_MAX || handler.event == event.event) {
+                handler.callback(event.event, info);
+            }
+        }
+    }
+}
+
+// Strongest access point of the network, or the one of the BSSID hint on its channel
+void WiFiClass::associate()
+{
+    int found = -1;
+    for (size_t i = 0; i < accessPoints.size(); i++) {
+        const HostAccessPoint& ap = accessPoints[i];
+        if (ap.ssid != beginSSID) {
+            continue;
+        }
+        if (beginBssid && (memcmp(ap.bssid, hintBssid, sizeof(hintBssid)) != 0 || (beginChannel > 0 && ap.channel != beginChannel))) {
+            continue;
+        }
+        if (found < 0 || ap.rssi > accessPoints[found].rssi) {
+            found = i;
+        }
+    }
+    if (found < 0) {
+        state = WL_NO_SSID_AVAIL;
+        events.push_back({ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_NO_AP_FOUND});
+    } else if (accessPoints[found].password != password) {
+        state = WL_CONNECT_FAILED;
+        events.push_back({ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_AUTH_FAIL});
+    } else {
+        state = WL_CONNECTED;
+        current = found;
+        events.push_back({ARDUINO_EVENT_WIFI_STA_CONNECTED, 0});
+        events.push_back({ARDUINO_EVENT_WIFI_STA_GOT_IP, 0});
+    }
+}
+
+void WiFiClass::hostDrop(uint8_t reason)
+{
+    if (state == WL_CONNECTED) {
+        state = WL_DISCONNECTED;
+        current = -1;
+        events.push_back({ARDUINO_EVENT_WIFI_STA_DISCONNECTED, reason});
+    }
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventFuncCb callback, arduino_event_id_t event)
+{
+    handlers.push_back({nextHandler, event, callback});
+    return nextHandler++;
+}
+
+void WiFiClass::removeEvent(wifi_event_id_t id)
+{
+    for (auto it = handlers.begin(); it != handlers.end(); ++it) {
+        if (it->id == id) {
+            handlers.erase(it);
+            return;
+        }
+    }
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase, int32_t channel, const uint8_t* bssid, bool connect)
+{
+    disconnect();  // the current association ends with WIFI_REASON_ASSOC_LEAVE
+    begins++;
+    beginSSID = ssid;
+    password = passphrase != nullptr ? passphrase : "";
+    beginChannel = channel;
+    beginBssid = bssid != nullptr;
+    if (bssid != nullptr) {
+        memcpy(hintBssid, bssid, sizeof(hintBssid));
+    }
+    associating = connect;
+    beginAt = millis();
+    return state;
+}
+
+bool WiFiClass::config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2)
+{
+    staticIP = localIP;
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAP)
+{
+    if (state == WL_CONNECTED) {
+        events.push_back({ARDUINO_EVENT_WIFI_STA_DISCONNECTED, WIFI_REASON_ASSOC_LEAVE});
+    }
+    state = WL_DISCONNECTED;
+    current = -1;
+    associating = false;
+    return true;
+}
+
+bool WiFiClass::mode(WiFiMode_t mode)
+{
+    currentMode = mode;
+    return true;
+}
+
+bool WiFiClass::softAP(const char* ssid, const char* passphrase)
+{
+    currentMode = (WiFiMode_t)(currentMode | WIFI_AP);
+    return true;
+}
+
+int16_t WiFiClass::scanNetworks(bool async, bool showHidden)
+{
+    if (!scanning) {
+        scanning = true;
+        scanDone = false;
+        scanAt = millis();
+    }
+    return WIFI_SCAN_RUNNING;
+}
+
+int16_t WiFiClass::scanComplete()
+{
+    if (scanning) {
+        return WIFI_SCAN_RUNNING;
+    }
+    return scanDone ? scanResults.size() : WIFI_SCAN_FAILED;
+}
+
+bool WiFiClass::getNetworkInfo(uint8_t index, String& ssid, uint8_t& encryptionType, int32_t& rssi, uint8_t*& bssid, int32_t& channel)
+{
+    if (index >= scanResults.size()) {
+        return false;
+    }
+    HostAccessPoint& ap = scanResults[index];
+    ssid = ap.ssid;
+    encryptionType = 3;  // WPA2 PSK
+    rssi = ap.rssi;
+    bssid = ap.bssid;
+    channel = ap.channel;
+    return true;
+}
+
+String WiFiClass::SSID()
+{
+    return current >= 0 ? accessPoints[current].ssid : String("");
+}
+
+String WiFiClass::psk()
+{
+    return current >= 0 ? password : String("");
+}
+
+uint8_t* WiFiClass::BSSID()
+{
+    return current >= 0 ? accessPoints[current].bssid : nullptr;
+}
+
+String WiFiClass::BSSIDstr()
+{
+    const uint8_t* bssid = BSSID();
+    if (bssid == nullptr) {
+        return "";
+    }
+    char text[18];
+    snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5]);
+    return text;
+}
+
+int32_t WiFiClass::channel()
+{
+    return current >= 0 ? accessPoints[current].channel : 0;
+}
+
+int8_t WiFiClass::RSSI()
+{
+    return current >= 0 ? accessPoints[current].rssi : 0;
+}
+
+IPAddress WiFiClass::localIP()
+{
+    if (state != WL_CONNECTED) {
+        return IPAddress((uint32_t)0);
+    }
+    if (current < 0) {
+        return IPAddress(127, 0, 0, 1);
+    }
+    return (uint32_t)staticIP != 0 ? staticIP : IPAddress(192, 168, 1, 100);
+}
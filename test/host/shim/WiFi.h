@@ -0,0 +1,225 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+WiFi for the host: WiFiClient reaches an in-process HostServer registered on the port it connects
+to, instead of a socket (the address is ignored). The server handles the bytes written by the client
+synchronously, in receive(), and its answer is read back by the client.
+*/
+class HostServer
+{
+  public:
+    explicit HostServer(uint16_t port);
+    virtual ~HostServer();
+
+    static HostServer* find(uint16_t port);
+
+    // a client connects, false to refuse it
+    virtual bool accept() { return true; }
+    // bytes written by the client
+    virtual void receive(const uint8_t* data, size_t size) = 0;
+    // the client closed the connection
+    virtual void closed() {}
+
+    void send(const uint8_t* data, size_t size);  // to the client
+    void close();                                 // close the client connection
+    bool isOpen() { return open; }
+
+  private:
+    friend class WiFiClient;
+    uint16_t port;
+    bool open = false;
+    std::string output;  // not read by the client yet
+    size_t outputPos = 0;
+};
+
+class WiFiClient : public Client
+{
+  public:
+    ~WiFiClient() { stop(); }
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t timeout) { return connect(ip, port); }
+    int connect(const char* host, uint16_t port, int32_t timeout) { return connect(host, port); }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t* buf, size_t size) override;
+    using Print::write;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+    void setNoDelay(bool noDelay) {}
+    IPAddress remoteIP() { return IPAddress(127, 0, 0, 1); }
+    int fd() { return -1; }
+
+  private:
+    HostServer* server = nullptr;
+};
+
+// Telnet server: never has a client on the host
+class WiFiServer
+{
+  public:
+    explicit WiFiServer(uint16_t port) {}
+    void begin() {}
+    void stop() {}
+    void setNoDelay(bool noDelay) {}
+    bool hasClient() { return false; }
+    WiFiClient accept() { return WiFiClient(); }
+};
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+// esp_wifi_types.h
+#define WIFI_REASON_ASSOC_LEAVE 8
+#define WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT 15
+#define WIFI_REASON_BEACON_TIMEOUT 200
+#define WIFI_REASON_NO_AP_FOUND 201
+#define WIFI_REASON_AUTH_FAIL 202
+#define WIFI_REASON_HANDSHAKE_TIMEOUT 204
+
+typedef enum {
+    ARDUINO_EVENT_WIFI_STA_CONNECTED,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP,
+    ARDUINO_EVENT_WIFI_STA_LOST_IP,
+    ARDUINO_EVENT_MAX
+} arduino_event_id_t;
+
+typedef union {
+    struct {
+        uint8_t ssid[32];
+        uint8_t ssid_len;
+        uint8_t bssid[6];
+        uint8_t reason;
+    } wifi_sta_disconnected;
+} arduino_event_info_t;
+
+typedef size_t wifi_event_id_t;
+typedef std::function<void(arduino_event_id_t event, arduino_event_info_t info)> WiFiEventFuncCb;
+
+// Access point in range of the simulated station
+struct HostAccessPoint {
+    String ssid;
+    String password;
+    uint8_t bssid[6];
+    int32_t channel;
+    int32_t rssi;
+};
+
+/*
+Simulated station driver (ESP32 Arduino API). Connected to the host network until begin() or
+disconnect() is called, so that the code which only checks the link works unchanged. begin() and
+scanNetworks() complete asynchronously: hostProcess(), the driver task, resolves them against
+accessPoints once hostDelay ms elapsed and calls the onEvent() handlers, as the driver does from
+its own context.
+*/
+class WiFiClass
+{
+  public:
+    std::vector<HostAccessPoint> accessPoints;
+    unsigned long hostDelay = 500;  // ms to associate, or to scan
+
+    // calls to begin(): network, hints and static configuration of the last one
+    uint32_t begins = 0;
+    String beginSSID;
+    int32_t beginChannel = 0;
+    bool beginBssid = false;
+    IPAddress staticIP;
+
+    void hostProcess();
+    // link lost (AP gone, out of range): disconnection event with reason
+    void hostDrop(uint8_t reason = WIFI_REASON_BEACON_TIMEOUT);
+    size_t hostHandlers() { return handlers.size(); }  // registered with onEvent()
+
+    wifi_event_id_t onEvent(WiFiEventFuncCb callback, arduino_event_id_t event = ARDUINO_EVENT_MAX);
+    void removeEvent(wifi_event_id_t id);
+
+    wl_status_t begin(const char* ssid, const char* passphrase = nullptr, int32_t channel = 0, const uint8_t* bssid = nullptr, bool connect = true);
+    bool config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1 = (uint32_t)0, IPAddress dns2 = (uint32_t)0);
+    bool disconnect(bool wifiOff = false, bool eraseAP = false);
+    bool isConnected() { return status() == WL_CONNECTED; }
+    wl_status_t status() { return state; }
+
+    bool mode(WiFiMode_t mode);
+    WiFiMode_t getMode() { return currentMode; }
+    bool softAP(const char* ssid, const char* passphrase = nullptr);
+    bool softAPConfig(IPAddress localIP, IPAddress gateway, IPAddress subnet) { return true; }
+    bool softAPdisconnect(bool wifiOff = false) { return true; }
+
+    int16_t scanNetworks(bool async = false, bool showHidden = false);
+    int16_t scanComplete();
+    void scanDelete() { scanResults.clear(); }
+    bool getNetworkInfo(uint8_t index, String& ssid, uint8_t& encryptionType, int32_t& rssi, uint8_t*& bssid, int32_t& channel);
+
+    String SSID();
+    String psk();
+    uint8_t* BSSID();
+    String BSSIDstr();
+    int32_t channel();
+    int8_t RSSI();
+    String macAddress() { return "24:0A:C4:00:00:01"; }
+    IPAddress localIP();
+    IPAddress gatewayIP() { return IPAddress(192, 168, 1, 1); }
+    IPAddress subnetMask() { return IPAddress(255, 255, 255, 0); }
+    IPAddress dnsIP() { return IPAddress(192, 168, 1, 1); }
+
+  private:
+    struct Handler {
+        wifi_event_id_t id;
+        arduino_event_id_t event;  // ARDUINO_EVENT_MAX: all
+        WiFiEventFuncCb callback;
+    };
+    struct Event {
+        arduino_event_id_t event;
+        uint8_t reason;
+    };
+
+    wl_status_t state = WL_CONNECTED;
+    WiFiMode_t currentMode = WIFI_STA;
+    int current = -1;  // associated access point, -1 on the host network or disconnected
+    String password;
+    bool associating = false;
+    unsigned long beginAt = 0;
+    uint8_t hintBssid[6];
+    bool scanning = false;
+    bool scanDone = false;
+    unsigned long scanAt = 0;
+    std::vector<HostAccessPoint> scanResults;
+    wifi_event_id_t nextHandler = 1;
+    std::vector<Handler> handlers;
+    std::vector<Event> events;  // delivered by hostProcess()
+
+    void associate();
+};
+extern WiFiClass WiFi;
+
+#endif
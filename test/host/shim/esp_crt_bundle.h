@@ -0,0 +1,12 @@
+#ifndef HOST_ESP_CRT_BUNDLE_H
+#define HOST_ESP_CRT_BUNDLE_H
+
+#include "esp_err.h"
+
+// No TLS on the host: the bundle is accepted and never used
+inline esp_err_t esp_crt_bundle_attach(void* conf)
+{
+    return ESP_OK;
+}
+
+#endif
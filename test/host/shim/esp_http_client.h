@@ -0,0 +1,29 @@
+#ifndef HOST_ESP_HTTP_CLIENT_H
+#define HOST_ESP_HTTP_CLIENT_H
+
+#include "esp_err.h"
+#include <stddef.h>
+
+// esp_http_client, the fields and functions used by the OTA backends (shim/esp_idf.cpp)
+typedef struct esp_http_client* esp_http_client_handle_t;
+
+typedef struct {
+    const char* url;
+    esp_err_t (*crt_bundle_attach)(void* conf);
+    int timeout_ms;
+    int buffer_size;
+    bool keep_alive_enable;
+} esp_http_client_config_t;
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t* config);
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char* key, const char* value);
+esp_err_t esp_http_client_set_timeout_ms(esp_http_client_handle_t client, int timeout_ms);
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len);
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client);
+int esp_http_client_get_status_code(esp_http_client_handle_t client);
+int esp_http_client_read(esp_http_client_handle_t client, char* buffer, int len);
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client);
+esp_err_t esp_http_client_close(esp_http_client_handle_t client);
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client);
+
+#endif
@@ -0,0 +1,304 @@
+#include "esp_http_client.h"
+#include "esp_https_ota.h"
+#include "esp_ota_ops.h"
+#include "HostOTA.h"
+#include <Arduino.h>
+#include <algorithm>
+#include <cstring>
+
+/*
+ESP-IDF functions of the OTA backends: esp_http_client against the canned server of HostOTA.h, esp_ota_*
+on in-memory partitions. esp_https_ota (EspHttpsOTABackend) is not simulated, it always fails to connect.
+*/
+
+const char* esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:
+            return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_OTA_VALIDATE_FAILED:
+            return "ESP_ERR_OTA_VALIDATE_FAILED";
+        case ESP_ERR_HTTP_CONNECT:
+            return "ESP_ERR_HTTP_CONNECT";
+        case ESP_ERR_HTTP_EAGAIN:
+            return "ESP_ERR_HTTP_EAGAIN";
+        case ESP_ERR_HTTPS_OTA_IN_PROGRESS:
+            return "ESP_ERR_HTTPS_OTA_IN_PROGRESS";
+        default:
+            return "UNKNOWN ERROR";
+    }
+}
+
+std::vector<std::pair<std::string, std::string>> HostHttp::files;
+std::vector<HostHttpResponse> HostHttp::responses;
+std::vector<HostHttpRequest> HostHttp::requests;
+size_t HostHttp::readChunk = 1460;  // one TCP segment
+int HostHttp::openClients = 0;
+
+void HostHttp::reset()
+{
+    files.clear();
+    responses.clear();
+    requests.clear();
+    readChunk = 1460;
+}
+
+struct esp_http_client {
+    std::string url;
+    std::string range;
+    int timeoutMs;
+    bool open = false;
+    HostHttpResponse response;
+    int status = 0;
+    int64_t contentLength = 0;
+    size_t sent = 0;
+    bool stalled = false;
+    unsigned long stallStart = 0;
+};
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t* config)
+{
+    esp_http_client* client = new esp_http_client();
+    client->url = config->url;
+    client->timeoutMs = config->timeout_ms;
+    HostHttp::openClients++;
+    return client;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char* key, const char* value)
+{
+    if (strcmp(key, "Range") == 0) {
+        client->range = value;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_timeout_ms(esp_http_client_handle_t client, int timeout_ms)
+{
+    client->timeoutMs = timeout_ms;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    HostHttp::requests.push_back({client->url, client->range, millis()});
+    if (!HostHttp::responses.empty()) {
+        client->response = HostHttp::responses.front();
+        HostHttp::responses.erase(HostHttp::responses.begin());
+    } else {
+        client->response = HostHttpResponse();
+    }
+    HostHttpResponse& response = client->response;
+    if (response.openError != ESP_OK) {
+        return response.openError;
+    }
+    client->open = true;
+    client->sent = 0;
+    client->status = response.status;
+    if (client->status == 0) {
+        auto file = std::find_if(HostHttp::files.begin(), HostHttp::files.end(), [client](const std::pair<std::string, std::string>& file) { return file.first == client->url; });
+        size_t offset = client->range.empty() ? 0 : strtoul(client->range.c_str() + strlen("bytes="), nullptr, 10);
+        if (file == HostHttp::files.end()) {
+            client->status = 404;
+        } else if (offset > file->second.size()) {
+            client->status = 416;
+        } else {
+            client->status = client->range.empty() ? 200 : 206;
+            response.body = file->second.substr(offset);
+        }
+    }
+    client->contentLength = response.contentLength >= 0 ? response.contentLength : (int64_t)response.body.size();
+    return ESP_OK;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    return client->open ? client->contentLength : ESP_FAIL;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->open ? client->status : 0;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char* buffer, int len)
+{
+    const HostHttpResponse& response = client->response;
+    if (!client->open || client->sent >= response.breakAfter) {
+        return ESP_FAIL;
+    }
+    if (client->sent >= response.stallAfter && !client->stalled) {
+        client->stalled = true;
+        client->stallStart = millis();
+    }
+    bool paused = client->stalled && (response.stallMs == 0 || millis() - client->stallStart < response.stallMs);
+    // nothing to send for now, or less sent than announced: the read times out
+    if (paused || (client->sent >= response.body.size() && (int64_t)client->sent < client->contentLength)) {
+        hostClockAdvance(client->timeoutMs * 1000UL);
+        return -ESP_ERR_HTTP_EAGAIN;
+    }
+    size_t pending = client->stalled ? response.body.size() : std::min(response.stallAfter, response.body.size());
+    size_t count = std::min({(size_t)len, HostHttp::readChunk, pending - client->sent, response.breakAfter - client->sent});
+    memcpy(buffer, response.body.data() + client->sent, count);
+    client->sent += count;
+    return count;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client)
+{
+    return client->open && client->sent >= client->response.body.size() && (int64_t)client->sent >= client->contentLength;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    client->open = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    HostHttp::openClients--;
+    delete client;
+    return ESP_OK;
+}
+
+esp_err_t esp_https_ota_begin(const esp_https_ota_config_t* ota_config, esp_https_ota_handle_t* handle)
+{
+    *handle = nullptr;
+    return ESP_ERR_HTTP_CONNECT;
+}
+
+esp_err_t esp_https_ota_perform(esp_https_ota_handle_t handle)
+{
+    return ESP_ERR_INVALID_ARG;
+}
+
+bool esp_https_ota_is_complete_data_received(esp_https_ota_handle_t handle)
+{
+    return false;
+}
+
+esp_err_t esp_https_ota_finish(esp_https_ota_handle_t handle)
+{
+    return ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t esp_https_ota_abort(esp_https_ota_handle_t handle)
+{
+    return ESP_OK;
+}
+
+int esp_https_ota_get_image_len_read(esp_https_ota_handle_t handle)
+{
+    return 0;
+}
+
+int esp_https_ota_get_image_size(esp_https_ota_handle_t handle)
+{
+    return 0;
+}
+
+std::string HostOTA::running;
+std::string HostOTA::written;
+uint32_t HostOTA::partitionSize = 0x180000;
+bool HostOTA::validImage = true;
+bool HostOTA::bootSelected = false;
+int HostOTA::begins = 0;
+int HostOTA::aborts = 0;
+
+static esp_partition_t runningPartition = {0x10000, 0, "app0"};
+static esp_partition_t updatePartition = {0x190000, 0, "app1"};
+static bool otaWriting = false;
+
+void HostOTA::reset()
+{
+    written.clear();
+    validImage = true;
+    bootSelected = false;
+    begins = 0;
+    aborts = 0;
+    otaWriting = false;
+}
+
+const esp_partition_t* esp_ota_get_running_partition()
+{
+    runningPartition.size = HostOTA::partitionSize;
+    return &runningPartition;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from)
+{
+    updatePartition.size = HostOTA::partitionSize;
+    return &updatePartition;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle)
+{
+    if (partition != &updatePartition) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostOTA::written.clear();
+    HostOTA::begins++;
+    otaWriting = true;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size)
+{
+    if (!otaWriting) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (HostOTA::written.size() + size > HostOTA::partitionSize) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    HostOTA::written.append((const char*)data, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    if (!otaWriting) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    otaWriting = false;
+    return HostOTA::validImage && !HostOTA::written.empty() ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    HostOTA::aborts++;
+    otaWriting = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition)
+{
+    if (partition != &updatePartition || otaWriting) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostOTA::bootSelected = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size)
+{
+    const std::string& content = partition == &runningPartition ? HostOTA::running : HostOTA::written;
+    if (src_offset + size > content.size()) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, content.data() + src_offset, size);
+    return ESP_OK;
+}
@@ -0,0 +1,8 @@
+#ifndef HOST_ESP_IDF_VERSION_H
+#define HOST_ESP_IDF_VERSION_H
+
+// The shims follow ESP-IDF 5 (non-blocking reads of esp_http_client)
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(5, 1, 0)
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef HOST_ESP_OTA_OPS_H
+#define HOST_ESP_OTA_OPS_H
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+// esp_ota_*, the functions used by the OTA backends (shim/esp_idf.cpp)
+typedef uint32_t esp_ota_handle_t;
+
+#define OTA_SIZE_UNKNOWN 0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES 0xfffffffe
+
+const esp_partition_t* esp_ota_get_running_partition();
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+
+#endif
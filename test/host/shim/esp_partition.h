@@ -0,0 +1,15 @@
+#ifndef HOST_ESP_PARTITION_H
+#define HOST_ESP_PARTITION_H
+
+#include "esp_err.h"
+#include <stddef.h>
+
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef HOST_LWIP_DNS_H
+#define HOST_LWIP_DNS_H
+
+// No resolver on the host: only numeric addresses, which the callers parse themselves
+#include "ip_addr.h"
+
+typedef void (*dns_found_callback)(const char* name, const ip_addr_t* ipaddr, void* callback_arg);
+
+inline err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg)
+{
+    return ERR_ARG;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef HOST_LWIP_IP_ADDR_H
+#define HOST_LWIP_IP_ADDR_H
+
+#include <cstdint>
+
+typedef int8_t err_t;
+#define ERR_OK 0
+#define ERR_INPROGRESS -5
+#define ERR_ARG -16
+
+typedef struct {
+    uint32_t addr;
+} ip4_addr_t;
+typedef struct {
+    ip4_addr_t u_addr;
+} ip_addr_t;
+#define ip_2_ip4(ipaddr) (&(ipaddr)->u_addr)
+#define ip4_addr_get_u32(ip4addr) ((ip4addr)->addr)
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef HOST_LWIP_SOCKETS_H
+#define HOST_LWIP_SOCKETS_H
+
+// BSD sockets of the host (the WiFiClient shim has no descriptor, fd() is -1)
+#include <errno.h>
+#include <sys/socket.h>
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef HOST_LWIP_TCPIP_H
+#define HOST_LWIP_TCPIP_H
+
+#define LOCK_TCPIP_CORE()
+#define UNLOCK_TCPIP_CORE()
+
+#endif
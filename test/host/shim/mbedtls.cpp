@@ -0,0 +1,81 @@
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+
+#define HOST_MBEDTLS_ERROR -1
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx)
+{
+    ctx->md = EVP_MD_CTX_new();
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx)
+{
+    EVP_MD_CTX_free((EVP_MD_CTX*)ctx->md);
+    ctx->md = nullptr;
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224)
+{
+    return EVP_DigestInit_ex((EVP_MD_CTX*)ctx->md, is224 ? EVP_sha224() : EVP_sha256(), nullptr) == 1 ? 0 : HOST_MBEDTLS_ERROR;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t length)
+{
+    return EVP_DigestUpdate((EVP_MD_CTX*)ctx->md, input, length) == 1 ? 0 : HOST_MBEDTLS_ERROR;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char output[32])
+{
+    return EVP_DigestFinal_ex((EVP_MD_CTX*)ctx->md, output, nullptr) == 1 ? 0 : HOST_MBEDTLS_ERROR;
+}
+
+int mbedtls_sha256(const unsigned char* input, size_t length, unsigned char output[32], int is224)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    int ret = mbedtls_sha256_starts(&ctx, is224);
+    if (ret == 0) {
+        ret = mbedtls_sha256_update(&ctx, input, length);
+    }
+    if (ret == 0) {
+        ret = mbedtls_sha256_finish(&ctx, output);
+    }
+    mbedtls_sha256_free(&ctx);
+    return ret;
+}
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx)
+{
+    ctx->key = nullptr;
+}
+
+void mbedtls_pk_free(mbedtls_pk_context* ctx)
+{
+    EVP_PKEY_free((EVP_PKEY*)ctx->key);
+    ctx->key = nullptr;
+}
+
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t length)
+{
+    BIO* bio = BIO_new_mem_buf(key, (int)length);
+    ctx->key = PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr);
+    BIO_free(bio);
+    return ctx->key != nullptr ? 0 : HOST_MBEDTLS_ERROR;
+}
+
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md, const unsigned char* hash, size_t hashLength, const unsigned char* signature,
+                      size_t signatureLength)
+{
+    if (ctx->key == nullptr || md != MBEDTLS_MD_SHA256) {
+        return HOST_MBEDTLS_ERROR;
+    }
+    EVP_PKEY_CTX* verify = EVP_PKEY_CTX_new((EVP_PKEY*)ctx->key, nullptr);
+    int ret = verify != nullptr && EVP_PKEY_verify_init(verify) == 1 && EVP_PKEY_CTX_set_signature_md(verify, EVP_sha256()) == 1 &&
+                      EVP_PKEY_verify(verify, signature, signatureLength, hash, hashLength) == 1
+                  ? 0
+                  : HOST_MBEDTLS_ERROR;
+    EVP_PKEY_CTX_free(verify);
+    return ret;
+}
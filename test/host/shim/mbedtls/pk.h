@@ -0,0 +1,22 @@
+#ifndef HOST_MBEDTLS_PK_H
+#define HOST_MBEDTLS_PK_H
+
+// mbedtls public key verification, implemented with OpenSSL (shim/mbedtls.cpp)
+#include <stddef.h>
+
+typedef enum {
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_SHA256 = 6
+} mbedtls_md_type_t;
+
+typedef struct {
+    void* key;
+} mbedtls_pk_context;
+
+void mbedtls_pk_init(mbedtls_pk_context* ctx);
+void mbedtls_pk_free(mbedtls_pk_context* ctx);
+int mbedtls_pk_parse_public_key(mbedtls_pk_context* ctx, const unsigned char* key, size_t length);  // PEM, length includes the '\0'
+int mbedtls_pk_verify(mbedtls_pk_context* ctx, mbedtls_md_type_t md, const unsigned char* hash, size_t hashLength, const unsigned char* signature,
+                      size_t signatureLength);
+
+#endif
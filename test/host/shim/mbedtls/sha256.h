@@ -0,0 +1,19 @@
+#ifndef HOST_MBEDTLS_SHA256_H
+#define HOST_MBEDTLS_SHA256_H
+
+// mbedtls SHA-256, implemented with OpenSSL (shim/mbedtls.cpp)
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    void* md;
+} mbedtls_sha256_context;
+
+void mbedtls_sha256_init(mbedtls_sha256_context* ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context* ctx);
+int mbedtls_sha256_starts(mbedtls_sha256_context* ctx, int is224);
+int mbedtls_sha256_update(mbedtls_sha256_context* ctx, const unsigned char* input, size_t length);
+int mbedtls_sha256_finish(mbedtls_sha256_context* ctx, unsigned char output[32]);
+int mbedtls_sha256(const unsigned char* input, size_t length, unsigned char output[32], int is224);
+
+#endif
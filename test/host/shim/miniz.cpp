@@ -0,0 +1,57 @@
+#include "rom/miniz.h"
+#include <zlib.h>
+
+/*
+zlib keeps its own 32 KB window, so the caller's window only receives the output. The stream is
+created on the first call after tinfl_init() and released when the inflate ends or fails (the
+decoder frees the tinfl_decompressor with free(), an abandoned stream leaks).
+*/
+static tinfl_status finish(tinfl_decompressor* r, tinfl_status status)
+{
+    z_stream* stream = (z_stream*)r->m_stream;
+    inflateEnd(stream);
+    delete stream;
+    r->m_stream = nullptr;
+    r->m_state = 2;
+    return status;
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* in, size_t* inSize, mz_uint8* outStart, mz_uint8* outNext, size_t* outSize,
+                              const mz_uint32 flags)
+{
+    if (r->m_state == 2) {
+        *inSize = 0;
+        *outSize = 0;
+        return TINFL_STATUS_DONE;
+    }
+    if (r->m_state == 0) {
+        z_stream* stream = new z_stream();
+        if (inflateInit2(stream, (flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? MAX_WBITS : -MAX_WBITS) != Z_OK) {
+            delete stream;
+            return TINFL_STATUS_FAILED;
+        }
+        r->m_stream = stream;
+        r->m_state = 1;
+    }
+    z_stream* stream = (z_stream*)r->m_stream;
+    stream->next_in = (Bytef*)in;
+    stream->avail_in = *inSize;
+    stream->next_out = outNext;
+    stream->avail_out = *outSize;
+    int ret = inflate(stream, Z_NO_FLUSH);
+    *inSize -= stream->avail_in;
+    *outSize -= stream->avail_out;
+    if (ret == Z_STREAM_END) {
+        return finish(r, TINFL_STATUS_DONE);
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return finish(r, TINFL_STATUS_FAILED);
+    }
+    if (stream->avail_out == 0) {
+        return TINFL_STATUS_HAS_MORE_OUTPUT;
+    }
+    if ((flags & TINFL_FLAG_HAS_MORE_INPUT) == 0) {
+        return finish(r, TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS);
+    }
+    return TINFL_STATUS_NEEDS_MORE_INPUT;
+}
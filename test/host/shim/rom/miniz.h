@@ -0,0 +1,44 @@
+#ifndef HOST_MINIZ_H
+#define HOST_MINIZ_H
+
+/*
+tinfl API of the ESP32 ROM, implemented with zlib (shim/miniz.cpp): only the streaming use of
+OTAPackageDecoder is supported (zlib header, caller-provided circular window).
+*/
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+
+typedef enum {
+    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+typedef struct {
+    mz_uint32 m_state;
+    void* m_stream;
+} tinfl_decompressor;
+
+#define tinfl_init(r) \
+    do {                  \
+        (r)->m_state = 0; \
+    } while (0)
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* in, size_t* inSize, mz_uint8* outStart, mz_uint8* outNext, size_t* outSize,
+                              const mz_uint32 flags);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <cstdio>
+
+/*
+Minimal checks for the host tests: a failed CHECK prints its location and the test goes on,
+main() returns testResult() so that make stops on the first failing test binary.
+*/
+static int testChecks = 0;
+static int testFailures = 0;
+
+#define CHECK(condition) testCheck((condition), #condition, __FILE__, __LINE__)
+
+static inline bool testCheck(bool passed, const char* condition, const char* file, int line)
+{
+    testChecks++;
+    if (!passed) {
+        testFailures++;
+        printf("%s:%d: CHECK(%s) failed\n", file, line, condition);
+    }
+    return passed;
+}
+
+static inline int testResult(const char* name)
+{
+    printf("%s: %d checks, %d failed\n", name, testChecks, testFailures);
+    return testFailures == 0 ? 0 : 1;
+}
+
+#endif
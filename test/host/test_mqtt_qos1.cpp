@@ -0,0 +1,204 @@
+/*
+QoS 1 publications of MQTTManager (publishQos1, checkInflight) with PubSubClient against the in-process
+broker stand-in, on the manual clock: in-flight window, retransmission with DUP after the ack timeout,
+drop after the last retry, resend after a reconnection, packet ids apart from the SUBSCRIBE ones.
+*/
+#include "../../include/MQTTManager.h"
+#include "HostFlash.h"
+#include "MQTTBroker.h"
+#include "test.h"
+#include <set>
+
+#define BROKER_PORT 1883
+#define ACK_TIMEOUT 1000  // ms, well below the keep alive of PubSubClient (15 s)
+#define MAX_RETRIES 2
+
+static EventManager eventManager;
+static Configuration config;
+static MQTTManager mqttManager(config, eventManager);
+
+// loops and timer ticks (MainController runs checkInflight every 100 ms) during ms milliseconds
+static void run(unsigned long ms)
+{
+    for (unsigned long elapsed = 0; elapsed <= ms; elapsed += 10) {
+        mqttManager.loop();
+        if (elapsed % 100 == 0) {
+            mqttManager.checkInflight();
+        }
+        delay(10);
+    }
+}
+
+static size_t countDup(const std::vector<MQTTBroker::Publication>& publications, bool dup)
+{
+    size_t count = 0;
+    for (const auto& publication : publications) {
+        count += publication.qos == 1 && publication.dup == dup;
+    }
+    return count;
+}
+
+static void testWindow(MQTTBroker& broker)
+{
+    broker.publications.clear();
+    broker.ackPublications = false;
+    for (int i = 0; i < 6; i++) {
+        CHECK(mqttManager.publishQos1("test/qos1", "message " + String(i)));
+    }
+    // only the window is sent, the rest waits for acks
+    mqttManager.loop();
+    CHECK(broker.publications.size() == 3);
+    CHECK(mqttManager.getQos1Infos().startsWith("QoS 1: 3/3 in flight, 3 waiting"));
+    for (const auto& publication : broker.publications) {
+        CHECK(publication.qos == 1 && !publication.dup && !publication.retained && publication.topic == "test/qos1");
+    }
+    CHECK(broker.publications[0].payload == "message 0" && broker.publications[2].payload == "message 2");
+
+    // one ack frees one slot, refilled by the next timer tick
+    broker.ack(broker.publications[0].packetId);
+    run(100);
+    CHECK(broker.publications.size() == 4);
+    CHECK(broker.publications.back().payload == "message 3" && !broker.publications.back().dup);
+
+    // the broker acks everything from now on
+    broker.ackPublications = true;
+    for (size_t i = 1; i < broker.publications.size(); i++) {
+        broker.ack(broker.publications[i].packetId);
+    }
+    run(ACK_TIMEOUT / 2);
+    CHECK(broker.publications.size() == 6);
+    CHECK(broker.publications.back().payload == "message 5");
+    CHECK(countDup(broker.publications, true) == 0);
+    CHECK(mqttManager.getQos1Infos().startsWith("QoS 1: 0/3 in flight, 0 waiting"));
+}
+
+static void testRetransmission(MQTTBroker& broker)
+{
+    broker.publications.clear();
+    broker.ackPublications = false;
+    CHECK(mqttManager.publishQos1("test/retry", "payload", true));
+    mqttManager.loop();
+    CHECK(broker.publications.size() == 1);
+    uint16_t packetId = broker.publications[0].packetId;
+
+    // no retransmission before the ack timeout
+    run(ACK_TIMEOUT - 200);
+    CHECK(broker.publications.size() == 1);
+    // then resent with DUP, same packet id
+    run(300);
+    CHECK(broker.publications.size() == 2);
+    CHECK(broker.publications[1].dup && broker.publications[1].retained);
+    CHECK(broker.publications[1].packetId == packetId && broker.publications[1].payload == "payload");
+
+    // acked: nothing more
+    broker.ack(packetId);
+    run(3 * ACK_TIMEOUT);
+    CHECK(broker.publications.size() == 2);
+    CHECK(mqttManager.getQos1Infos().startsWith("QoS 1: 0/3"));
+    broker.ackPublications = true;
+}
+
+static void testDrop(MQTTBroker& broker)
+{
+    broker.publications.clear();
+    broker.ackPublications = false;
+    CHECK(mqttManager.publishQos1("test/drop", "lost"));
+    // first sending and MAX_RETRIES retransmissions, then dropped
+    run((MAX_RETRIES + 2) * ACK_TIMEOUT);
+    CHECK(broker.publications.size() == 1 + MAX_RETRIES);
+    CHECK(countDup(broker.publications, true) == MAX_RETRIES);
+    CHECK(mqttManager.getQos1Infos().startsWith("QoS 1: 0/3 in flight, 0 waiting"));
+    CHECK(mqttManager.getQos1Infos().endsWith("failed: 1"));
+    run(3 * ACK_TIMEOUT);
+    CHECK(broker.publications.size() == 1 + MAX_RETRIES);
+    broker.ackPublications = true;
+}
+
+static void testReconnection(MQTTBroker& broker)
+{
+    broker.publications.clear();
+    broker.ackPublications = false;
+    CHECK(mqttManager.publishQos1("test/reconnect", "in flight"));
+    mqttManager.loop();
+    CHECK(broker.publications.size() == 1);
+    uint16_t packetId = broker.publications[0].packetId;
+
+    // connection lost: kept in flight, and published while disconnected: queued
+    uint32_t connections = broker.connections;
+    broker.close();
+    mqttManager.loop();
+    CHECK(!mqttManager.isConnected());
+    CHECK(mqttManager.publishQos1("test/reconnect", "queued"));
+    CHECK(broker.publications.size() == 1);
+
+    // resent with DUP and the same id after the reconnection (backoff up to backoffMin), then the queued one
+    broker.ackPublications = true;
+    run(1500);
+    CHECK(mqttManager.isConnected() && broker.connections == connections + 1);
+    CHECK(broker.publications.size() == 3);
+    if (broker.publications.size() == 3) {
+        CHECK(broker.publications[1].dup && broker.publications[1].packetId == packetId && broker.publications[1].payload == "in flight");
+        CHECK(!broker.publications[2].dup && broker.publications[2].payload == "queued");
+    }
+    CHECK(mqttManager.getQos1Infos().startsWith("QoS 1: 0/3 in flight, 0 waiting"));
+}
+
+static void testPacketIds(MQTTBroker& broker)
+{
+    // PubSubClient numbers its SUBSCRIBE packets from 1: the QoS 1 ids stay apart, and are not reused in flight
+    mqttManager.subscribe("test/sub/a");
+    mqttManager.subscribe("test/sub/b");
+    mqttManager.unsubscribe("test/sub/a");
+    broker.publications.clear();
+    broker.ackPublications = false;
+    for (int i = 0; i < 3; i++) {
+        mqttManager.publishQos1("test/ids", String(i));
+    }
+    mqttManager.loop();
+    CHECK(!broker.subscribeIds.empty());
+    std::set<uint16_t> ids;
+    for (const auto& publication : broker.publications) {
+        CHECK(publication.packetId >= 0x8000);
+        ids.insert(publication.packetId);
+    }
+    CHECK(ids.size() == broker.publications.size());
+    for (uint16_t id : broker.subscribeIds) {
+        CHECK(id > 0 && id < 0x8000);
+        CHECK(ids.count(id) == 0);
+    }
+    broker.ackPublications = true;
+    for (const auto& publication : broker.publications) {
+        broker.ack(publication.packetId);
+    }
+    run(200);
+    CHECK(mqttManager.getQos1Infos().startsWith("QoS 1: 0/3"));
+}
+
+int main()
+{
+    HostFlash::storageDir = "";  // configuration in RAM
+    Serial.quiet = true;
+    hostClockManual(true);
+
+    MQTTBroker broker(BROKER_PORT);
+    broker.keepPublications = true;
+    config.init(eventManager);
+    config.setPreference("hostname", "qos1");
+    config.setPreference("mq_serv", "127.0.0.1");
+    config.setPreference("mq_port", BROKER_PORT);
+
+    mqttManager.init();
+    mqttManager.setInflightWindow(3, ACK_TIMEOUT, MAX_RETRIES);
+    mqttManager.setStatus(2);
+    run(100);
+    if (!CHECK(mqttManager.isConnected())) {
+        return testResult("test_mqtt_qos1");
+    }
+
+    testWindow(broker);
+    testRetransmission(broker);
+    testDrop(broker);
+    testReconnection(broker);
+    testPacketIds(broker);
+    return testResult("test_mqtt_qos1");
+}
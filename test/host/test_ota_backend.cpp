@@ -0,0 +1,391 @@
+/*
+PackageOTABackend through its HTTP client seam, against the canned server and the in-memory partitions of
+shim/HostOTA.h, with the packages built by tools/ota_package.py (see the Makefile), on the manual clock:
+plain images and packages, HTTP status and connection errors, signed manifest, reads without data
+(-ESP_ERR_HTTP_EAGAIN), the stall timeout, and the resume with Range requests after a lost connection.
+*/
+#include "../../include/OTAUpdater.h"
+#include "HostOTA.h"
+#include "test.h"
+#include <fstream>
+#include <iterator>
+
+#define URL "http://host/fw.bin"
+
+static String dataDir;
+static unsigned long longestStep = 0;  // ms, of the last download()
+
+static std::string readFile(const char* name)
+{
+    std::ifstream file((dataDir + "/" + name).c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void serve(const std::string& content)
+{
+    HostHttp::reset();
+    HostOTA::reset();
+    HostHttp::files = {{URL, content}};
+}
+
+// step() until done or error, the rest of the main loop takes 1 ms between two steps
+static ota_step_result download(PackageOTABackend& backend, int maxSteps = 100000)
+{
+    ota_step_result result = OTA_STEP_CONTINUE;
+    longestStep = 0;
+    for (int i = 0; i < maxSteps && result == OTA_STEP_CONTINUE; i++) {
+        unsigned long start = millis();
+        result = backend.step();
+        longestStep = std::max(longestStep, millis() - start);
+        delay(1);
+    }
+    return result;
+}
+
+static HostHttpResponse lostAfter(size_t bytes)
+{
+    HostHttpResponse response;
+    response.breakAfter = bytes;
+    return response;
+}
+
+static HostHttpResponse refused()
+{
+    HostHttpResponse response;
+    response.openError = ESP_ERR_HTTP_CONNECT;
+    return response;
+}
+
+static void testPlainImage(const std::string& image)
+{
+    serve(image);
+    PackageOTABackend backend;
+    CHECK(backend.begin(URL));
+    CHECK(backend.getTotal() == image.size());
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(backend.getReceived() == image.size());
+    CHECK(backend.finish());
+    CHECK(HostOTA::written == image && HostOTA::bootSelected);
+    CHECK(HostHttp::requests.size() == 1 && HostHttp::requests[0].range.empty());
+    CHECK(backend.getInfos().startsWith("No manifest\nPlain image, " + String((int)image.size())));
+    CHECK(HostHttp::openClients == 0);
+}
+
+static void testPackages(const std::string& image)
+{
+    // full package, compressed
+    serve(readFile("full.bin"));
+    PackageOTABackend backend;
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(backend.getInfos().indexOf("Full package") > 0);
+    CHECK(backend.finish());
+    CHECK(HostOTA::written == image && HostOTA::bootSelected);
+
+    // delta from the running partition
+    serve(readFile("delta.bin"));
+    HostOTA::running = readFile("base.bin");
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(backend.getInfos().indexOf("Delta package") > 0);
+    CHECK(backend.finish());
+    CHECK(HostOTA::written == image && HostOTA::bootSelected);
+
+    // image not validated by esp_ota_end: the boot partition is not changed
+    serve(image);
+    HostOTA::validImage = false;
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(!backend.finish());
+    CHECK(backend.getError() == "finish: ESP_ERR_OTA_VALIDATE_FAILED");
+    CHECK(!HostOTA::bootSelected);
+    CHECK(HostHttp::openClients == 0);
+}
+
+static void testStatus(const std::string& image)
+{
+    PackageOTABackend backend;
+    serve(image);
+    HostHttp::files.clear();
+    CHECK(!backend.begin(URL));
+    CHECK(backend.getError() == "HTTP 404");
+
+    serve(image);
+    HostHttpResponse refused;
+    refused.openError = ESP_ERR_HTTP_CONNECT;
+    HostHttp::responses.push_back(refused);
+    CHECK(!backend.begin(URL));
+    CHECK(backend.getError() == "connect: ESP_ERR_HTTP_CONNECT");
+
+    serve(image);
+    HostHttpResponse serverError;
+    serverError.status = 500;
+    serverError.body = "Internal Server Error";
+    HostHttp::responses.push_back(serverError);
+    CHECK(!backend.begin(URL));
+    CHECK(backend.getError() == "HTTP 500");
+
+    // a part of the file where the whole one is expected
+    serve(image);
+    HostHttpResponse partial;
+    partial.status = 206;
+    partial.body = image.substr(1000);
+    HostHttp::responses.push_back(partial);
+    CHECK(!backend.begin(URL));
+    CHECK(backend.getError() == "HTTP 206");
+    CHECK(HostOTA::begins == 0);
+
+    // package shorter than its header announces
+    std::string package = readFile("full.bin");
+    serve(package.substr(0, package.size() / 2));
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_ERROR);
+    CHECK(backend.getError() == "wrong package size");
+    backend.abort();
+    CHECK(HostOTA::aborts == 0 && !HostOTA::bootSelected);  // failed before esp_ota_begin
+
+    // without Content-Length, the server ends the response before the end of the package
+    serve(image);
+    HostHttpResponse truncated;
+    truncated.status = 200;
+    truncated.contentLength = 0;
+    truncated.body = package.substr(0, package.size() / 2);
+    HostHttp::responses.push_back(truncated);
+    CHECK(backend.begin(URL));
+    CHECK(backend.getTotal() == 0);
+    CHECK(download(backend) == OTA_STEP_ERROR);
+    CHECK(backend.getError() == "incomplete image");
+    backend.abort();
+    CHECK(HostOTA::aborts == 1 && !HostOTA::bootSelected);
+    CHECK(HostHttp::openClients == 0);
+}
+
+static void testManifest(const std::string& image)
+{
+    std::string key = readFile("ota_public.pem");
+    PackageOTABackend backend;
+    backend.setPublicKey(key.c_str());
+
+    serve(image);
+    CHECK(!backend.begin(URL));
+    CHECK(backend.getError() == "manifest: HTTP 404");
+    CHECK(HostHttp::requests.size() == 1 && HostHttp::requests[0].url == URL ".manifest");
+
+    serve(image);
+    HostHttp::files.push_back({URL ".manifest", readFile("new.bin.manifest")});
+    CHECK(backend.begin(URL));
+    CHECK(HostHttp::requests.size() == 2 && HostHttp::requests[1].url == URL);
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(backend.finish());
+    CHECK(backend.getInfos().startsWith("Signed manifest"));
+    CHECK(HostOTA::bootSelected);
+
+    // another image than the signed one: not written
+    serve(readFile("base.bin"));
+    HostHttp::files.push_back({URL ".manifest", readFile("new.bin.manifest")});
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_ERROR);
+    CHECK(backend.getError() == "image size does not match the manifest");
+    backend.abort();
+    CHECK(HostOTA::begins == 0 && !HostOTA::bootSelected);
+    CHECK(HostHttp::openClients == 0);
+}
+
+static void testReadTimeout(const std::string& image)
+{
+    // the server pauses for 5 s: the reads return without data, each within OTA_READ_TIMEOUT, no reconnection
+    serve(image);
+    HostHttpResponse paused;
+    paused.stallAfter = image.size() / 3;
+    paused.stallMs = 5000;
+    HostHttp::responses.push_back(paused);
+    PackageOTABackend backend;
+    CHECK(backend.begin(URL));
+    unsigned long start = millis();
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(millis() - start >= 5000);
+    CHECK(longestStep <= OTA_READ_TIMEOUT);
+    CHECK(HostHttp::requests.size() == 1);
+    CHECK(backend.finish() && HostOTA::written == image);
+    CHECK(backend.getInfos().indexOf("resumed") < 0);
+}
+
+static void testStallTimeout(const std::string& image)
+{
+    // the server stops sending without closing: reconnection OTA_STALL_TIMEOUT after the last data, then 1 s of backoff
+    serve(image);
+    HostHttpResponse stalled;
+    stalled.stallAfter = image.size() / 3;
+    HostHttp::responses.push_back(stalled);
+    PackageOTABackend backend;
+    CHECK(backend.begin(URL));
+    unsigned long lastData = 0;
+    ota_step_result result = OTA_STEP_CONTINUE;
+    while (result == OTA_STEP_CONTINUE && HostHttp::requests.size() == 1) {
+        size_t received = backend.getReceived();
+        result = backend.step();
+        if (backend.getReceived() != received) {
+            lastData = millis();
+        }
+        delay(1);
+    }
+    CHECK(result == OTA_STEP_CONTINUE);
+    CHECK(backend.getReceived() == image.size() / 3);
+    CHECK(millis() - lastData >= OTA_STALL_TIMEOUT + 1000);
+    CHECK(millis() - lastData <= OTA_STALL_TIMEOUT + 1000 + 2 * OTA_READ_TIMEOUT);
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(backend.finish() && HostOTA::written == image);
+    CHECK(backend.getInfos().indexOf("resumed 1 times") > 0);
+    CHECK(HostHttp::openClients == 0);
+}
+
+static void testResume(const std::string& image)
+{
+    // the decoder goes on across the reconnections: compressed package, delta package, plain image
+    const char* files[] = {"full.bin", "delta.bin", "new.bin"};
+    for (const char* name : files) {
+        std::string file = readFile(name);
+        serve(file);
+        HostOTA::running = readFile("base.bin");
+        size_t breaks[] = {1000, file.size() / 2, file.size() - 10};
+        HostHttp::responses = {lostAfter(breaks[0]), lostAfter(breaks[1] - breaks[0]), lostAfter(breaks[2] - breaks[1])};
+        PackageOTABackend backend;
+        CHECK(backend.begin(URL));
+        CHECK(download(backend) == OTA_STEP_DONE);
+        CHECK(backend.finish() && HostOTA::written == image);
+        CHECK(HostOTA::begins == 1);
+        CHECK(backend.getInfos().indexOf("resumed 3 times") > 0);
+        CHECK(HostHttp::requests.size() == 4);
+        for (size_t i = 0; i < 3 && HostHttp::requests.size() == 4; i++) {
+            CHECK(HostHttp::requests[i + 1].range == "bytes=" + std::to_string(breaks[i]) + "-");
+        }
+    }
+}
+
+static void testResumeStatus(const std::string& image)
+{
+    size_t lost = image.size() / 2;
+
+    // 200, the whole file again: the server ignores Range, not resumed on it
+    serve(image);
+    HostHttpResponse whole;
+    whole.status = 200;
+    whole.body = image;
+    HostHttp::responses = {lostAfter(lost), whole};
+    PackageOTABackend backend;
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(HostHttp::requests.size() == 3);
+    CHECK(backend.finish() && HostOTA::written == image);
+    CHECK(backend.getInfos().indexOf("resumed 1 times") > 0);
+
+    // never a 206: given up after OTA_RESUME_RETRIES failures, the lost connection included
+    serve(image);
+    HostHttp::responses = {lostAfter(lost)};
+    for (int i = 0; i < OTA_RESUME_RETRIES; i++) {
+        HostHttp::responses.push_back(whole);
+    }
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_ERROR);
+    CHECK(backend.getError() == "resume: HTTP 200 at " + String((int)lost) + " bytes");
+    CHECK(HostHttp::requests.size() == 1 + OTA_RESUME_RETRIES);
+    backend.abort();
+    CHECK(HostOTA::aborts == 1 && !HostOTA::bootSelected);
+
+    // 206 with a Content-Length other than the rest of the file
+    serve(image);
+    HostHttpResponse wrongLength;
+    wrongLength.status = 206;
+    wrongLength.body = image.substr(lost);
+    wrongLength.contentLength = image.size() - lost + 1;
+    HostHttp::responses = {lostAfter(lost), wrongLength};
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(HostHttp::requests.size() == 3);
+    CHECK(backend.finish() && HostOTA::written == image);
+
+    serve(image);
+    HostHttp::responses = {lostAfter(lost)};
+    for (int i = 0; i < OTA_RESUME_RETRIES; i++) {
+        HostHttp::responses.push_back(wrongLength);
+    }
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_ERROR);
+    CHECK(backend.getError() == "resume: wrong length at " + String((int)lost) + " bytes");
+    CHECK(HostHttp::openClients == 0);
+}
+
+static void testResumeRetries(const std::string& image)
+{
+    // OTA_RESUME_RETRIES failures in a row (the lost connection, then refused ones), 1 s more to wait each time
+    serve(image);
+    size_t lost = image.size() / 3;
+    HostHttp::responses = {lostAfter(lost)};
+    for (int i = 0; i < OTA_RESUME_RETRIES - 1; i++) {
+        HostHttp::responses.push_back(refused());
+    }
+    PackageOTABackend backend;
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(backend.finish() && HostOTA::written == image);
+    CHECK(HostHttp::requests.size() == 1 + OTA_RESUME_RETRIES);
+    for (size_t i = 2; i < HostHttp::requests.size(); i++) {
+        unsigned long wait = HostHttp::requests[i].at - HostHttp::requests[i - 1].at;
+        CHECK(wait >= 1000 * i && wait <= 1000 * i + 2);
+        CHECK(HostHttp::requests[i].range == "bytes=" + std::to_string(lost) + "-");
+    }
+
+    // one more: the download fails
+    serve(image);
+    HostHttp::responses = {lostAfter(lost)};
+    for (int i = 0; i < OTA_RESUME_RETRIES; i++) {
+        HostHttp::responses.push_back(refused());
+    }
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_ERROR);
+    CHECK(backend.getError() == "connect: ESP_ERR_HTTP_CONNECT at " + String((int)lost) + " bytes");
+    CHECK(HostHttp::requests.size() == 1 + OTA_RESUME_RETRIES);
+    backend.abort();
+    CHECK(!HostOTA::bootSelected);
+
+    // the count restarts with the data: twice OTA_RESUME_RETRIES failures, not in a row
+    serve(image);
+    for (int lostConnections = 0; lostConnections < 2; lostConnections++) {
+        HostHttp::responses.push_back(lostAfter(lost));
+        for (int i = 0; i < OTA_RESUME_RETRIES - 1; i++) {
+            HostHttp::responses.push_back(refused());
+        }
+    }
+    CHECK(backend.begin(URL));
+    CHECK(download(backend) == OTA_STEP_DONE);
+    CHECK(backend.finish() && HostOTA::written == image);
+    CHECK(backend.getInfos().indexOf("resumed 2 times") > 0);
+    CHECK(HostHttp::openClients == 0);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        printf("usage: %s <package directory>\n", argv[0]);
+        return 2;
+    }
+    dataDir = argv[1];
+    std::string image = readFile("new.bin");
+    if (image.empty()) {
+        printf("no images in %s\n", argv[1]);
+        return 2;
+    }
+    Serial.quiet = true;
+    hostClockManual(true);
+
+    testPlainImage(image);
+    testPackages(image);
+    testStatus(image);
+    testManifest(image);
+    testReadTimeout(image);
+    testStallTimeout(image);
+    testResume(image);
+    testResumeStatus(image);
+    testResumeRetries(image);
+    return testResult("test_ota_backend");
+}
@@ -0,0 +1,257 @@
+/*
+OTAPackageDecoder and OTAManifest on the host, with the packages built by tools/ota_package.py
+(see the Makefile): each package is fed in random chunk sizes and the output must be the image.
+*/
+#include "../../include/OTAPackage.h"
+#include "../../include/Tools.h"
+#include "test.h"
+#include <fstream>
+#include <iterator>
+#include <mbedtls/sha256.h>
+#include <random>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static String dataDir;
+
+static Bytes readFile(const char* name)
+{
+    std::ifstream file((dataDir + "/" + name).c_str(), std::ios::binary);
+    return Bytes(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+struct Result {
+    bool ok = false;
+    String error;
+    Bytes output;
+    uint32_t crc = 0;
+    size_t maxStep = 0;  // largest output of a single process()
+};
+
+static OTAPackageHeader headerOf(const Bytes& package)
+{
+    OTAPackageHeader header;
+    if (!header.parse(package.data())) {
+        // plain image, as OTAUpdater handles it
+        header = OTAPackageHeader();
+        header.imageSize = package.size();
+        header.payloadSize = package.size();
+    }
+    return header;
+}
+
+// Feed the payload in chunks of 1 to maxChunk bytes, through the in place input of the decoder
+static Result decode(const Bytes& package, const Bytes* source, std::mt19937& rng, size_t maxChunk)
+{
+    Result result;
+    OTAPackageHeader header = headerOf(package);
+    size_t pos = header.isPlain() ? 0 : OTA_PACKAGE_HEADER_SIZE;
+    OTAPackageDecoder decoder;
+    decoder.setOutput([&](const uint8_t* data, size_t length) {
+        result.output.insert(result.output.end(), data, data + length);
+        return true;
+    });
+    if (source != nullptr) {
+        decoder.setSource([source](uint32_t offset, uint8_t* data, size_t length) {
+            if (offset + length > source->size()) {
+                return false;
+            }
+            memcpy(data, source->data() + offset, length);
+            return true;
+        });
+    }
+    if (!decoder.begin(header)) {
+        result.error = decoder.getError();
+        return result;
+    }
+    while (!decoder.isComplete()) {
+        if (decoder.needsInput()) {
+            size_t space;
+            uint8_t* input = decoder.getInput(space);
+            size_t count = std::min(std::min(space, package.size() - pos), (size_t)(rng() % maxChunk + 1));
+            if (count == 0) {
+                result.error = "stalled";
+                return result;
+            }
+            memcpy(input, package.data() + pos, count);
+            pos += count;
+            decoder.commitInput(count);
+            continue;
+        }
+        size_t produced = decoder.getProduced();
+        if (!decoder.process()) {
+            result.error = decoder.getError();
+            return result;
+        }
+        result.maxStep = std::max(result.maxStep, decoder.getProduced() - produced);
+    }
+    if (!decoder.flush()) {
+        result.error = decoder.getError();
+        return result;
+    }
+    result.crc = decoder.getCrc();
+    result.ok = pos == package.size();
+    return result;
+}
+
+static void testRoundTrips(const Bytes& base, const Bytes& image)
+{
+    const char* packages[] = {"full.bin", "delta.bin", "delta_w9.bin", "new.bin"};
+    const size_t chunks[] = {1, 17, 700, 4096};
+    std::mt19937 rng(48);
+    for (const char* name : packages) {
+        Bytes package = readFile(name);
+        OTAPackageHeader header = headerOf(package);
+        for (size_t maxChunk : chunks) {
+            Result result = decode(package, &base, rng, maxChunk);
+            if (!CHECK(result.ok)) {
+                printf("  %s, chunks up to %zu bytes: %s\n", name, maxChunk, result.error.c_str());
+                continue;
+            }
+            CHECK(result.output == image);
+            CHECK(result.crc == crc32(image.data(), image.size()));
+            CHECK(header.isPlain() || result.crc == header.imageCrc);
+            CHECK(result.maxStep <= OTA_PACKAGE_STEP_BYTES + OTA_PACKAGE_OUTPUT_SIZE);
+        }
+    }
+}
+
+static void testPackageKinds()
+{
+    OTAPackageHeader header;
+    CHECK(header.parse(readFile("full.bin").data()));
+    CHECK(header.flags == OTA_PACKAGE_COMPRESSED && header.windowBits == 15);
+    CHECK(header.parse(readFile("delta.bin").data()));
+    CHECK(header.flags == (OTA_PACKAGE_COMPRESSED | OTA_PACKAGE_DELTA));
+    CHECK(header.parse(readFile("delta_w9.bin").data()));
+    CHECK(header.flags == (OTA_PACKAGE_COMPRESSED | OTA_PACKAGE_DELTA) && header.windowBits == 9);
+    CHECK(!header.parse(readFile("new.bin").data()));
+}
+
+static void testErrors(const Bytes& base, const Bytes& image)
+{
+    std::mt19937 rng(1);
+    Bytes delta = readFile("delta.bin");
+
+    Result result = decode(delta, nullptr, rng, 1000);
+    CHECK(!result.ok && result.error == "no delta source");
+
+    Bytes otherBase = base;
+    otherBase[otherBase.size() / 2] ^= 0x01;
+    result = decode(delta, &otherBase, rng, 1000);
+    CHECK(!result.ok && result.error == "the running firmware is not the delta source");
+    CHECK(result.output.empty());
+
+    // a corrupted deflate stream fails, or at least does not give the image CRC
+    Bytes corrupted = readFile("full.bin");
+    for (size_t i = OTA_PACKAGE_HEADER_SIZE + 100; i < corrupted.size(); i += corrupted.size() / 7) {
+        corrupted[i] ^= 0x5A;
+    }
+    result = decode(corrupted, &base, rng, 1000);
+    CHECK(!result.ok || result.crc != headerOf(corrupted).imageCrc);
+
+    // the payload is truncated, and its announced size too
+    Bytes truncated = readFile("full.bin");
+    truncated.resize(truncated.size() - 500);
+    uint32_t payloadSize = truncated.size() - OTA_PACKAGE_HEADER_SIZE;
+    memcpy(truncated.data() + 24, &payloadSize, 4);
+    result = decode(truncated, &base, rng, 1000);
+    CHECK(!result.ok && result.error.length() > 0);
+
+    Bytes wrongWindow = readFile("full.bin");
+    wrongWindow[6] = 16;
+    result = decode(wrongWindow, &base, rng, 1000);
+    CHECK(!result.ok && result.error == "invalid window size");
+
+    Bytes wrongFlags = readFile("full.bin");
+    wrongFlags[5] |= 0x80;
+    result = decode(wrongFlags, &base, rng, 1000);
+    CHECK(!result.ok && result.error.startsWith("unsupported package flags"));
+
+    // an image larger than its header says
+    Bytes larger = readFile("full.bin");
+    uint32_t imageSize = image.size() - 1;
+    memcpy(larger.data() + 8, &imageSize, 4);
+    result = decode(larger, &base, rng, 1000);
+    CHECK(!result.ok && result.error == "image larger than announced");
+
+    // the output refuses the second block
+    OTAPackageDecoder decoder;
+    OTAPackageHeader header = headerOf(image);
+    int writes = 0;
+    decoder.setOutput([&writes](const uint8_t* data, size_t length) { return ++writes < 2; });
+    CHECK(decoder.begin(header));
+    size_t pos = 0;
+    bool failed = false;
+    while (!failed && pos < image.size()) {
+        size_t space;
+        uint8_t* input = decoder.getInput(space);
+        size_t count = std::min(space, image.size() - pos);
+        memcpy(input, image.data() + pos, count);
+        pos += count;
+        decoder.commitInput(count);
+        failed = !decoder.process();
+    }
+    CHECK(failed && decoder.getError() == "write error at " + String(2 * OTA_PACKAGE_OUTPUT_SIZE));
+}
+
+static void testManifest(const Bytes& image)
+{
+    Bytes key = readFile("ota_public.pem");
+    key.push_back(0);
+    const char* publicKey = (const char*)key.data();
+    Bytes manifest = readFile("new.bin.manifest");
+
+    OTAManifest loaded;
+    CHECK(loaded.load(manifest.data(), manifest.size(), publicKey));
+    CHECK(loaded.error == "");
+    CHECK(loaded.imageSize == image.size());
+    uint8_t digest[32];
+    mbedtls_sha256(image.data(), image.size(), digest, 0);
+    CHECK(memcmp(loaded.sha256, digest, sizeof(digest)) == 0);
+
+    Bytes tampered = manifest;
+    tampered[12] ^= 0x01;  // first byte of the image SHA-256
+    CHECK(!loaded.load(tampered.data(), tampered.size(), publicKey));
+    CHECK(loaded.error == "invalid signature");
+
+    Bytes badSignature = manifest;
+    badSignature.back() ^= 0x01;
+    CHECK(!loaded.load(badSignature.data(), badSignature.size(), publicKey));
+
+    Bytes otherKey = readFile("other_public.pem");
+    otherKey.push_back(0);
+    CHECK(!loaded.load(manifest.data(), manifest.size(), (const char*)otherKey.data()));
+    CHECK(loaded.error == "invalid signature");
+
+    CHECK(!loaded.load(manifest.data(), manifest.size(), "not a key"));
+    CHECK(loaded.error == "invalid public key");
+
+    CHECK(!loaded.load(manifest.data(), OTA_MANIFEST_SIGNED_SIZE, publicKey));
+    CHECK(loaded.error == "invalid manifest");
+    Bytes wrongMagic = manifest;
+    wrongMagic[0] = 'X';
+    CHECK(!loaded.load(wrongMagic.data(), wrongMagic.size(), publicKey));
+    CHECK(loaded.error == "invalid manifest");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        printf("usage: %s <package directory>\n", argv[0]);
+        return 2;
+    }
+    dataDir = argv[1];
+    Bytes base = readFile("base.bin");
+    Bytes image = readFile("new.bin");
+    if (base.empty() || image.empty()) {
+        printf("no images in %s\n", argv[1]);
+        return 2;
+    }
+    testPackageKinds();
+    testRoundTrips(base, image);
+    testErrors(base, image);
+    testManifest(image);
+    return testResult("test_ota_package");
+}
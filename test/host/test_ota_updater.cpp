@@ -0,0 +1,261 @@
+/*
+OTAUpdater on the host with a fake OTABackend and the manual clock: loop budget, progress events,
+restart after done, abort and failures.
+*/
+#include "../../include/OTAUpdater.h"
+#include "test.h"
+#include <vector>
+
+// Downloads `total` bytes by `chunk` bytes per step, each step taking `stepMicros`
+class FakeBackend : public OTABackend
+{
+  public:
+    size_t total = 100000;
+    size_t chunk = 1000;
+    unsigned long stepMicros = 2000;
+    bool beginOk = true;
+    bool finishOk = true;
+    size_t errorAt = SIZE_MAX;  // step error once this many bytes are received
+
+    String url;
+    int steps = 0;
+    int finishes = 0;
+    int aborts = 0;
+
+    bool begin(const String& url) override
+    {
+        this->url = url;
+        received = 0;
+        error = beginOk ? "" : "connect: timeout";
+        return beginOk;
+    }
+    ota_step_result step() override
+    {
+        steps++;
+        hostClockAdvance(stepMicros);
+        if (received >= errorAt) {
+            error = "read error at " + String(received) + " bytes";
+            return OTA_STEP_ERROR;
+        }
+        size_t size = total > 0 ? total : 300000;
+        received = std::min(received + chunk, size);
+        return received == size ? OTA_STEP_DONE : OTA_STEP_CONTINUE;
+    }
+    bool finish() override
+    {
+        finishes++;
+        error = finishOk ? "" : "image checksum mismatch";
+        return finishOk;
+    }
+    void abort() override { aborts++; }
+
+    size_t getReceived() override { return received; }
+    size_t getTotal() override { return total; }
+    String getError() override { return error; }
+
+  private:
+    size_t received = 0;
+    String error;
+};
+
+struct Event {
+    String name;
+    std::vector<String> params;
+};
+
+struct Fixture {
+    EventManager eventManager;
+    OTAUpdater updater{eventManager};
+    FakeBackend backend;
+    std::vector<Event> events;
+
+    Fixture()
+    {
+        eventManager.registerCallback("ota", [this](const String& event, const std::vector<String>& params) { events.push_back({event, params}); });
+        updater.setBackend(&backend);
+        ESP.restarts = 0;
+    }
+
+    int count(const String& name)
+    {
+        int found = 0;
+        for (const Event& event : events) {
+            found += event.name == name;
+        }
+        return found;
+    }
+
+    // loop() until the state changes, returns the longest loop() in ms
+    unsigned long run(int maxLoops = 10000)
+    {
+        unsigned long longest = 0;
+        for (int i = 0; i < maxLoops && updater.getState() == OTA_DOWNLOADING; i++) {
+            unsigned long start = millis();
+            updater.loop();
+            longest = std::max(longest, millis() - start);
+            hostClockAdvance(5000);  // the rest of the main loop
+        }
+        return longest;
+    }
+};
+
+static void testStart()
+{
+    EventManager eventManager;
+    OTAUpdater updater(eventManager);
+    CHECK(!updater.start("http://host/fw.bin"));  // no backend
+    CHECK(updater.getState() == OTA_IDLE);
+
+    Fixture fixture;
+    CHECK(fixture.updater.start("http://host/fw.bin"));
+    CHECK(fixture.backend.url == "http://host/fw.bin");
+    CHECK(fixture.updater.isRunning());
+    CHECK(fixture.events.size() == 1 && fixture.events[0].name == "started" && fixture.events[0].params[0] == "100000");
+    CHECK(!fixture.updater.start("http://host/other.bin"));  // already running
+    CHECK(fixture.backend.url == "http://host/fw.bin");
+
+    Fixture failing;
+    failing.backend.beginOk = false;
+    CHECK(!failing.updater.start("http://host/fw.bin"));
+    CHECK(failing.updater.getState() == OTA_FAILED);
+    CHECK(failing.count("failed") == 1 && failing.events[0].params[0] == "connect: timeout");
+    CHECK(failing.updater.getInfos().indexOf("Error: connect: timeout") >= 0);
+}
+
+static void testBudget()
+{
+    Fixture fixture;
+    fixture.updater.budget = 20;
+    fixture.updater.start("http://host/fw.bin");
+    fixture.updater.loop();
+    CHECK(fixture.backend.steps == 10);  // 2 ms steps in a 20 ms budget
+
+    unsigned long longest = fixture.run();
+    CHECK(longest >= 20 && longest <= 20 + 2);
+    CHECK(fixture.updater.getState() == OTA_DONE);
+    CHECK(fixture.backend.steps == 100);
+
+    // a blocking step (connection) is not cut: the loop takes one step
+    Fixture slow;
+    slow.backend.stepMicros = 300000;
+    slow.updater.start("http://host/fw.bin");
+    unsigned long start = millis();
+    slow.updater.loop();
+    CHECK(slow.backend.steps == 1);
+    CHECK(millis() - start == 300);
+}
+
+static void testProgress()
+{
+    Fixture fixture;
+    fixture.backend.stepMicros = 10000;  // 2 % per loop
+    fixture.updater.start("http://host/fw.bin");
+    fixture.run();
+    std::vector<int> percents;
+    for (const Event& event : fixture.events) {
+        if (event.name == "progress") {
+            percents.push_back(event.params[0].toInt());
+            CHECK(event.params[2] == "100000");
+        }
+    }
+    CHECK(percents.size() == 21);  // 0, 5, ..., 100, each once
+    for (size_t i = 0; i < percents.size(); i++) {
+        CHECK(percents[i] == (int)i * 5);
+    }
+    CHECK(fixture.events.back().name == "done" && fixture.events.back().params[0] == "100000");
+
+    // unknown size: by 64 KB, without percent
+    Fixture unknown;
+    unknown.backend.total = 0;
+    unknown.backend.chunk = 4096;
+    unknown.updater.start("http://host/fw.bin");
+    unknown.run();
+    int progress = 0;
+    for (const Event& event : unknown.events) {
+        if (event.name == "progress") {
+            progress++;
+            CHECK(event.params[0] == "-1");
+        }
+    }
+    CHECK(progress == 300000 / 65536 + 1);
+    CHECK(unknown.updater.getState() == OTA_DONE);
+}
+
+static void testDone()
+{
+    Fixture fixture;
+    fixture.updater.start("http://host/fw.bin");
+    fixture.run();
+    CHECK(fixture.updater.getState() == OTA_DONE);
+    CHECK(fixture.backend.finishes == 1 && fixture.backend.aborts == 0);
+    CHECK(fixture.count("done") == 1);
+    CHECK(!fixture.updater.start("http://host/fw.bin"));
+
+    // the restart waits 1 s for the event and the logs
+    fixture.updater.loop();
+    CHECK(ESP.restarts == 0);
+    hostClockAdvance(990000);
+    fixture.updater.loop();
+    CHECK(ESP.restarts == 0);
+    hostClockAdvance(10000);
+    fixture.updater.loop();
+    CHECK(ESP.restarts == 1);
+    CHECK(fixture.backend.steps == 100);
+}
+
+static void testAbort()
+{
+    Fixture fixture;
+    fixture.updater.start("http://host/fw.bin");
+    fixture.updater.loop();
+    int steps = fixture.backend.steps;
+    fixture.updater.abort();
+    CHECK(fixture.updater.getState() == OTA_ABORTED);
+    CHECK(fixture.backend.aborts == 1 && fixture.backend.finishes == 0);
+    CHECK(fixture.count("aborted") == 1);
+    fixture.updater.loop();
+    CHECK(fixture.backend.steps == steps);
+    fixture.updater.abort();
+    CHECK(fixture.backend.aborts == 1);
+
+    // a new update can start
+    CHECK(fixture.updater.start("http://host/fw.bin"));
+    fixture.run();
+    CHECK(fixture.updater.getState() == OTA_DONE);
+}
+
+static void testErrors()
+{
+    Fixture fixture;
+    fixture.backend.errorAt = 30000;
+    fixture.updater.start("http://host/fw.bin");
+    fixture.run();
+    CHECK(fixture.updater.getState() == OTA_FAILED);
+    CHECK(fixture.backend.aborts == 1 && fixture.backend.finishes == 0);
+    CHECK(fixture.count("failed") == 1 && fixture.events.back().params[0] == "read error at 30000 bytes");
+    CHECK(fixture.updater.getInfos().indexOf("30000/100000 bytes (30%)") >= 0);
+    CHECK(ESP.restarts == 0);
+
+    Fixture invalid;
+    invalid.backend.finishOk = false;
+    invalid.updater.start("http://host/fw.bin");
+    invalid.run();
+    CHECK(invalid.updater.getState() == OTA_FAILED);
+    CHECK(invalid.backend.finishes == 1);
+    CHECK(invalid.count("done") == 0 && invalid.events.back().params[0] == "image checksum mismatch");
+    hostClockAdvance(2000000);
+    invalid.updater.loop();
+    CHECK(ESP.restarts == 0);
+}
+
+int main()
+{
+    hostClockManual(true);
+    testStart();
+    testBudget();
+    testProgress();
+    testDone();
+    testAbort();
+    testErrors();
+    return testResult("test_ota_updater");
+}
@@ -0,0 +1,116 @@
+/*
+MQTTPublishQueue with its spill file on the RAM file system of the LittleFS shim: overflow to the file
+and replay in order, replay position kept across a reboot, removal and latest-only replacement of
+messages read back from the file.
+*/
+#include "../../include/MQTTPublishQueue.h"
+#include "test.h"
+
+#define SPILL_PATH "/mqtt_queue.bin"
+
+// pop() every message, returns the payloads in order
+static String drain(MQTTPublishQueue& queue)
+{
+    String payloads;
+    while (queue.front() != nullptr) {
+        payloads += queue.front()->payload + " ";
+        queue.pop();
+    }
+    return payloads;
+}
+
+// a new queue on the same file system, as after a reboot
+static size_t sizeAfterReboot()
+{
+    MQTTPublishQueue rebooted(2, 4096);
+    rebooted.enableSpill(SPILL_PATH);
+    return rebooted.size();
+}
+
+static void testSpill()
+{
+    LittleFS.files.clear();
+    MQTTPublishQueue queue(2, 4096);
+    CHECK(queue.enableSpill(SPILL_PATH));
+    String longPayload(std::string(300, 'x').c_str());
+    const char* payloads[] = {"a", "b", "c", "d", "e"};
+    for (const char* payload : payloads) {
+        CHECK(queue.push("test/keep", payload));
+    }
+    CHECK(queue.push("test/keep", longPayload));
+    CHECK(queue.size() == 6 && queue.getStats().spilled == 4);
+    CHECK(sizeAfterReboot() == 4);
+
+    // read back by batches of the RAM tier size, the position is saved after each batch
+    CHECK(drain(queue) == "a b c d e " + longPayload + " ");
+    CHECK(queue.isEmpty());
+    CHECK(!LittleFS.exists(SPILL_PATH) && !LittleFS.exists(SPILL_PATH ".pos"));
+}
+
+static void testRemoveRefilled()
+{
+    LittleFS.files.clear();
+    MQTTPublishQueue queue(2, 4096);
+    queue.enableSpill(SPILL_PATH);
+    const char* topics[] = {"test/a", "test/b", "test/c", "test/d", "test/e"};
+    for (const char* topic : topics) {
+        queue.push(topic, String(topic).substring(5));
+    }
+    queue.pop();
+    queue.pop();
+    CHECK(queue.front() != nullptr && queue.front()->topic == "test/c");  // c and d read back
+
+    // removed before being sent: the batch ends with d, its position is saved
+    CHECK(queue.remove("test/c"));
+    CHECK(queue.size() == 2);
+    queue.pop();
+    CHECK(sizeAfterReboot() == 1);
+    CHECK(drain(queue) == "e ");
+    CHECK(!LittleFS.exists(SPILL_PATH));
+
+    // the whole batch removed
+    for (const char* topic : topics) {
+        queue.push(topic, String(topic).substring(5));
+    }
+    queue.pop();
+    queue.pop();
+    queue.front();
+    CHECK(queue.remove("test/c") && queue.remove("test/d"));
+    CHECK(sizeAfterReboot() == 1);
+    CHECK(drain(queue) == "e ");
+    CHECK(!LittleFS.exists(SPILL_PATH));
+}
+
+static void testReplaceRefilled()
+{
+    LittleFS.files.clear();
+    MQTTPublishQueue queue(2, 4096);
+    queue.enableSpill(SPILL_PATH);
+    const char* topics[] = {"test/a", "test/b", "test/c", "test/d", "test/e"};
+    for (const char* topic : topics) {
+        queue.push(topic, String(topic).substring(5));
+    }
+    queue.pop();
+    queue.pop();
+    queue.front();
+
+    // a newer value for c: the one read back is replaced, the new one stays in RAM
+    CHECK(queue.push("test/c", "c2", false, MQTT_QUEUE_LATEST_ONLY));
+    CHECK(queue.getStats().replaced == 1);
+    CHECK(queue.front()->topic == "test/d");
+    queue.pop();
+    CHECK(sizeAfterReboot() == 1);
+    CHECK(drain(queue) == "c2 e ");
+    CHECK(queue.isEmpty() && !LittleFS.exists(SPILL_PATH));
+}
+
+int main()
+{
+    Serial.quiet = true;
+    LittleFS.hostMounted = true;
+
+    testSpill();
+    testRemoveRefilled();
+    testReplaceRefilled();
+    return testResult("test_publish_queue");
+}
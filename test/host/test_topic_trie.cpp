@@ -0,0 +1,95 @@
+/*
+MQTTTopicTrie: routing compared to MQTTTopicTrie::matches for exact, '+' and '#' filters, '$' topics,
+and handlers added or removed while a message is dispatched.
+*/
+#include "../../include/MQTTTopicTrie.h"
+#include "test.h"
+#include <vector>
+
+static void testMatches()
+{
+    const char* filters[] = {"a/b/c", "a/+/c", "a/#", "+/b/#", "#", "a/b", "+", "a/+", "$SYS/#", "+/+/+", "a/b/c/#"};
+    const char* topics[] = {"a/b/c", "a/x/c", "a", "a/b", "b", "a/b/c/d", "$SYS/load", "$SYS", "x/b", "x/b/c", "a//c", "/b"};
+    MQTTTopicTrie trie;
+    std::vector<int> hits(sizeof(filters) / sizeof(filters[0]));
+    for (size_t i = 0; i < hits.size(); i++) {
+        CHECK(trie.add(filters[i], [&hits, i](const MQTTMessage& message) { hits[i]++; }) > 0);
+    }
+    CHECK(trie.size() == hits.size());
+    for (const char* topic : topics) {
+        std::fill(hits.begin(), hits.end(), 0);
+        size_t count = trie.match(topic, [](const MQTTMessageHandler& handler) { handler(MQTTMessage("", nullptr, 0)); });
+        size_t expected = 0;
+        for (size_t i = 0; i < hits.size(); i++) {
+            bool matches = MQTTTopicTrie::matches(filters[i], topic);
+            expected += matches;
+            if (!CHECK(hits[i] == (matches ? 1 : 0))) {
+                printf("  filter %s, topic %s\n", filters[i], topic);
+            }
+        }
+        CHECK(count == expected);
+    }
+    CHECK(trie.add("a/#/b", [](const MQTTMessage& message) {}) == 0);
+    CHECK(trie.add("", [](const MQTTMessage& message) {}) == 0);
+}
+
+static void testRemove()
+{
+    MQTTTopicTrie trie;
+    int calls = 0;
+    uint exact = trie.add("a/b", [&calls](const MQTTMessage& message) { calls++; });
+    uint multi = trie.add("a/#", [&calls](const MQTTMessage& message) { calls++; });
+    CHECK(trie.match("a/b", [](const MQTTMessageHandler& handler) { handler(MQTTMessage("a/b", nullptr, 0)); }) == 2);
+    CHECK(trie.remove(exact));
+    CHECK(!trie.remove(exact));
+    CHECK(trie.match("a/b", [](const MQTTMessageHandler& handler) { handler(MQTTMessage("a/b", nullptr, 0)); }) == 1);
+    CHECK(trie.remove(multi));
+    CHECK(trie.size() == 0);
+    CHECK(trie.match("a/b", [](const MQTTMessageHandler& handler) { handler(MQTTMessage("a/b", nullptr, 0)); }) == 0);
+    CHECK(calls == 3);
+}
+
+static void testChangesDuringDispatch()
+{
+    MQTTTopicTrie trie;
+    std::vector<String> calls;
+    uint second = 0;
+    uint self = 0;
+    // the first handler removes the second one and adds a third one, the last one removes itself
+    trie.add("t/#", [&](const MQTTMessage& message) {
+        calls.push_back("first");
+        trie.remove(second);
+        trie.add("t/x", [&calls](const MQTTMessage& message) { calls.push_back("added"); });
+    });
+    second = trie.add("t/+", [&calls](const MQTTMessage& message) { calls.push_back("second"); });
+    self = trie.add("t/x", [&](const MQTTMessage& message) {
+        trie.remove(self);
+        calls.push_back("self");  // still alive after its removal
+    });
+    size_t count = trie.match("t/x", [](const MQTTMessageHandler& handler) { handler(MQTTMessage("t/x", nullptr, 0)); });
+    CHECK(count == 2);
+    CHECK(calls.size() == 2 && calls[0] == "first" && calls[1] == "self");
+
+    calls.clear();
+    trie.match("t/x", [](const MQTTMessageHandler& handler) { handler(MQTTMessage("t/x", nullptr, 0)); });
+    CHECK(calls.size() == 2 && calls[0] == "first" && calls[1] == "added");  // the second one added is not called yet
+
+    // a handler routing another message through the same trie
+    MQTTTopicTrie nested;
+    int inner = 0;
+    nested.add("in", [&inner](const MQTTMessage& message) { inner++; });
+    nested.add("out", [&nested](const MQTTMessage& message) {
+        nested.match("in", [](const MQTTMessageHandler& handler) { handler(MQTTMessage("in", nullptr, 0)); });
+    });
+    nested.add("#", [](const MQTTMessage& message) {});
+    CHECK(nested.match("out", [](const MQTTMessageHandler& handler) { handler(MQTTMessage("out", nullptr, 0)); }) == 2);
+    CHECK(inner == 1);
+}
+
+int main()
+{
+    testMatches();
+    testRemove();
+    testChangesDuringDispatch();
+    return testResult("test_topic_trie");
+}
@@ -0,0 +1,178 @@
+/*
+WiFiManager connection logic (processWiFiEvents, checkAttempt) against the simulated station driver of
+the WiFi shim, on the manual clock: connection, loss and reconnection, fast connect fallback (with the
+whole timeout for the full attempt), wrong password, other stored networks, roaming, driver callbacks
+registered once.
+*/
+#include "../../include/WiFiManager.h"
+#include "HostFlash.h"
+#include "test.h"
+
+#define HOME 0
+#define OFFICE 1
+#define CONNECTION_TIMEOUT_MS 10000   // WiFiManager::CONNECTION_TIMEOUT
+#define FAST_CONNECT_TIMEOUT_MS 3000  // WiFiManager::FAST_CONNECT_TIMEOUT
+
+static EventManager eventManager;
+static Configuration config;
+static WiFiManager wifiManager(config, eventManager);
+static std::vector<String> events;  // "wifi/<event>"
+
+// driver task and loops during ms milliseconds
+static void run(unsigned long ms)
+{
+    for (unsigned long elapsed = 0; elapsed < ms; elapsed += 10) {
+        WiFi.hostProcess();
+        wifiManager.loop();
+        delay(10);
+    }
+}
+
+static bool received(const String& event)
+{
+    for (const String& received : events) {
+        if (received == event) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void testConnection()
+{
+    wifiManager.init();
+    CHECK(WiFi.hostHandlers() == 1);
+    run(1000);
+    CHECK(wifiManager.getStatus() == "Connected");
+    CHECK(wifiManager.isConnected() && received("wifi/connected"));
+    CHECK(WiFi.SSID() == "home" && !WiFi.beginBssid);  // nothing cached yet: full connection
+
+    // init() again (configuration reload): the driver callbacks are not registered twice
+    wifiManager.init(false);
+    wifiManager.init(false);
+    CHECK(WiFi.hostHandlers() == 1);
+    CHECK(wifiManager.getStatus() == "Connected");
+}
+
+static void testConnectionLost()
+{
+    events.clear();
+    uint32_t begins = WiFi.begins;
+    WiFi.hostDrop();
+    run(100);
+    CHECK(wifiManager.getStatus() == "Connection lost");
+    CHECK(!wifiManager.isConnected() && received("wifi/lost"));
+
+    // not recovered by the driver: new attempt after the timeout, on the cached channel and BSSID
+    run(9000);
+    CHECK(WiFi.begins == begins);
+    run(2000);
+    CHECK(WiFi.begins == begins + 1 && WiFi.beginBssid && WiFi.beginChannel == 6);
+    CHECK(wifiManager.getStatus() == "Connected" && received("wifi/connected"));
+}
+
+static void testFastConnectFallback()
+{
+    // the AP moved to another channel: the cached BSSID is not found, full connection
+    WiFi.accessPoints[HOME].channel = 1;
+    WiFi.hostDrop();
+    run(CONNECTION_TIMEOUT_MS + 2000);
+    CHECK(wifiManager.getStatus() == "Connected");
+    CHECK(!WiFi.beginBssid && WiFi.channel() == 1);
+    CHECK(wifiManager.getConnectInfos().indexOf("failed: 1") > 0);
+}
+
+static void testSlowFallback()
+{
+    // the fast attempt times out, the full one takes 8 s: more than what is left of the first CONNECTION_TIMEOUT
+    WiFi.accessPoints[HOME].channel = 11;
+    WiFi.hostDelay = 8000;
+    uint32_t begins = WiFi.begins;
+    WiFi.hostDrop();
+    run(CONNECTION_TIMEOUT_MS + FAST_CONNECT_TIMEOUT_MS + 8000 + 200);
+    CHECK(wifiManager.getStatus() == "Connected" && WiFi.channel() == 11);
+    CHECK(WiFi.begins == begins + 2);  // fast, full: not cut by the timeout of the fast one
+    CHECK(wifiManager.getConnectInfos().indexOf("failed: 2") > 0);
+    CHECK(wifiManager.getConnectInfos().startsWith("Last connection: 80"));
+    WiFi.hostDelay = 500;
+}
+
+static void testWrongPassword()
+{
+    // password changed on the AP: the attempt fails with AUTH_FAIL, the access point is started
+    events.clear();
+    WiFi.accessPoints[HOME].password = "changed";
+    WiFi.hostDrop();
+    run(CONNECTION_TIMEOUT_MS + 2000);
+    CHECK(wifiManager.getStatus() == "Wrong password");
+    CHECK(received("wifi/wrong_password") && received("wifi/ap_started"));
+    CHECK(WiFi.getMode() == WIFI_AP_STA);
+
+    // retried once the attempt times out, still reported as a wrong password
+    uint32_t begins = WiFi.begins;
+    run(CONNECTION_TIMEOUT_MS + 2000);
+    CHECK(WiFi.begins > begins);
+    CHECK(wifiManager.getStatus() == "Wrong password");
+
+    // fixed on the AP: connected by the next retry
+    WiFi.accessPoints[HOME].password = "secret";
+    run(CONNECTION_TIMEOUT_MS + 2000);
+    CHECK(wifiManager.getStatus() == "Connected" && WiFi.SSID() == "home");
+}
+
+static void testNextNetwork()
+{
+    // wrong password on the main network: the other stored network is tried next
+    CHECK(wifiManager.addProfile("office", "office-pass"));
+    WiFi.accessPoints[HOME].password = "changed";
+    WiFi.hostDrop();
+    run(2 * CONNECTION_TIMEOUT_MS + 2000);
+    CHECK(wifiManager.getStatus() == "Connected");
+    CHECK(WiFi.SSID() == "office");
+}
+
+static void testRoaming()
+{
+    // a stronger AP of the same network appears while the link weakens: roamed, not counted as a drop
+    events.clear();
+    WiFi.accessPoints.push_back({"office", "office-pass", {0x24, 0x0A, 0xC4, 0, 0, 3}, 1, -50});
+    WiFi.accessPoints[OFFICE].rssi = -85;
+    wifiManager.setRoaming(-75, 8, false);
+    ConnectionStats& stats = wifiManager.getStats();
+    uint32_t drops = stats.getDrops();
+    uint32_t reconnects = stats.getReconnects();
+    run(20000);
+    CHECK(received("wifi/roaming") && !received("wifi/lost"));
+    CHECK(wifiManager.getStatus() == "Connected" && WiFi.BSSID() != nullptr && WiFi.BSSID()[5] == 3);
+    CHECK(stats.getRoams() == 1 && stats.getDrops() == drops && stats.getReconnects() == reconnects);
+    CHECK(stats.getInfos().indexOf("roams: 1") > 0);
+    CHECK(wifiManager.getLinkInfos().indexOf("1 roams") > 0);
+}
+
+int main()
+{
+    HostFlash::storageDir = "";  // configuration in RAM
+    Serial.quiet = true;
+    hostClockManual(true);
+
+    WiFi.disconnect();
+    WiFi.accessPoints.push_back({"home", "secret", {0x24, 0x0A, 0xC4, 0, 0, 1}, 6, -60});
+    WiFi.accessPoints.push_back({"office", "office-pass", {0x24, 0x0A, 0xC4, 0, 0, 2}, 11, -65});
+
+    eventManager.registerMainCallback([](const String& type, const String& event, const std::vector<String>& params) {
+        events.push_back(type + "/" + event);
+        wifiManager.processEvent(type, event, params);
+    });
+    config.init(eventManager);
+    config.setPreference("wf_ssid", "home");
+    config.setPreference("wf_pass", "secret");
+
+    testConnection();
+    testConnectionLost();
+    testFastConnectFallback();
+    testSlowFallback();
+    testWrongPassword();
+    testNextNetwork();
+    testRoaming();
+    return testResult("test_wifi");
+}
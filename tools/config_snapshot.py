@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Encode / decode ESP32MiniFramework configuration snapshots.
+
+A snapshot is a 16 bytes header followed by a MessagePack map of the preferences:
+  magic "EMCS" | format (u8) | reserved (u8) | config version (u16 LE) | body length (u32 LE) | CRC32 of body (u32 LE)
+
+Usage:
+  config_snapshot.py encode config.json snapshot.bin [--version N] [--hex]
+  config_snapshot.py decode snapshot.bin [--hex]
+
+With --hex the snapshot is read / written as the console commands printed by sys:snapshot: several
+"sys:restore <hex>" lines, short enough for the console line (SERIAL_LINE_SIZE), to send back as they are.
+"""
+
+import argparse
+import json
+import struct
+import sys
+import zlib
+
+MAGIC = b"EMCS"
+FORMAT = 1
+HEADER = struct.Struct("<4sBBHII")
+LINE_BYTES = 248  # snapshot bytes per sys:restore line, (SERIAL_LINE_SIZE - 16) / 2
+
+
+def pack(value, out):
+    if value is None:
+        out.append(0xC0)
+    elif value is True or value is False:
+        out.append(0xC3 if value else 0xC2)
+    elif isinstance(value, int):
+        if 0 <= value < 0x80:
+            out.append(value)
+        elif -32 <= value < 0:
+            out.append(value & 0xFF)
+        elif -0x80000000 <= value < 0x80000000:
+            out += struct.pack(">Bi", 0xD2, value)
+        else:
+            out += struct.pack(">Bq", 0xD3, value)
+    elif isinstance(value, float):
+        out += struct.pack(">Bd", 0xCB, value)
+    elif isinstance(value, str):
+        data = value.encode("utf-8")
+        if len(data) < 32:
+            out.append(0xA0 | len(data))
+        elif len(data) < 0x100:
+            out += struct.pack(">BB", 0xD9, len(data))
+        else:
+            out += struct.pack(">BH", 0xDA, len(data))
+        out += data
+    elif isinstance(value, dict):
+        if len(value) < 16:
+            out.append(0x80 | len(value))
+        else:
+            out += struct.pack(">BH", 0xDE, len(value))
+        for key, item in value.items():
+            pack(str(key), out)
+            pack(item, out)
+    else:
+        raise ValueError("unsupported value: %r" % (value,))
+
+
+def unpack(data, pos=0):
+    tag = data[pos]
+    pos += 1
+    if tag < 0x80:
+        return tag, pos
+    if tag >= 0xE0:
+        return tag - 0x100, pos
+    if tag & 0xF0 == 0x80:
+        return unpack_map(data, pos, tag & 0x0F)
+    if tag & 0xE0 == 0xA0:
+        return unpack_str(data, pos, tag & 0x1F)
+    if tag == 0xC0:
+        return None, pos
+    if tag in (0xC2, 0xC3):
+        return tag == 0xC3, pos
+    fixed = {
+        0xCA: ">f", 0xCB: ">d",
+        0xCC: ">B", 0xCD: ">H", 0xCE: ">I", 0xCF: ">Q",
+        0xD0: ">b", 0xD1: ">h", 0xD2: ">i", 0xD3: ">q",
+    }
+    if tag in fixed:
+        fmt = struct.Struct(fixed[tag])
+        return fmt.unpack_from(data, pos)[0], pos + fmt.size
+    if tag in (0xD9, 0xDA, 0xDB):
+        fmt = struct.Struct({0xD9: ">B", 0xDA: ">H", 0xDB: ">I"}[tag])
+        return unpack_str(data, pos + fmt.size, fmt.unpack_from(data, pos)[0])
+    if tag in (0xDE, 0xDF):
+        fmt = struct.Struct({0xDE: ">H", 0xDF: ">I"}[tag])
+        return unpack_map(data, pos + fmt.size, fmt.unpack_from(data, pos)[0])
+    raise ValueError("unsupported MessagePack tag 0x%02x" % tag)
+
+
+def unpack_str(data, pos, length):
+    return data[pos:pos + length].decode("utf-8"), pos + length
+
+
+def unpack_map(data, pos, count):
+    result = {}
+    for _ in range(count):
+        key, pos = unpack(data, pos)
+        result[key], pos = unpack(data, pos)
+    return result, pos
+
+
+def encode(config, version):
+    body = bytearray()
+    pack(config, body)
+    return HEADER.pack(MAGIC, FORMAT, 0, version, len(body), zlib.crc32(body)) + bytes(body)
+
+
+def decode(blob):
+    if len(blob) < HEADER.size:
+        raise ValueError("snapshot too short")
+    magic, fmt, _, version, length, crc = HEADER.unpack_from(blob)
+    if magic != MAGIC or fmt != FORMAT:
+        raise ValueError("invalid header")
+    body = blob[HEADER.size:]
+    if len(body) != length:
+        raise ValueError("wrong length: %d, expected %d" % (len(body), length))
+    if zlib.crc32(body) != crc:
+        raise ValueError("checksum mismatch")
+    config, _ = unpack(body)
+    return version, config
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+    enc = sub.add_parser("encode")
+    enc.add_argument("json")
+    enc.add_argument("snapshot")
+    enc.add_argument("--version", type=int, default=1)
+    enc.add_argument("--hex", action="store_true")
+    dec = sub.add_parser("decode")
+    dec.add_argument("snapshot")
+    dec.add_argument("--hex", action="store_true")
+    args = parser.parse_args()
+
+    if args.command == "encode":
+        with open(args.json) as f:
+            blob = encode(json.load(f), args.version)
+        if args.hex:
+            with open(args.snapshot, "w") as f:
+                for pos in range(0, len(blob), LINE_BYTES):
+                    f.write("sys:restore " + blob[pos:pos + LINE_BYTES].hex() + "\n")
+        else:
+            with open(args.snapshot, "wb") as f:
+                f.write(blob)
+        print("%d bytes" % len(blob), file=sys.stderr)
+    else:
+        with open(args.snapshot, "rb") as f:
+            blob = f.read()
+        if args.hex:
+            # the last token of each line: sys:restore lines, or plain hexadecimal
+            blob = bytes.fromhex("".join(line.split()[-1] for line in blob.decode().splitlines() if line.strip()))
+        version, config = decode(blob)
+        print("version %d" % version, file=sys.stderr)
+        json.dump(config, sys.stdout, indent=2)
+        print()
+
+
+if __name__ == "__main__":
+    main()
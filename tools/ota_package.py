@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+"""Build / verify ESP32MiniFramework OTA packages (compressed and delta firmware images).
+
+A package is a 28 bytes header followed by the payload:
+  magic "EMOT" | format (u8) | flags (u8) | window bits (u8) | reserved (u8) |
+  image size (u32 LE) | image CRC32 (u32 LE) | source size (u32 LE) | source CRC32 (u32 LE) | payload size (u32 LE)
+
+Flags: 0x01 the payload is a zlib stream (window of 2^bits bytes, also the RAM used by the device to inflate it),
+       0x02 the payload is a delta against the running firmware (source), made of operations:
+  0x01 COPY   source offset (u32 LE) | length (u32 LE)
+  0x02 INSERT length (u32 LE) | bytes
+
+The device checks the CRC32 of its running firmware against the source before applying a delta.
+Plain firmware images (without header) are still accepted by the device.
+
+When the firmware has an OTA_PUBLIC_KEY, each image needs a manifest served next to it (<url>.manifest):
+  magic "EMOM" | format (u8) | reserved (3 bytes) | image size (u32 LE) | image SHA-256 | DER ECDSA signature
+The signature covers the first 44 bytes; it is made (and checked) with openssl.
+  openssl ecparam -name prime256v1 -genkey -noout -out ota_key.pem
+  openssl ec -in ota_key.pem -pubout -out ota_public.pem
+
+Usage:
+  ota_package.py build firmware.bin package.bin [--base old_firmware.bin] [--window 15] [--level 9] [--key ota_key.pem]
+  ota_package.py sign firmware.bin firmware.bin.manifest --key ota_key.pem
+  ota_package.py verify package.bin firmware.bin [--base old_firmware.bin] [--public-key ota_public.pem]
+  ota_package.py info package.bin
+
+build --key also writes package.bin.manifest, verify --public-key checks package.bin.manifest.
+"""
+
+import argparse
+import hashlib
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+MAGIC = b"EMOT"
+FORMAT = 1
+HEADER = struct.Struct("<4sBBBBIIIII")
+COMPRESSED = 0x01
+DELTA = 0x02
+OP_COPY = 0x01
+OP_INSERT = 0x02
+COPY = struct.Struct("<BII")
+INSERT = struct.Struct("<BI")
+MANIFEST_MAGIC = b"EMOM"
+MANIFEST = struct.Struct("<4sB3xI32s")
+BLOCK = 32  # minimum match length, longer than a COPY operation
+STEP = 4  # base firmware indexing step (code is mostly 4 bytes aligned)
+
+
+def diff(base, image):
+    index = {}
+    for offset in range(0, len(base) - BLOCK + 1, STEP):
+        index.setdefault(base[offset:offset + BLOCK], offset)
+
+    ops = bytearray()
+    literal_start = 0
+    last_source = -1  # where the previous match ended in the base, tried first
+    i = 0
+    while i + BLOCK <= len(image):
+        block = image[i:i + BLOCK]
+        if 0 <= last_source and base[last_source:last_source + BLOCK] == block:
+            source = last_source
+        else:
+            source = index.get(block, -1)
+        if source < 0:
+            i += 1
+            continue
+        # extend the match backwards into the pending literal, then forwards
+        while i > literal_start and source > 0 and image[i - 1] == base[source - 1]:
+            i -= 1
+            source -= 1
+        length = BLOCK
+        while i + length < len(image) and source + length < len(base) and image[i + length] == base[source + length]:
+            length += 1
+        if i > literal_start:
+            ops += INSERT.pack(OP_INSERT, i - literal_start) + image[literal_start:i]
+        ops += COPY.pack(OP_COPY, source, length)
+        i += length
+        literal_start = i
+        last_source = source + length
+    if literal_start < len(image):
+        ops += INSERT.pack(OP_INSERT, len(image) - literal_start) + image[literal_start:]
+    return bytes(ops)
+
+
+def patch(base, ops):
+    image = bytearray()
+    pos = 0
+    while pos < len(ops):
+        op = ops[pos]
+        if op == OP_COPY:
+            _, offset, length = COPY.unpack_from(ops, pos)
+            if offset + length > len(base):
+                raise ValueError("COPY outside of the source at %d" % pos)
+            image += base[offset:offset + length]
+            pos += COPY.size
+        elif op == OP_INSERT:
+            _, length = INSERT.unpack_from(ops, pos)
+            pos += INSERT.size
+            if pos + length > len(ops):
+                raise ValueError("truncated INSERT at %d" % pos)
+            image += ops[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError("invalid operation 0x%02x at %d" % (op, pos))
+    return bytes(image)
+
+
+def compress(data, window, level):
+    compressor = zlib.compressobj(level, zlib.DEFLATED, window)
+    return compressor.compress(data) + compressor.flush()
+
+
+def build(image, base, window, level):
+    """Return the smallest of the full compressed image and (with a base) the compressed delta."""
+    payload = compress(image, window, level)
+    flags = COMPRESSED
+    if base is not None:
+        delta = compress(diff(base, image), window, level)
+        print("full: %d bytes, delta: %d bytes" % (len(payload), len(delta)), file=sys.stderr)
+        if len(delta) < len(payload):
+            payload = delta
+            flags |= DELTA
+    source_size = len(base) if flags & DELTA else 0
+    source_crc = zlib.crc32(base) if flags & DELTA else 0
+    header = HEADER.pack(MAGIC, FORMAT, flags, window, 0, len(image), zlib.crc32(image), source_size, source_crc, len(payload))
+    return header + payload
+
+
+def parse(package):
+    if len(package) < HEADER.size:
+        raise ValueError("package too short")
+    magic, fmt, flags, window, _, size, crc, source_size, source_crc, length = HEADER.unpack_from(package)
+    if magic != MAGIC or fmt != FORMAT:
+        raise ValueError("invalid header")
+    payload = package[HEADER.size:]
+    if len(payload) != length:
+        raise ValueError("wrong payload length: %d, expected %d" % (len(payload), length))
+    return flags, window, size, crc, source_size, source_crc, payload
+
+
+def decode(package, base):
+    flags, window, size, crc, source_size, source_crc, payload = parse(package)
+    if flags & COMPRESSED:
+        decompressor = zlib.decompressobj(window)  # fails if the stream needs a larger window
+        payload = decompressor.decompress(payload) + decompressor.flush()
+        if not decompressor.eof or decompressor.unused_data:
+            raise ValueError("invalid zlib stream")
+    if flags & DELTA:
+        if base is None:
+            raise ValueError("delta package, the base firmware is needed")
+        if len(base) != source_size or zlib.crc32(base) != source_crc:
+            raise ValueError("base firmware does not match the package source")
+        payload = patch(base, payload)
+    if len(payload) != size:
+        raise ValueError("wrong image size: %d, expected %d" % (len(payload), size))
+    if zlib.crc32(payload) != crc:
+        raise ValueError("image checksum mismatch")
+    return payload
+
+
+def sign(image, key):
+    signed = MANIFEST.pack(MANIFEST_MAGIC, FORMAT, len(image), hashlib.sha256(image).digest())
+    signature = subprocess.run(["openssl", "dgst", "-sha256", "-sign", key], input=signed, stdout=subprocess.PIPE, check=True).stdout
+    return signed + signature
+
+
+def check_manifest(manifest, image, public_key):
+    if len(manifest) <= MANIFEST.size:
+        raise ValueError("manifest too short")
+    magic, fmt, size, digest = MANIFEST.unpack_from(manifest)
+    if magic != MANIFEST_MAGIC or fmt != FORMAT:
+        raise ValueError("invalid manifest header")
+    with tempfile.NamedTemporaryFile(delete=False) as f:
+        f.write(manifest[MANIFEST.size:])
+    try:
+        result = subprocess.run(["openssl", "dgst", "-sha256", "-verify", public_key, "-signature", f.name],
+                                input=manifest[:MANIFEST.size], stdout=subprocess.PIPE)
+    finally:
+        os.unlink(f.name)
+    if result.returncode != 0:
+        raise ValueError("invalid manifest signature")
+    if size != len(image) or digest != hashlib.sha256(image).digest():
+        raise ValueError("manifest does not match the image")
+
+
+def read(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+    bld = sub.add_parser("build")
+    bld.add_argument("firmware")
+    bld.add_argument("package")
+    bld.add_argument("--base")
+    bld.add_argument("--window", type=int, default=15, choices=range(9, 16))
+    bld.add_argument("--level", type=int, default=9, choices=range(1, 10))
+    bld.add_argument("--key")
+    sgn = sub.add_parser("sign")
+    sgn.add_argument("firmware")
+    sgn.add_argument("manifest")
+    sgn.add_argument("--key", required=True)
+    ver = sub.add_parser("verify")
+    ver.add_argument("package")
+    ver.add_argument("firmware")
+    ver.add_argument("--base")
+    ver.add_argument("--public-key")
+    inf = sub.add_parser("info")
+    inf.add_argument("package")
+    args = parser.parse_args()
+
+    base = read(args.base) if getattr(args, "base", None) else None
+    if args.command == "build":
+        image = read(args.firmware)
+        package = build(image, base, args.window, args.level)
+        # the package is only written if it decodes back to the firmware
+        if decode(package, base) != image:
+            raise SystemExit("round trip failed")
+        with open(args.package, "wb") as f:
+            f.write(package)
+        print("%d bytes (%.1f%% of %d)" % (len(package), len(package) * 100.0 / len(image), len(image)), file=sys.stderr)
+        if args.key:
+            with open(args.package + ".manifest", "wb") as f:
+                f.write(sign(image, args.key))
+    elif args.command == "sign":
+        with open(args.manifest, "wb") as f:
+            f.write(sign(read(args.firmware), args.key))
+    elif args.command == "verify":
+        image = read(args.firmware)
+        package = read(args.package)
+        # a plain image is its own package
+        if package[:4] == MAGIC and decode(package, base) != image or package[:4] != MAGIC and package != image:
+            raise SystemExit("image differs from the firmware")
+        if args.public_key:
+            check_manifest(read(args.package + ".manifest"), image, args.public_key)
+        print("OK", file=sys.stderr)
+    else:
+        flags, window, size, crc, source_size, source_crc, payload = parse(read(args.package))
+        print("%s, window %d bytes" % ("delta" if flags & DELTA else "full", 1 << window))
+        print("image: %d bytes, crc %08x" % (size, crc))
+        if flags & DELTA:
+            print("source: %d bytes, crc %08x" % (source_size, source_crc))
+        print("payload: %d bytes%s" % (len(payload), " (zlib)" if flags & COMPRESSED else ""))
+
+
+if __name__ == "__main__":
+    main()